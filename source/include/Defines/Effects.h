@@ -8,6 +8,8 @@ enum MoveType
     MOVE_TYPE_LINEAR     = 0,
     MOVE_TYPE_CIRCULAR   = 1,
     MOVE_TYPE_BEZIER     = 2,
+    MOVE_TYPE_POLYLINE   = 3,
+    MOVE_TYPE_SPLINE     = 4,
     MAX_MOVE_TYPE
 };
 
@@ -30,6 +32,21 @@ enum OffsetType
     OFFSET_TYPE_RELATIVE = 1,
 };
 
+struct EffectProgram;
+struct Effect;
+
+// maximum nesting of chained effects and maximum number of effects in one resolved chain
+#define EFFECT_CHAIN_MAX_DEPTH  64
+#define EFFECT_CHAIN_MAX_LENGTH 1024
+
+// link to next effect as written in effect definition, resolved after all effect files are parsed
+struct EffectChainLink
+{
+    std::wstring name;
+    uint32 repeat;          // 0 if not specified - chained effect is played once and cannot close a cycle by itself
+    Effect* target;
+};
+
 struct Effect
 {
     Effect()
@@ -41,6 +58,11 @@ struct Effect
 
     bool isBlocking;
 
+    // concurrent effect runs together with other effects on the element instead of being queued
+    bool isConcurrent;
+    // order of composing concurrent effects, lower goes first
+    int32 priority;
+
     // movement data
     uint32* moveType;
     int32* startPos; // 2 coords
@@ -61,8 +83,14 @@ struct Effect
     // movement data specific for each one type
     bool* circlePlus;
     CVector2* bezierVector; // 2 vectors !
+    std::vector<CVector2>* pathPoints; // points between start and end position for polyline and spline
+
+    std::vector<EffectChainLink> *m_effectChain;
+    // chain resolved to effects in order of playing, including chains of chained effects
+    std::vector<Effect*> *chain;
 
-    std::vector<std::wstring> *m_effectChain;
+    // compiled at first usage, see EffectHandler::CompileEffect
+    EffectProgram* program;
 };
 
 typedef std::map<const wchar_t*, Effect*> EffectMap;
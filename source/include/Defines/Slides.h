@@ -5,6 +5,57 @@
 
 typedef std::map<uint32, ExpressionTreeElement> ExprMap;
 
+class ExpressionProgram;
+
+// size of text buffer of expression in styled text, it has to fit any formatted 64bit number
+#define STYLED_EXPRESSION_TEXT_LEN 24
+
+// element properties, which expressions could read
+enum ExpressionDependency
+{
+    EXPR_DEP_X          = 0x01,
+    EXPR_DEP_Y          = 0x02,
+    EXPR_DEP_POSITION   = EXPR_DEP_X | EXPR_DEP_Y
+};
+
+// flags of expressions in styled text
+#define STYLED_EXPRESSION_DIRTY     0x01    // referenced element moved since the last evaluation
+#define STYLED_EXPRESSION_VOLATILE  0x02    // refers to something not tracked, so it's evaluated every time
+
+// state of prepared render list at the time of its last update - the list is shared with all copies
+// of prototype, so the state is too, and the list is touched only when something differs
+struct StyledTextCache
+{
+    StyledTextCache()
+    {
+        valid = false;
+        dirty = false;
+        anyVolatile = false;
+        opacity = 0;
+        styleGeneration = 0;
+    }
+
+    bool valid;
+    bool dirty;       // some expression is marked dirty
+    bool anyVolatile; // some expression is volatile
+    uint8 opacity;
+    uint32 styleGeneration;
+    std::vector<int64> values; // last results of expressions, in order of expression map
+    std::vector<uint8> flags;  // STYLED_EXPRESSION_* flags of expressions
+    std::vector<ExpressionProgram*> programs; // compiled expressions, NULL for those left to tree walker
+};
+
+// expression, which reads properties of some element - the list of them is kept by the element,
+// so the element could mark them dirty when it moves
+struct ExpressionDependent
+{
+    StyledTextCache* cache;
+    uint32 expression;   // index of expression in cache
+    uint8 properties;    // ExpressionDependency flags
+};
+
+typedef std::vector<ExpressionDependent> ExpressionDependentList;
+
 enum SlideElementTypes
 {
     SLIDE_ELEM_NONE             = 0,
@@ -103,6 +154,9 @@ static const KnownKey KnownKeys[] = {
 
 class EffectHandler;
 
+// concurrent effects of element, ordered by priority
+typedef std::vector<EffectHandler*> EffectLayerList;
+
 struct SlideElement
 {
     SlideElement()
@@ -112,18 +166,31 @@ struct SlideElement
         elemEffect = L"";
 
         myEffect = NULL;
+        effectLayers = NULL;
+        dependents = NULL;
         drawable = false;
 
         for (uint32 i = 0; i <= 1; i++)
         {
-            position[i] = 0;
+            positionSpec[i] = 0;
+            position[i] = 0.0f;
             finalPosition[i] = 0;
         }
 
         opacity = 255;
         scale = 1.0f;
+        activeFrame = 0;
+
+        for (uint32 i = 0; i <= 1; i++)
+        {
+            layerPosition[i] = 0.0f;
+            expiredLayerPosition[i] = 0.0f;
+        }
+        expiredLayerOpacity = 255.0f;
+        expiredLayerScale = 1.0f;
 
         typeText.outlist = NULL;
+        typeText.outlistCache = NULL;
     }
 
     SlideElementTypes elemType;
@@ -135,19 +202,47 @@ struct SlideElement
     wchar_t* elemEffect;
 
     EffectHandler* myEffect;
+    EffectLayerList* effectLayers;
+    ExpressionDependentList* dependents; // expressions reading properties of this element, shared by all copies
 
-    int32 position[2]; // element position
+    int32 positionSpec[2]; // position as defined (numbers or enum value from PositionSpecial)
+    float position[2]; // element position, with sub-pixel precision for smooth movement
     int32 finalPosition[2]; // final position in case of effects - used for calculating wrapping limits
 
     uint8 opacity;
     float scale;
 
+    uint32 activeFrame; // last frame, in which the element was within drawn elements, only such elements are animated
+
+    float layerPosition[2]; // movement composed from effect layers in the last drawn frame, expressions see it too
+    // final values of expired effect layers, which were removed from the list
+    float expiredLayerPosition[2];
+    float expiredLayerOpacity;
+    float expiredLayerScale;
+
+    // position as drawn, including effect layers
+    float GetVisiblePosition(uint32 axis) { return position[axis] + layerPosition[axis]; };
+
     void OnCreate();
     void CreateEffectIfAny();
     void PlayEffect(const wchar_t* effectId);
     void PlayEffect(Effect* eff);
+    void AddEffectLayer(Effect* eff);
+    void ComposeEffectLayers();
+    void ClearEffectLayers();
+    // returns element to the state before any effect was played on it
+    void ResetEffects();
+    // moves all effects of element to their final state
+    void FinishEffects();
+    // the same, but the effect played last is moved to given time since its start, queued tells, if it waits in queue of element effect
+    void SeekEffects(Effect* last, bool queued, uint32 elapsed);
     void CalculatePosition();
+    // marks dependent expressions dirty, has to be called whenever element position changes
+    void NotifyMoved(uint8 properties = EXPR_DEP_POSITION);
+    // binds expressions referring to this element to this instance
+    void BindDependents();
     void Draw();
+    bool IsStatic();
 
     // Drawable slide element data
 
@@ -156,9 +251,11 @@ struct SlideElement
         wchar_t* text;           // text... text!
         StyledTextList* outlist; // prepared render list for case of marked up input
         ExprMap outlistExpressions; // map of expressions prepared
+        StyledTextCache* outlistCache; // state of render list, to not update it every frame
         uint32 depth;            // depth of drawing - for some kind of "layers"
         int32 wrapSign;          // sign for wrapping, default prewrapped
         void Draw(SlideElement* parent);
+        void UpdateOutlist(SlideElement* parent);
         static uint8 GetFeatureArrayIndexOf(Style* style);
     } typeText;
 
@@ -223,6 +320,8 @@ struct SlideElement
     {
         SlideSwitchType type;      // type of slide switch
         float moveAngle;           // in case of movement, we need an angle to move all stuff away
+        uint32 effectTimer;        // duration of transition
+        uint8 effProgress;         // transition progress type
         Effect* effect;            // effect, created once at first usage
     } typeNewSlide;
 };
@@ -0,0 +1,110 @@
+#ifndef EXCDR_EASING_H
+#define EXCDR_EASING_H
+
+#include "Global.h"
+#include "Singleton.h"
+
+#include <cmath>
+
+enum EffectProgress
+{
+    // Assuming x is from <0;1>
+    EP_LINEAR         = 0,  // y = x
+    EP_SINUS          = 1,  // y = sin(x*PI/2)
+    EP_QUADRATIC      = 2,  // y = x^2
+    EP_EASE           = 3,  // cubic-bezier(0.25, 0.1, 0.25, 1)
+    EP_EASE_IN        = 4,  // cubic-bezier(0.42, 0, 1, 1)
+    EP_EASE_OUT       = 5,  // cubic-bezier(0, 0, 0.58, 1)
+    EP_EASE_IN_OUT    = 6,  // cubic-bezier(0.42, 0, 0.58, 1)
+    EP_BACK_IN        = 7,  // pulls back a bit before start
+    EP_BACK_OUT       = 8,  // overshoots the end a bit
+    EP_ELASTIC        = 9,  // oscillates around the end
+    EP_BOUNCE         = 10, // bounces at the end
+    MAX_EP_PREDEFINED,
+
+    // curves with parameters (cubic-bezier(x1,y1,x2,y2), steps(n)) are registered at parse time from this id
+    EP_CUSTOM_START   = 32,
+    EP_INVALID        = 255
+};
+
+enum EasingFunction
+{
+    EASING_LINEAR       = 0,
+    EASING_SINUS        = 1,
+    EASING_QUADRATIC    = 2,
+    EASING_CUBIC_BEZIER = 3,
+    EASING_BACK_IN      = 4,
+    EASING_BACK_OUT     = 5,
+    EASING_ELASTIC      = 6,
+    EASING_BOUNCE       = 7,
+    EASING_STEPS        = 8,
+    MAX_EASING_FUNCTION
+};
+
+// curve is sampled to table in this number of segments, values between samples are interpolated linearly
+#define EASING_TABLE_SIZE 256
+
+struct EasingCurve
+{
+    uint8 function;
+    float params[4];
+    float table[EASING_TABLE_SIZE+1];
+
+    float Evaluate(float x)
+    {
+        // interpolation between samples would turn every step into a ramp, and steps are cheap to compute exactly
+        if (function == EASING_STEPS)
+        {
+            if (x <= 0.0f)
+                return 0.0f;
+            if (x >= 1.0f)
+                return 1.0f;
+
+            return floor(x * params[0]) / params[0];
+        }
+
+        if (x <= 0.0f)
+            return table[0];
+        if (x >= 1.0f)
+            return table[EASING_TABLE_SIZE];
+
+        float pos = x * float(EASING_TABLE_SIZE);
+        uint32 index = uint32(pos);
+        float frac = pos - float(index);
+
+        return table[index] + (table[index+1] - table[index]) * frac;
+    }
+};
+
+// Library of progress curves used by effects and canvas effects
+// Every curve is precomputed to table, so the evaluation costs only one lookup and interpolation
+class EasingMgr
+{
+    public:
+        EasingMgr();
+        ~EasingMgr();
+
+        // returns curve id for curve name or definition (i.e. "ease-in", "cubic-bezier(0.1,0.7,1,0.1)", "steps(4)")
+        // EP_INVALID is returned for unknown or malformed definition
+        uint8 ParseCurve(const wchar_t* input);
+
+        EasingCurve* GetCurve(uint8 id);
+        float Evaluate(uint8 id, float x);
+        // evaluates many values at once, in and out may point to the same array
+        void EvaluateBatch(uint8 id, const float* in, float* out, uint32 count);
+
+        // exact value of curve function, used to fill tables
+        static float EvaluateFunction(uint8 function, float* params, float x);
+
+    private:
+        EasingCurve* CreateCurve(uint8 function, float p0 = 0.0f, float p1 = 0.0f, float p2 = 0.0f, float p3 = 0.0f);
+        uint8 RegisterCurve(uint8 function, float p0, float p1, float p2, float p3);
+
+        static float SolveCubicBezier(float x1, float y1, float x2, float y2, float x);
+
+        std::vector<EasingCurve*> m_curves;
+};
+
+#define sEasing Singleton<EasingMgr>::instance()
+
+#endif
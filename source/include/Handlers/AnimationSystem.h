@@ -0,0 +1,67 @@
+#ifndef EXCDR_ANIMATION_SYSTEM_H
+#define EXCDR_ANIMATION_SYSTEM_H
+
+#include "Global.h"
+#include "Singleton.h"
+
+struct SlideElement;
+class EffectHandler;
+
+enum AnimationPropertyFlags
+{
+    ANIM_PROP_POSITION = 0x01,
+    ANIM_PROP_OPACITY  = 0x02,
+    ANIM_PROP_SCALE    = 0x04
+};
+
+#define ANIMATION_INVALID_SLOT -1
+
+// Storage of all running interpolated animations in structure-of-arrays form
+// Every frame all animations are updated in few tight passes over the arrays (time, easing, interpolation)
+// and the results are written back to the owning elements. Effects with movement along a curve are still
+// animated by their own handler.
+class AnimationSystem
+{
+    public:
+        AnimationSystem();
+
+        // returns slot of added animation
+        int32 Add(EffectHandler* handler, SlideElement* owner, uint8 properties, clock_t startTime, uint32 duration, uint8 curve,
+                  float* fromPos, float* toPos, float fromOpacity, float toOpacity, float fromScale, float toScale);
+        void Remove(int32 slot);
+
+        // updates all animations and writes results to their owners
+        // owners not active in given frame (not drawn, i.e. rolled back) are left alone, and their finished
+        // animations are dropped without notifying the handler, so they cannot unblock the presentation
+        void Update(clock_t now, uint32 frame);
+
+        uint32 GetCount() { return m_owner.size(); };
+
+    private:
+        // owners
+        std::vector<EffectHandler*> m_handler;
+        std::vector<SlideElement*> m_owner;
+        std::vector<uint8> m_properties;
+
+        // timing
+        std::vector<clock_t> m_startTime;
+        std::vector<float> m_invDuration;
+        std::vector<uint8> m_curve;
+
+        // interpolated values
+        std::vector<float> m_fromX, m_fromY, m_toX, m_toY;
+        std::vector<float> m_fromOpacity, m_toOpacity;
+        std::vector<float> m_fromScale, m_toScale;
+
+        // per frame work arrays
+        std::vector<float> m_time;
+        std::vector<float> m_coef;
+        std::vector<float> m_x, m_y, m_opacity, m_scale;
+        std::vector<uint32> m_finished;
+        std::vector<bool> m_notify;
+        std::vector<EffectHandler*> m_finishedHandlers;
+};
+
+#define sAnimation Singleton<AnimationSystem>::instance()
+
+#endif
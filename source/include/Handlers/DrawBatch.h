@@ -0,0 +1,98 @@
+#ifndef EXCDR_DRAW_BATCH_H
+#define EXCDR_DRAW_BATCH_H
+
+#include "Global.h"
+#include "Singleton.h"
+
+// size of cell of the grid, which finds earlier quads overlapping new one
+#define BATCH_GRID_CELL 64.0f
+// number of cells in each direction, quads outside of the grid fall into its border cells
+#define BATCH_GRID_SIZE 32
+
+enum BatchBlendMode
+{
+    BATCH_BLEND_NONE     = 0, // opaque, blending disabled
+    BATCH_BLEND_ALPHA    = 1, // classic src alpha / one minus src alpha
+    BATCH_BLEND_ADD      = 2, // source color is added to destination
+    MAX_BATCH_BLEND
+};
+
+// Transformation applied to quad corners on CPU side, so quads from different elements
+// can share one draw call instead of being separated by glPushMatrix/glScalef/glPopMatrix
+struct BatchTransform
+{
+    BatchTransform()
+    {
+        originX = 0.0f;
+        originY = 0.0f;
+        scale = 1.0f;
+    }
+    BatchTransform(float ox, float oy, float sc)
+    {
+        originX = ox;
+        originY = oy;
+        scale = sc;
+    }
+
+    float originX, originY;  // point, around which the scale is done
+    float scale;
+};
+
+struct BatchQuad
+{
+    float vertex[4][2];      // left upper, right upper, right lower, left lower
+    float texCoord[4][2];
+    uint32 color[4];         // one color for each corner, to allow gradients
+    uint32 textureId;        // 0 for non-textured quads
+    uint8 blend;
+
+    uint32 sequence;         // order of submission
+    uint32 layer;            // computed layer - quads in higher layer have to be drawn later
+    float bounds[4];         // minimum x, minimum y, maximum x, maximum y
+};
+
+// Collects quads of the whole frame (or its part) and submits them at once
+// Quads are sorted by texture and blend state, but only in such way, that
+// overlapping quads with different state still keep their original order
+class DrawBatch
+{
+    public:
+        DrawBatch();
+
+        void AddQuad(float x, float y, float width, float height, uint32 color, uint32 textureId = 0, uint8 blend = BATCH_BLEND_ALPHA, BatchTransform* transform = NULL);
+        void AddTexturedQuad(float x, float y, float width, float height, uint32 color, uint32 textureId, float u0, float v0, float u1, float v1, uint8 blend = BATCH_BLEND_ALPHA, BatchTransform* transform = NULL);
+        void AddGradientQuad(float x, float y, float width, float height, uint32 colorFrom, uint32 colorTo, uint32 direction, BatchTransform* transform = NULL);
+
+        // submits all collected quads with currently set modelview matrix
+        void Flush();
+
+        bool IsEmpty() { return m_quads.empty(); };
+
+        // statistics of last flush
+        uint32 GetLastQuadCount() { return m_lastQuadCount; };
+        uint32 GetLastDrawCallCount() { return m_lastDrawCalls; };
+
+    private:
+        BatchQuad* PrepareQuad(float x, float y, float width, float height, uint32 textureId, uint8 blend, BatchTransform* transform);
+        void ComputeLayer(BatchQuad* quad);
+        uint32 GetGridCell(float coord);
+
+        std::vector<BatchQuad> m_quads;
+        std::vector<uint32> m_order;
+
+        // indexes of quads touching every cell, so the new quad is compared only with its neighbours
+        std::vector<uint32> m_grid[BATCH_GRID_SIZE * BATCH_GRID_SIZE];
+        std::vector<uint32> m_visited;   // index of the last quad, which compared with the quad
+
+        // vertex arrays reused between frames to avoid allocations
+        std::vector<float> m_vertexArray;
+        std::vector<float> m_texCoordArray;
+        std::vector<uint8> m_colorArray;
+
+        uint32 m_lastQuadCount;
+        uint32 m_lastDrawCalls;
+};
+
+#define sDrawBatch Singleton<DrawBatch>::instance()
+
+#endif
@@ -1,47 +1,127 @@
 #ifndef EXCDR_EFFECT_HANDLER_H
 #define EXCDR_EFFECT_HANDLER_H
 
+#include "Easing.h"
+#include "Defines/Effects.h"
+#include "Handlers/MotionPath.h"
+
 struct SlideElement;
 
-enum EffectProgress
+enum EffectTrackProperty
+{
+    EFFECT_TRACK_POSITION = 0,
+    EFFECT_TRACK_OPACITY  = 1,
+    EFFECT_TRACK_SCALE    = 2,
+    MAX_EFFECT_TRACK
+};
+
+struct EffectTrack;
+
+// Values computed by effect tracks, written to the element or composed with other effects
+struct EffectState
+{
+    float position[2];
+    float opacity;
+    float scale;
+};
+
+typedef void (*EffectTrackKernel)(EffectTrack* track, EffectState* target, float coef);
+
+// Effect prototype compiled to list of animated properties with chosen kernels
+// it's built only once for every effect, so Animate does not need to inspect optional fields of prototype
+struct EffectProgram
+{
+    uint32 duration;                                 // 0 means instant effect
+    EasingCurve* progress;
+
+    uint32 trackCount;
+    uint8 properties;                                // mask of animated properties (1 << EffectTrackProperty)
+    uint8 trackProperty[MAX_EFFECT_TRACK];
+    EffectTrackKernel trackKernel[MAX_EFFECT_TRACK];
+};
+
+// Track of program bound to one handler, all values are resolved at handler creation
+struct EffectTrack
 {
-    // Assuming x is from <0;1>
-    EP_LINEAR    = 0, // y = x
-    EP_SINUS     = 1, // y = sin(x*PI/2)
-    EP_QUADRATIC = 2, // y = x^2
+    EffectTrackKernel kernel;
+    uint8 property;
+    float from[2];
+    float to[2];
+    float params[5];                                 // kernel specific data
+    MotionPath* path;                                // movement along curve, owned by handler
 };
 
-enum EffectQueueFlags
+// statistics slot for effects without movement, the others are indexed by MoveType
+#define EFFECT_STAT_NO_MOVE MAX_MOVE_TYPE
+
+struct EffectStatistics
 {
-    EFFECT_QF_ADDED_LATER = 0,
-    MAX_EFFECT_QF
+    uint32 liveHandlers;                             // handlers allocated from pools and not released
+    uint32 queuedEffects;                            // effects waiting in queues of all handlers
+    uint32 evaluations[MAX_MOVE_TYPE + 1];           // effect evaluations in frame by move type
+    uint32 animateTime;                              // time spent by animating effects in frame, in microseconds
 };
 
+// queued effect, and whether it was added later (played to running effect), not as a part of resolved chain
+// the flag belongs to queue entry, the same effect could be both chained and played later
+typedef std::pair<Effect*, bool> EffectQueueEntry;
+typedef std::list<EffectQueueEntry> EffectQueue;
+
 class EffectHandler
 {
     public:
-        EffectHandler(SlideElement* parent, Effect* elementEffect, bool fromQueue = false);
+        EffectHandler(SlideElement* parent, Effect* elementEffect, bool fromQueue = false, bool asLayer = false);
         ~EffectHandler();
 
         void Animate();
         void RollBack();
-        void RollBackLastQueued();
+        // state of effect is function of time since its start, so it could be set directly
+        // Seek moves effect itself to given time, Finish moves effect and all queued effects to their end
+        // SeekQueue finishes effect and queued effects except the last queued one, which is moved to given time
+        void Seek(uint32 elapsed);
+        void SeekQueue(uint32 elapsed);
+        void Finish();
         bool isExpired() { return expired; };
         bool isRunningQueue() { return runningQueue; };
 
         void QueueEffect(Effect* eff);
+        // adds resolved chain of effect prototype to queue
+        void QueueChain();
 
         Effect* getEffectProto() { return effectProto; };
 
+        // concurrent effect layer - does not write to element, its values are composed with element state
+        bool isLayer() { return m_layer; };
+        void ComposeLayer(float* position, float &opacity, float &scale);
+
+        // animation system interface
+        void SetAnimationSlot(int32 slot) { m_animSlot = slot; };
+        void AnimationFinished();
+
         static void CalculateEffectProgress(float &coef, uint8 progressType);
 
+        static EffectProgram* CompileEffect(Effect* eff);
+
+        // runtime statistics, counters of frame are moved to target and cleared
+        static EffectStatistics* GetStatistics() { return &s_statistics; };
+        static void ResetFrameStatistics(EffectStatistics* target);
+        static void CountEvaluations(uint8 statType, uint32 count) { s_statistics.evaluations[statType] += count; };
+        static void AddAnimateTime(uint32 time) { s_statistics.animateTime += time; };
+
     private:
-        void AnimateMoveLinear();
-        void AnimateMoveCircular();
-        void AnimateMoveBezier();
-        void AnimateFadeIn();
-        void AnimateFadeOut();
-        void AnimateScaleScale();
+        static void KernelNone(EffectTrack* track, EffectState* target, float coef);
+        static void KernelMoveLinear(EffectTrack* track, EffectState* target, float coef);
+        static void KernelMovePath(EffectTrack* track, EffectState* target, float coef);
+        static void KernelOpacity(EffectTrack* track, EffectState* target, float coef);
+        static void KernelScale(EffectTrack* track, EffectState* target, float coef);
+
+        void BindTracks();
+        void BuildPath(EffectTrack* track);
+        void FinishTracks();
+        // writes animated properties of state to the owner
+        void ApplyState();
+        // moves interpolated animation to animation system, if possible
+        void RegisterAnimation();
 
         // time coefficient could be reused
         float timeCoef;
@@ -51,7 +131,7 @@ class EffectHandler
             // If the time coefficient is equal or larger than 1, then we passed the end of effect
             // return false if finished, true if not
 
-            target = (float(clock()-startTime)) / float(*effectProto->effectTimer);
+            target = (float(clock()-startTime)) / float(m_program->duration);
             if (target >= 1.0f)
             {
                 target = 1.0f;
@@ -60,7 +140,6 @@ class EffectHandler
 
             return true;
         }
-        void CalculateEffectProgress(float &coef);
 
         void UnblockPresentationIfNeeded();
         void SetExpired(bool set = true)
@@ -80,8 +159,8 @@ class EffectHandler
         bool runningQueue;
 
         // cached position coords
-        int32 startPos[2];
-        int32 endPos[2];
+        float startPos[2];
+        float endPos[2];
 
         // cached opacity
         uint8 startOpacity;
@@ -89,21 +168,56 @@ class EffectHandler
         // cached scale
         float startScale;
 
-        // For circular and bezier movement
-        CVector2 movementVector[2];
-        // For circular movement
-        float phase;
-        float radius;
+        EffectProgram* m_program;
+        EffectTrack m_tracks[MAX_EFFECT_TRACK];
+        uint32 m_trackCount;
+        MotionPath m_path;
+        int32 m_animSlot;
+        EffectState m_state;
+        bool m_layer;
 
         clock_t startTime;
 
         SlideElement* effectOwner;
         Effect* effectProto;
-        std::list<Effect*> m_effectQueue;
-        std::list<EffectHandler*> m_effectQueueHandlers;
+        EffectQueue m_effectQueue;
         uint32 m_queuePos;
-        std::map<Effect*, uint32> m_effectQueueFlags;
         EffectHandler* m_queuedEffectHandler;
+
+        void ReleaseQueuedHandler();
+        // moves effect and queued effects to their end, until given count of queued effects remains
+        void FinishQueue(uint32 keep);
+        // keeps count of queued effects in statistics
+        void SetQueuePos(uint32 pos);
+
+        // statistics slot of this effect
+        uint8 m_statType;
+
+        static EffectStatistics s_statistics;
+
+        friend class EffectHandlerPool;
+};
+
+// Pool of effect handlers - memory of recycled handlers is reused for new ones, so the memory is bounded
+// by the maximum number of handlers living at once
+class EffectHandlerPool
+{
+    public:
+        EffectHandlerPool();
+        ~EffectHandlerPool();
+
+        EffectHandler* Acquire(SlideElement* parent, Effect* elementEffect, bool fromQueue = false, bool asLayer = false);
+        void Release(EffectHandler* handler);
+
+        // statistics
+        uint32 GetLiveCount() { return m_live; };
+        uint32 GetPooledCount() { return m_free.size(); };
+        uint32 GetAllocatedCount() { return m_allocated; };
+
+    private:
+        std::vector<void*> m_free;
+        uint32 m_live;
+        uint32 m_allocated;
 };
 
 #endif
@@ -0,0 +1,80 @@
+#ifndef EXCDR_FONT_REGISTRY_H
+#define EXCDR_FONT_REGISTRY_H
+
+#include "Global.h"
+#include "Singleton.h"
+
+struct FontRegistryKey
+{
+    uint32 hash;             // hash of case folded family name
+    uint32 size;
+    uint8 feature;           // bold, italic, underline and strikeout bits, as in feature index of text
+
+    bool operator<(const FontRegistryKey &other) const
+    {
+        if (hash != other.hash)
+            return hash < other.hash;
+        if (size != other.size)
+            return size < other.size;
+        return feature < other.feature;
+    }
+};
+
+struct FontRegistryEntry
+{
+    std::wstring family;     // case folded, compared when the key matches
+    int32 fontId;
+};
+
+struct FontRegistryFont
+{
+    std::wstring family;     // as written in style, SimplyFlat gets it this way
+    uint32 size;
+    int32 simplyFlatId;      // -1 until SimplyFlat has to draw with the font
+    bool simplyFlatBuilt;    // build was tried, failed one is not tried again
+};
+
+// All fonts of presentation, found by family, size and features
+// Fonts are built without features, every font contains all variants and the text selects one by its feature index,
+// so the styles differing only in features (and markup variants) share one font
+// Font ids are given by registry and the text is drawn by glyph atlas, SimplyFlat builds its font (in main thread,
+// using OGL) only when it has to draw or measure the text, which atlas cannot handle
+class FontRegistry
+{
+    public:
+        FontRegistry();
+
+        // returns id of font with given parameters, the font is registered if there's none yet, -1 without family
+        int32 GetFont(const wchar_t* family, uint32 size, uint8 feature);
+
+        // SimplyFlat font id of registry font, it's built on first use, default font is used when it cannot be built
+        int32 GetSimplyFlatFont(int32 fontId);
+        // copy of list with SimplyFlat font ids, valid until the next call
+        StyledTextList* GetSimplyFlatList(StyledTextList* list);
+
+        uint32 GetFamilyCount() { return m_families.size(); };
+        uint32 GetFontCount() { return m_fonts.size(); };
+        uint32 GetSimplyFlatFontCount() { return m_simplyFlatCount; };
+        uint32 GetEntryCount() { return m_entryCount; };
+
+        // one line text report, returns its length
+        uint32 FormatReport(char* buffer, uint32 size);
+
+    private:
+        int32 Find(FontRegistryKey &key, const std::wstring &family);
+        void Insert(FontRegistryKey &key, const std::wstring &family, int32 fontId);
+
+        std::map<FontRegistryKey, std::vector<FontRegistryEntry> > m_entries;
+        std::vector<std::wstring> m_families;
+        std::vector<FontRegistryFont> m_fonts;   // by font id, one for every family and size
+        uint32 m_entryCount;     // all combinations of family, size and features asked for
+        uint32 m_simplyFlatCount;
+
+        // SimplyFlat variant of styled text list, kept between calls to avoid allocations
+        std::vector<printTextData> m_simplyFlatEntries;
+        StyledTextList m_simplyFlatList;
+};
+
+#define sFontRegistry Singleton<FontRegistry>::instance()
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef EXCDR_GLYPH_ATLAS_H
+#define EXCDR_GLYPH_ATLAS_H
+
+#include "Global.h"
+#include "Singleton.h"
+#include "Handlers/DrawBatch.h"
+#include "Handlers/TextMetrics.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#ifndef _WIN32
+  #include <pthread.h>
+  #include <semaphore.h>
+#endif
+
+// width and height of one atlas texture
+#define GLYPH_ATLAS_SIZE 512
+// maximum number of atlas textures, when all of them are full, the atlas starts from scratch
+#define GLYPH_ATLAS_MAX_PAGES 8
+// empty space around every glyph, so the linear filtering does not pick up its neighbours
+#define GLYPH_ATLAS_PADDING 1
+// size of opaque block in the corner of every page, used for underline and strikeout
+#define GLYPH_ATLAS_SOLID_SIZE 4
+// maximum number of cached shaped runs, the cache is cleared when exceeded
+#define GLYPH_RUN_CACHE_MAX 4096
+// number of threads rasterizing glyphs in background
+#define GLYPH_RASTER_THREADS 2
+// maximum number of font files opened by one rasterizer, all of them are closed when exceeded
+#define GLYPH_RASTER_FACE_CACHE 16
+
+// bits of feature index, as returned by elemTextData::GetFeatureArrayIndexOf
+enum GlyphFeatureFlags
+{
+    GLYPH_FEATURE_BOLD       = 0x01,
+    GLYPH_FEATURE_ITALIC     = 0x02,
+    GLYPH_FEATURE_UNDERLINE  = 0x04,
+    GLYPH_FEATURE_STRIKEOUT  = 0x08
+};
+
+struct GlyphInfo
+{
+    uint32 textureId;        // atlas page, 0 for glyphs without bitmap (i.e. spaces)
+    float texCoord[4];       // u0, v0, u1, v1
+    float offset[2];         // left upper corner of bitmap relative to pen position on baseline
+    float size[2];           // bitmap size
+    float advance;           // all metrics are in canvas units (original screen resolution)
+    bool pending;            // waiting for rasterizing thread
+    bool oversized;          // larger than atlas page, text with it is left to SimplyFlat
+};
+
+struct GlyphFontDesc
+{
+    std::wstring family;
+    uint32 size;
+    uint8 features;          // features of font as built by SimplyFlat
+};
+
+enum GlyphFaceState
+{
+    GLYPH_FACE_QUEUED   = 0, // waiting for rasterizing thread to create the font
+    GLYPH_FACE_READY    = 1,
+    GLYPH_FACE_INVALID  = 2  // the font could not be created, so we don't try every frame
+};
+
+// font file found for family and style
+struct GlyphFontFile
+{
+    std::wstring family;     // case folded
+    uint8 features;          // bold and italic bits of the style in file
+    std::string path;
+    int32 index;             // face index in font collection
+};
+
+struct GlyphFace
+{
+    uint8 state;
+    bool synchronous;        // faces of fallback font are created and rasterized right away
+    uint8 features;          // font features combined with feature index of text
+
+    // font file and its size, set before the face is queued and only read by rasterizers then
+    uint32 serial;           // unique number of face, rasterizers keep their opened files by it
+    std::string path;
+    int32 index;
+    uint32 pixelSize;
+    uint8 synthetic;         // bold and italic bits missing in font file, made from outline
+
+    float ascent;
+    float lineHeight;
+    float lineThickness;     // thickness of underline and strikeout
+
+    std::map<wchar_t, GlyphInfo> glyphs;
+    std::map<uint32, float> kerning;  // first char in upper 16 bits, second in lower
+};
+
+struct ShapedGlyph
+{
+    GlyphInfo* glyph;
+    wchar_t character;
+    float x;                 // pen position relative to run start, including kerning
+};
+
+struct ShapedRun
+{
+    std::wstring text;
+    GlyphFace* face;
+    std::vector<ShapedGlyph> glyphs;
+    float width;
+    uint32 serial;           // unique number of shaping, runs colliding in cache are shaped again in place
+    bool provisional;        // shaped with fallback font, shaped again when some rasterized glyphs arrive
+    uint32 generation;       // raster generation of provisional shaping
+    bool oversized;          // some glyph does not fit into atlas, the run cannot be drawn by atlas
+};
+
+// glyph placed by layout, waiting to become a quad
+struct LaidGlyph
+{
+    GlyphInfo* glyph;
+    GlyphFace* face;
+    float x;
+    float advance;
+    uint32 line;
+    uint32 run;              // index of run in layout, color is given by the run when drawing
+    bool space;              // spaces may hang over the wrap limit
+};
+
+// glyphs of text broken to lines, made once and then used until the text or wrap limit changes
+struct TextLayout
+{
+    std::vector<uint32> runSerials;  // shaped runs, the layout was made of
+    float limit;                     // wrap limit, 0 without wrapping
+    float minLimit;                  // the same lines would be made with any limit from minLimit
+    float maxLimit;                  // up to maxLimit (not including)
+    std::vector<LaidGlyph> glyphs;
+    std::vector<float> lineAscent;
+    std::vector<float> lineHeight;
+};
+
+// glyph bitmap with its metrics in screen pixels, made by any thread, uploaded by main thread
+struct GlyphBitmap
+{
+    int32 advance;
+    int32 origin[2];
+    uint32 width;            // without padding
+    uint32 height;
+    std::vector<uint8> pixels; // alpha with padding around, ready for upload
+};
+
+// font creation (with no character) or glyph rasterization for worker thread
+struct GlyphRasterJob
+{
+    GlyphFace* face;
+    wchar_t character;
+    std::wstring family;
+    float scale;
+    bool success;
+    GlyphBitmap bitmap;
+};
+
+// everything the rasterizing thread needs, main thread has its own one for fallback font
+// FreeType library and faces cannot be shared by threads, so every rasterizer opens its own
+struct GlyphRasterizer
+{
+    FT_Library library;
+    std::map<uint32, FT_Face> faces;   // by face serial
+};
+
+struct GlyphAtlasPage
+{
+    uint32 textureId;
+    uint32 cursor[2];        // position of next glyph in current shelf
+    uint32 shelfHeight;
+};
+
+// Text renderer drawing glyphs from shared atlas textures as batched quads
+// Glyphs are rasterized on demand in screen resolution, so the text stays crisp with any persistent scale,
+// and the runs of text are shaped (mapped to glyphs and kerned) only once and then taken from cache
+// Texts are broken to lines once too, the layout is kept for every drawn text and made again only
+// when its runs change, or when the wrap limit changes so much, that some line would break elsewhere
+// Glyphs are rasterized by FreeType from the installed font files, so they look the same on every platform
+// Fonts are created and glyphs rasterized by worker threads, main thread only uploads the bitmaps to atlas pages,
+// the text is drawn with default font until all of its glyphs arrive
+class GlyphAtlas
+{
+    public:
+        GlyphAtlas();
+        ~GlyphAtlas();
+
+        // tells the atlas, how the font with SimplyFlat font id looks like
+        void RegisterFont(int32 fontId, const wchar_t* family, uint32 size, bool bold, bool italic, bool underline, bool strikeout);
+
+        // both return false when the text cannot be drawn by atlas (unknown font, no rasterizer, glyph too large), nothing is drawn then
+        bool PrintText(int32 fontId, uint8 feature, float x, float y, int32 wrap, const wchar_t* text, uint32 color, BatchTransform* transform = NULL);
+        bool PrintStyledText(float x, float y, int32 wrap, StyledTextList* list, uint32 color, BatchTransform* transform = NULL);
+
+        // size of single line of text, as it would be drawn, from the same shaped runs
+        // return false in the same cases as printing, provisional tells, that some glyphs are not rasterized yet
+        bool MeasureText(int32 fontId, uint8 feature, const wchar_t* text, float &width, float &height, bool &provisional);
+        bool MeasureStyledText(StyledTextList* list, float &width, float &height, bool &provisional);
+
+        uint32 GetPageCount() { return m_pages.size(); };
+        uint32 GetFaceCount() { return m_faces.size(); };
+        uint32 GetRunCount() { return m_runs.size(); };
+        uint32 GetLayoutCount() { return m_layouts.size(); };
+        uint32 GetPendingJobCount();
+        // raised by every reset, anything keeping texture coordinates of glyphs (i.e. display lists) is outdated then
+        uint32 GetGeneration() { return m_generation; };
+
+    private:
+        void Prepare();
+        void Reset(bool dropFaces);
+
+        GlyphFace* GetFace(int32 fontId, uint8 feature);
+        GlyphInfo* GetGlyph(GlyphFace* face, wchar_t character);
+        bool UploadGlyph(GlyphBitmap* bitmap, GlyphInfo* glyph);
+        bool AllocateRect(uint32 width, uint32 height, GlyphAtlasPage* &page, uint32 &x, uint32 &y);
+        GlyphAtlasPage* AddPage();
+
+        // finds font file for family, main thread only
+        bool FindFontFile(GlyphFace* face, const std::wstring &family);
+        void ScanFontFiles();
+        void AddFontFile(const std::wstring &family, uint8 features, const std::string &path, int32 index);
+
+        // these are called from worker threads too, so they use nothing but their parameters
+        static bool CreateFace(GlyphRasterizer* rasterizer, GlyphFace* face, float scale);
+        static bool RasterizeGlyph(GlyphRasterizer* rasterizer, GlyphFace* face, wchar_t character, GlyphBitmap* bitmap);
+        static FT_Face OpenFace(GlyphRasterizer* rasterizer, GlyphFace* face);
+        static void InitRasterizer(GlyphRasterizer* rasterizer);
+        static void FreeRasterizer(GlyphRasterizer* rasterizer);
+
+        // worker threads
+        void QueueJob(GlyphRasterJob* job);
+        void CollectJobs();
+        void CancelJobs(bool dropFaces);
+        void StartWorkers();
+        void StopWorkers();
+        void Lock();
+        void Unlock();
+        void SignalJobs(uint32 count);
+        void WaitForJob();
+        void RunWorker();
+#ifdef _WIN32
+        static DWORD WINAPI WorkerThread(LPVOID param);
+#else
+        static void* WorkerThread(void* param);
+#endif
+
+        ShapedRun* GetShapedRun(int32 fontId, uint8 feature, const wchar_t* text);
+        // returns false when some glyph is not rasterized yet
+        bool ShapeRun(ShapedRun* run, GlyphFace* face, const wchar_t* text, uint32 length);
+
+        float GetWrapLimit(float x, int32 wrap);
+        // layout of runs in m_styledRuns, source is the text or list the runs were made of
+        TextLayout* GetLayout(const void* source, float limit);
+        void BeginLayout(TextLayout* layout, float limit);
+        void LayoutRun(ShapedRun* run, uint32 index);
+        void PushLine(GlyphFace* face);
+        void BreakLine(float trigger);
+        void EndLayout();
+        void SubmitLayout(TextLayout* layout, float x, float y, BatchTransform* transform);
+        // rounds canvas coordinate to whole screen pixel
+        float Snap(float value) { return floor(value * m_scale + 0.5f) / m_scale; };
+
+        std::map<int32, GlyphFontDesc> m_fonts;
+        std::map<uint32, GlyphFace*> m_faces;     // font id in upper bits, feature index in lower 8 bits
+        std::map<TextRunKey, ShapedRun> m_runs;
+        std::map<const void*, TextLayout> m_layouts;
+        uint32 m_runSerial;
+        uint32 m_faceSerial;
+
+        // installed font files, scanned when the first face is created
+        std::vector<GlyphFontFile> m_fontFiles;
+        bool m_fontFilesScanned;
+        std::vector<GlyphAtlasPage> m_pages;
+
+        // scale from canvas units to screen pixels, glyphs are rasterized with it
+        float m_scale;
+        bool m_resetPending;
+        uint32 m_generation;
+
+        // runs and their colors of the drawn text, vectors are kept between calls to avoid allocations
+        std::vector<ShapedRun*> m_styledRuns;
+        std::vector<uint32> m_runColors;
+
+        // layout state
+        TextLayout* m_layout;
+        float m_penX;
+        uint32 m_line;
+        uint32 m_lineStart;
+        uint32 m_lastBreak;      // index of the first glyph after the last break opportunity
+        wchar_t m_prevChar;
+
+        GlyphRasterizer m_rasterizer;
+        GlyphBitmap m_bitmap;
+        std::vector<uint8> m_uploadBuffer;
+
+        // jobs for worker threads, guarded by lock
+        std::list<GlyphRasterJob*> m_queuedJobs;
+        std::list<GlyphRasterJob*> m_doneJobs;
+        uint32 m_busyWorkers;
+        bool m_stopWorkers;
+        bool m_workersStarted;
+        uint32 m_rasterGeneration;   // raised every time finished jobs are collected
+
+        uint32 m_workerCount;        // started threads, the first ones in m_workers
+        bool m_semaphoreReady;
+#ifdef _WIN32
+        CRITICAL_SECTION m_jobLock;
+        HANDLE m_jobSemaphore;
+        HANDLE m_workers[GLYPH_RASTER_THREADS];
+#else
+        pthread_mutex_t m_jobLock;
+        sem_t m_jobSemaphore;
+        pthread_t m_workers[GLYPH_RASTER_THREADS];
+#endif
+};
+
+#define sGlyphAtlas Singleton<GlyphAtlas>::instance()
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef EXCDR_LINE_BREAK_H
+#define EXCDR_LINE_BREAK_H
+
+#include "Global.h"
+
+// line breaking classes of Unicode line breaking algorithm (UAX #14), reduced to those,
+// which make a difference in presentation texts
+enum LineBreakClass
+{
+    LBC_AL = 0,     // alphabetic, and everything not listed below
+    LBC_NU = 1,     // digits
+    LBC_SP = 2,     // space
+    LBC_BK = 3,     // mandatory break
+    LBC_GL = 4,     // non-breaking glue (no-break space, word joiner)
+    LBC_ZW = 5,     // zero width space
+    LBC_HY = 6,     // hyphen-minus
+    LBC_BA = 7,     // break after (dashes, soft hyphen, tabulator)
+    LBC_OP = 8,     // opening punctuation
+    LBC_CL = 9,     // closing punctuation, and everything else which must not start a line
+    LBC_ID = 10,    // ideographs, line could be broken on both sides
+    MAX_LBC
+};
+
+extern LineBreakClass GetLineBreakClass(wchar_t character);
+
+// returns true when the line could be broken between given characters
+extern bool IsLineBreakOpportunity(wchar_t before, wchar_t after);
+
+#endif
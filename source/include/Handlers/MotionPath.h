@@ -0,0 +1,47 @@
+#ifndef EXCDR_MOTION_PATH_H
+#define EXCDR_MOTION_PATH_H
+
+#include "Global.h"
+
+// number of points of arc-length table
+#define MOTION_PATH_SAMPLES 64
+// number of curve samples used to measure its length, for every table point
+#define MOTION_PATH_OVERSAMPLE 8
+
+// function returning point on curve for parameter t from <0;1>
+typedef void (*MotionPathSampler)(void* data, float t, float &x, float &y);
+
+// Movement path sampled by its length - points in table are equally distant, so the movement
+// along the path has constant speed and evaluation is only one interpolation between two points
+class MotionPath
+{
+    public:
+        MotionPath();
+
+        // cubic bezier curve from start to end with two control points
+        void BuildBezier(float* start, float* control1, float* control2, float* end);
+        // part of circle around center, starting at phase angle and sweeping given angle (both in radians)
+        void BuildCircular(float centerX, float centerY, float radius, float phase, float sweep);
+        // path through supplied points (x,y pairs), either straight segments or Catmull-Rom spline
+        void BuildPolyline(float* points, uint32 count);
+        void BuildSpline(float* points, uint32 count);
+
+        void Evaluate(float coef, float &x, float &y);
+
+        float GetLength() { return m_length; };
+        bool IsBuilt() { return m_built; };
+
+    private:
+        void Build(MotionPathSampler sampler, void* data);
+
+        static void SampleBezier(void* data, float t, float &x, float &y);
+        static void SampleCircular(void* data, float t, float &x, float &y);
+        static void SamplePolyline(void* data, float t, float &x, float &y);
+        static void SampleSpline(void* data, float t, float &x, float &y);
+
+        float m_points[MOTION_PATH_SAMPLES+1][2];
+        float m_length;
+        bool m_built;
+};
+
+#endif
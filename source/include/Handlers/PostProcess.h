@@ -0,0 +1,56 @@
+#ifndef EXCDR_POST_PROCESS_H
+#define EXCDR_POST_PROCESS_H
+
+#include "Global.h"
+#include "Singleton.h"
+#include "Handlers/ScreenCapture.h"
+
+// maximum number of kernel taps on one side of the center
+#define BLUR_MAX_TAPS 8
+// maximum gaussian sigma in downsampled pixels, larger blur is achieved by downsampling more
+#define BLUR_MAX_SIGMA 4.0f
+#define BLUR_MAX_DOWNSAMPLE 16
+
+// Effects applied to the whole drawn canvas after all elements has been drawn
+// Blur uses captured screen, downsampled and blurred by separable gaussian kernel in two passes
+// (horizontal and vertical) drawn as additively blended shifted copies of the image. If the textures
+// cannot be created (i.e. software or headless context), blur is computed on CPU instead.
+class PostProcess
+{
+    public:
+        PostProcess();
+
+        // blurs the actual content of back buffer, radius is in original screen pixels
+        void Blur(float radius);
+        // puts colored layer over the whole canvas
+        void Colorize(uint32 color);
+
+        bool IsCPUFallback() { return m_cpuFallback; };
+        // blur is computed on CPU from now on, the CPU blur is checked first, returns false when the check fails
+        bool ForceCPUFallback();
+
+        // computes integer gaussian kernel with weights summing up to 255, returns number of taps on one side
+        static uint32 ComputeKernel(float sigma, uint32* weights);
+        // blurs RGBA image in place, temp has to be able to hold the whole image
+        static void BlurImage(uint8* pixels, uint32 width, uint32 height, uint32* weights, uint32 taps, uint8* temp);
+        // checks, that the kernels sum up to 255 and that the blurred constant image stays the same including its edges
+        static bool CheckCPUBlur();
+
+    private:
+        bool BlurGPU(uint32* weights, uint32 taps, uint32 downsample);
+        void BlurCPU(uint32* weights, uint32 taps, uint32 downsample);
+        void BlurPass(ScreenCapture* source, float stepX, float stepY, uint32* weights, uint32 taps, float width, float height);
+
+        ScreenCapture m_scene;
+        ScreenCapture m_ping;
+        ScreenCapture m_pong;
+
+        bool m_cpuFallback;
+        std::vector<uint8> m_cpuPixels;
+        std::vector<uint8> m_cpuDownsampled;
+        std::vector<uint8> m_cpuTemp;
+};
+
+#define sPostProcess Singleton<PostProcess>::instance()
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef EXCDR_PROFILER_H
+#define EXCDR_PROFILER_H
+
+#include "Global.h"
+#include "Singleton.h"
+#include "Handlers/EffectHandler.h"
+
+// number of frames kept for average and maximum frame time
+#define PROFILER_HISTORY 64
+// frame taking longer than this (in microseconds) is counted as dropped
+#define PROFILER_FRAME_BUDGET 16667
+
+// Measures frame times and collects effect statistics of every finished frame,
+// so dropped frames could be matched with slides heavy on effects
+class FrameProfiler
+{
+    public:
+        FrameProfiler();
+
+        // time in microseconds from some unspecified point, only differences are meaningful
+        static uint64 GetTime();
+
+        void BeginFrame();
+        void EndFrame();
+
+        uint32 GetLastFrameTime() { return m_history[(m_historyPos + PROFILER_HISTORY - 1) % PROFILER_HISTORY]; };
+        uint32 GetAverageFrameTime();
+        uint32 GetMaxFrameTime();
+        uint32 GetFrameCount() { return m_frameCount; };
+        uint32 GetDroppedFrames() { return m_droppedFrames; };
+
+        // effect statistics of the last finished frame
+        EffectStatistics* GetEffectStatistics() { return &m_effectStats; };
+
+        // one line text report, returns its length
+        uint32 FormatReport(char* buffer, uint32 size);
+
+    private:
+        uint64 m_frameStart;
+        uint32 m_history[PROFILER_HISTORY];
+        uint32 m_historyPos;
+        uint32 m_frameCount;
+        uint32 m_droppedFrames;
+
+        EffectStatistics m_effectStats;
+};
+
+#define sProfiler Singleton<FrameProfiler>::instance()
+
+#endif
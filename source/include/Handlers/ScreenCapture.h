@@ -0,0 +1,51 @@
+#ifndef EXCDR_SCREEN_CAPTURE_H
+#define EXCDR_SCREEN_CAPTURE_H
+
+#include "Global.h"
+#include "Handlers/DrawBatch.h"
+
+// Texture holding copy of the screen (or its part), made by copying back buffer content
+// Texture dimensions are always power of two, so only part of the texture is used
+class ScreenCapture
+{
+    public:
+        ScreenCapture();
+        ~ScreenCapture();
+
+        // (re)creates texture to be able to hold image of supplied size
+        // texture is made large enough for maximum size, so the size could change up to it without new allocation
+        bool Prepare(uint32 width, uint32 height, uint32 maxWidth = 0, uint32 maxHeight = 0);
+        void Release();
+
+        // copies actual content of back buffer into texture
+        void Capture();
+        bool IsCaptured() { return m_captured; };
+        void Invalidate() { m_captured = false; };
+
+        uint32 GetTextureId() { return m_textureId; };
+        uint32 GetWidth() { return m_width; };
+        uint32 GetHeight() { return m_height; };
+
+        // adds quad with captured image (or its part) to draw batch
+        // source rectangle is relative to captured area (0.0 - 1.0), beginning in the left upper corner
+        void AddToBatch(float x, float y, float width, float height, uint32 color,
+                        float srcX = 0.0f, float srcY = 0.0f, float srcWidth = 1.0f, float srcHeight = 1.0f,
+                        uint8 blend = BATCH_BLEND_ALPHA);
+
+        static uint32 NextPowerOfTwo(uint32 value);
+
+    private:
+        uint32 m_textureId;
+
+        // captured area size
+        uint32 m_width;
+        uint32 m_height;
+
+        // real texture size
+        uint32 m_textureWidth;
+        uint32 m_textureHeight;
+
+        bool m_captured;
+};
+
+#endif
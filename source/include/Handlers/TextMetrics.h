@@ -0,0 +1,64 @@
+#ifndef EXCDR_TEXT_METRICS_H
+#define EXCDR_TEXT_METRICS_H
+
+#include "Global.h"
+#include "Singleton.h"
+
+// maximum number of cached text widths, the cache is cleared when exceeded
+#define TEXT_METRICS_CACHE_MAX 8192
+
+// run of text in one font and feature, identified by hash of the text
+// different texts may have the same key, so the text itself has to be compared by the user of key
+struct TextRunKey
+{
+    TextRunKey(int32 p_fontId, uint8 p_feature, const wchar_t* text, uint32 p_length);
+
+    int32 fontId;
+    uint8 feature;
+    uint32 hash;
+    uint32 length;
+
+    bool operator<(const TextRunKey &other) const
+    {
+        if (fontId != other.fontId)
+            return fontId < other.fontId;
+        if (feature != other.feature)
+            return feature < other.feature;
+        if (hash != other.hash)
+            return hash < other.hash;
+        return length < other.length;
+    }
+};
+
+struct TextMeasure
+{
+    std::wstring text;
+    uint32 width;
+};
+
+// Text widths and font heights as measured by SimplyFlat
+// The same texts are measured with every position recalculation, so the results are kept until some font is built
+class TextMetrics
+{
+    public:
+        TextMetrics();
+
+        // measures first length characters of text
+        uint32 GetTextWidth(int32 fontId, uint8 feature, const wchar_t* text, uint32 length);
+        uint32 GetTextWidth(int32 fontId, uint8 feature, const wchar_t* text) { return GetTextWidth(fontId, feature, text, text ? wcslen(text) : 0); };
+        uint32 GetFontHeight(int32 fontId);
+
+        // drops all measurements, called when fonts are built
+        void Invalidate();
+
+        uint32 GetEntryCount() { return m_widths.size(); };
+
+    private:
+        std::map<TextRunKey, TextMeasure> m_widths;
+        std::map<int32, uint32> m_heights;
+        std::wstring m_buffer;   // terminated copy of measured part of text
+};
+
+#define sTextMetrics Singleton<TextMetrics>::instance()
+
+#endif
@@ -32,6 +32,7 @@ extern wchar_t* RemoveBeginningSpaces(const wchar_t* input);
 extern bool EqualString(const wchar_t* first, const wchar_t* second, bool caseInsensitive = false);
 extern bool EqualString(const char* first, const char* second);
 extern int ContainsString(const wchar_t* str, const wchar_t* substr);
+extern uint32 HashString(const wchar_t* input, uint32 length);
 extern bool IsNumeric(const wchar_t* inp);
 extern int ToInt(const wchar_t* inp);
 extern wchar_t UpperChar(wchar_t inp);
@@ -4,6 +4,7 @@
 #include "Global.h"
 #include "Parsers/Parser.h"
 #include "Parsers/StyleParser.h"
+#include "Defines/Effects.h"
 
 static const wchar_t* SupportedEffectsVersions[] = {
     L"1.0",
@@ -15,6 +16,14 @@ class EffectParser: public Parser
     public:
         static bool ParseFile(const wchar_t* path);
         static bool Parse(std::vector<std::wstring>* input);
+
+        // resolves \NEXT_EFFECT names to effects, has to be called after all effect files are parsed
+        static bool ResolveChains();
+
+    private:
+        // stack contains effects being played, path contains links, through which they were reached (NULL for root)
+        static void FlattenChain(const wchar_t* rootName, Effect* eff, EffectChainLink* via, std::vector<Effect*>* stack, std::vector<EffectChainLink*>* path,
+                                 std::map<EffectChainLink*, uint32>* passes, std::vector<Effect*>* out);
 };
 
 #endif
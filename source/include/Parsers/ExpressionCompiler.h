@@ -0,0 +1,116 @@
+#ifndef EXCDR_EXPRESSION_COMPILER_H
+#define EXCDR_EXPRESSION_COMPILER_H
+
+#include "Global.h"
+#include "Parsers/ExpressionParser.h"
+
+// maximum depth of evaluation stack, deeper expressions are not compiled and are left to tree walker
+#define EXPRESSION_STACK_MAX 32
+
+enum ExpressionOpcode
+{
+    EXOP_PUSH_INT   = 0,    // push integer operand
+    EXOP_PUSH_FLOAT = 1,    // push floating point operand
+    EXOP_PUSH_REF   = 2,    // push integer value of reference in slot given by operand
+    EXOP_TO_FLOAT   = 3,    // convert integer on top of stack to floating point
+    EXOP_NEG_INT    = 4,
+    EXOP_NEG_FLOAT  = 5,
+    EXOP_ADD_INT    = 6,    // all binary operations take two values from top of stack and push result
+    EXOP_ADD_FLOAT  = 7,
+    EXOP_SUB_INT    = 8,
+    EXOP_SUB_FLOAT  = 9,
+    EXOP_MUL_INT    = 10,
+    EXOP_MUL_FLOAT  = 11,
+    EXOP_DIV_FLOAT  = 12,   // division is always done in floating point
+    EXOP_MOD_INT    = 13,
+    EXOP_MOD_FLOAT  = 14,
+    MAX_EXOP
+};
+
+// result of expression (or its part), integer unless some floating point value or division is involved
+struct ExpressionValue
+{
+    bool isFloat;
+    int64 asInt;
+    double asFloat;
+
+    int64 ToInt() const { return isFloat ? int64(asFloat) : asInt; };
+    double ToFloat() const { return isFloat ? asFloat : double(asInt); };
+
+    static ExpressionValue Int(int64 value);
+    static ExpressionValue Float(double value);
+
+    // the only definition of arithmetics, used by tree walker, constant folding and (in the same way) by bytecode
+    // division or modulo by zero leaves left operand untouched
+    static ExpressionValue Apply(MathOperation op, ExpressionValue left, ExpressionValue right);
+    static ExpressionValue Negate(ExpressionValue value);
+};
+
+struct SlideElement;
+
+// element property referenced from expression, bound to the element before evaluation
+struct ExpressionReference
+{
+    std::wstring elementId;
+    uint8 properties;       // one of EXPR_DEP_X and EXPR_DEP_Y
+    SlideElement* element;  // prototype until the first instance of element is created, NULL if there's no such element
+    bool instance;          // element is created instance, the binding won't change anymore
+};
+
+struct ExpressionInstruction
+{
+    uint8 opcode;
+    union
+    {
+        int64 asInt;
+        double asFloat;
+        uint32 asSlot;
+    } operand;
+};
+
+// Expression tree compiled to flat stack bytecode
+// Constants are folded and references are collected into slots in compile time, and the slots are bound
+// to elements directly, so the evaluation is just one loop over instructions without recursion, lookup or allocation
+class ExpressionProgram
+{
+    public:
+        // returns NULL when the expression cannot be compiled
+        static ExpressionProgram* Compile(ExpressionTreeElement* tree);
+
+        ExpressionValue Evaluate();
+
+        // binds references with id of element, prototype is bound only to unbound references
+        void BindElement(SlideElement* elem, bool instance);
+
+        bool IsConstant() { return m_code.empty(); };
+        uint32 GetInstructionCount() { return m_code.size(); };
+        uint32 GetReferenceCount() { return m_references.size(); };
+        const ExpressionReference* GetReference(uint32 slot) { return &m_references[slot]; };
+
+    private:
+        ExpressionProgram();
+
+        // compiled node is either constant or code leaving one value of known type on stack
+        struct Operand
+        {
+            bool constant;
+            ExpressionValue value;   // only type is valid for non-constant operand
+        };
+
+        Operand CompileNode(ExpressionTreeElement* node, std::vector<ExpressionInstruction> &code);
+        Operand CompileReference(const wchar_t* name, std::vector<ExpressionInstruction> &code);
+        Operand CompileChain(ExpressionTreeElement* node, std::vector<ExpressionInstruction> &code);
+        Operand CompileSequence(ExpressionTreeElement* node, std::vector<ExpressionInstruction> &code);
+        uint32 GetReferenceSlot(const std::wstring &elementId, uint8 properties);
+        uint32 GetStackDepth();
+
+        static void Emit(std::vector<ExpressionInstruction> &code, uint8 opcode);
+        static void EmitPush(std::vector<ExpressionInstruction> &code, ExpressionValue value, bool asFloat);
+
+        std::vector<ExpressionInstruction> m_code;
+        std::vector<ExpressionReference> m_references;
+        ExpressionValue m_constant;  // result of program without code
+        bool m_resultFloat;
+};
+
+#endif
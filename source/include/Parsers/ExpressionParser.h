@@ -63,6 +63,8 @@ struct ExprTreeElem
     }
     ValueType getEvaluableType();
     void SimplifyChildren();
+    // collects string values (element references) of whole subtree
+    void GetReferences(std::vector<const wchar_t*> &output);
 
     bool polarity; // positive (true) / negative (false)
 
@@ -9,6 +9,8 @@
 #include "Defines/Styles.h"
 #include "Defines/Effects.h"
 #include "Handlers/EffectHandler.h"
+#include "Handlers/ScreenCapture.h"
+#include "Parsers/ExpressionCompiler.h"
 
 enum InterfaceEventTypes
 {
@@ -34,6 +36,16 @@ enum InterfaceEventTypes
 
 typedef std::list<SlideElement*> SlideList;
 
+// number of tiles the old slide is split to, when dispersing
+#define TRANSITION_DISPERSE_COLUMNS 8
+#define TRANSITION_DISPERSE_ROWS    6
+
+// how many times every expression is evaluated by expression benchmark
+#define EXPRESSION_BENCHMARK_ITERATIONS 10000
+
+// time since start of step, at which all its effects are finished
+#define STEP_ELAPSED_FINISHED 0xFFFFFFFF
+
 class PresentationMgr
 {
     public:
@@ -45,14 +57,29 @@ class PresentationMgr
         void InterfaceEvent(InterfaceEventTypes type, int32 param1 = 0, int32 param2 = 0);
         void HandleExternalMessage(char* msg, uint8 len);
 
+        // sets canvas and elements to the state at given time since the current step started, earlier steps are finished
+        // only the current step could be sought, moving to another step goes through the usual slide navigation
+        void SeekStep(uint32 elapsed);
+
         void SetBlocking(bool block);
         bool IsBlocking() { return m_blocking; };
 
         SlideElement* GetActiveElementById(const wchar_t* id);
 
+        EffectHandlerPool* GetEffectPool() { return &m_effectPool; };
+
+        // evaluates compiled program, or walks the tree if there is none
+        int64 EvaluateExpression(ExpressionProgram* program, ExpressionTreeElement* expr);
         int64 NumerateExpression(ExpressionTreeElement* expr);
         int64 GetElementReferenceValue(wchar_t* input);
 
+        // evaluates all text expressions by tree walker and by bytecode, writes one line report with times
+        uint32 BenchmarkExpressions(char* buffer, uint32 size);
+        // the benchmark takes many frames of time, so the request waits until nothing moves and sends the report then
+        void RunPendingBenchmark();
+        // presentation waits for user, and nothing is moving on the screen
+        bool IsIdle();
+
         // Network access stuff
         void InitNetwork();
         void UpdateNetwork();
@@ -62,13 +89,51 @@ class PresentationMgr
         SlideElement* m_slideElement;
         SlideList m_activeElements;
 
+        // all effect handlers of this presentation are allocated here
+        EffectHandlerPool m_effectPool;
+
+        ExpressionValue WalkExpression(ExpressionTreeElement* expr);
+
         void AnimateCanvas(bool before);
         void MoveBack(bool hard);
 
+        // state of canvas and elements as a function of position in slide elements
+        void ResetCanvas();
+        void ApplyCanvasEffect(SlideElement* elem, clock_t startTime);
+        // effects at the last position are moved to given time since their start, if it's not STEP_ELAPSED_FINISHED
+        void EvaluateCanvas(SlideList::iterator last, uint32 elapsed = STEP_ELAPSED_FINISHED);
+        void EvaluateElementEffects(SlideElement* elem, SlideList::iterator last, uint32 elapsed = STEP_ELAPSED_FINISHED);
+
         void ApplyBackgroundElement(SlideElement* elem);
+        void DrawBackground();
+        void ComposeBackground();
+        bool RenderBackgroundCache();
+
+        void StartSlideTransition(SlideElement* elem, SlideList::iterator oldFirst, SlideList::iterator oldEnd);
+        void CaptureSlideTransition();
+        void DrawSlideTransition();
+
+        void DrawActiveElements();
+        // stamps elements, which are going to be drawn in this frame
+        void MarkActiveElements();
+        uint32 m_frame;
+        void InvalidateStaticCache() { staticCache.valid = false; };
 
         SlideList::iterator firstActual, lastActual;
 
+        // Elements from the beginning of slide, which are not changing anymore (effects expired, no expressions)
+        // are compiled into display list, so they cost only one call per frame
+        struct StaticElementCache
+        {
+            GLuint displayList;
+            SlideList::iterator first;    // first element of cached sequence
+            uint32 count;                 // number of cached elements
+            uint32 styleGeneration;       // storage style generation at the time of build
+            uint32 screenSize[2];         // screen resolution at the time of build
+            uint32 atlasGeneration;       // glyph atlas generation, reset atlas has other glyphs at the cached coordinates
+            bool valid;
+        } staticCache;
+
         struct BackgroundData
         {
             uint32 color;
@@ -76,8 +141,12 @@ class PresentationMgr
             uint32 backgroundPosition[2];
             uint32 backgroundDimensions[2];
             SlideElement* source;         // in case of recalculating sizes (changing of screen resolution 'on demand', and so)
+            bool cached;                  // composed background is rendered in m_backgroundCapture
         } bgData;
 
+        // Background is composed only when changed, and then drawn as one textured quad
+        ScreenCapture m_backgroundCapture;
+
         // These things are used for "hard" canvas effects
         // this means, that every element on the canvas will be affected, regardless of order
         struct CanvasLayer
@@ -85,6 +154,7 @@ class PresentationMgr
             CVector2 baseCoord;
             float baseAngle;
             float baseScale;
+            float baseBlur;
             uint32 baseColor;
 
             // canvas offset
@@ -102,6 +172,7 @@ class PresentationMgr
             EffectTime hardScale_time;
 
             // canvas blur
+            // radius in pixels
             float hardBlur;
             EffectTime hardBlur_time;
 
@@ -110,7 +181,20 @@ class PresentationMgr
             EffectTime hardColorize_time;
         } canvas;
 
+        // Slide transition - outgoing slide is captured into texture once and then composited over the new slide
+        struct SlideTransition
+        {
+            SlideSwitchType type;
+            SlideList::iterator first;    // first element of outgoing slide
+            SlideList::iterator end;      // element after the last element of outgoing slide
+            bool captured;
+            float moveAngle;
+            EffectTime time;
+        } transition;
+        ScreenCapture m_transitionCapture;
+
         bool m_blocking;
+        bool m_benchmarkPending;     // BENCHEXPR request waiting for idle presentation
 
         bool m_btEnabled;
 #ifdef _WIN32
@@ -14,19 +14,6 @@
 
 #define DEFAULT_NETWORK_PORT 3693
 
-struct StoredFont
-{
-    const wchar_t* fontName;
-    uint32 fontSize;
-
-    bool bold;
-    bool italic;
-    bool underline;
-    bool strikeout;
-
-    int32 fontId;
-};
-
 class Storage
 {
     public:
@@ -47,6 +34,8 @@ class Storage
         uint32 GetScreenHeight() { return m_screenHeight; };
         void AllowFullscreen(bool allow) { m_fullscreen = allow; };
         bool IsFullscreenAllowed() { return m_fullscreen; };
+        void ForceCPUBlur(bool force) { m_cpuBlur = force; };
+        bool IsCPUBlurForced() { return m_cpuBlur; };
         void SetOriginalScreenWidth(uint32 width) { m_originalScreenWidth = width; };
         void SetOriginalScreenHeight(uint32 height) { m_originalScreenHeight = height; };
         uint32 GetOriginalScreenWidth() { return m_originalScreenWidth; };
@@ -58,8 +47,13 @@ class Storage
 
         void SetDefaultFontId(int32 id) { m_defaultFontId = id; };
         int32 GetDefaultFontId() { return m_defaultFontId; };
+        // registers fonts of queued styles, and parses markup which waited for them
         void BuildStyleFonts();
 
+        // style generation is increased everytime some font is built or some text markup reparsed
+        // so anything cached from style data knows, that it's no longer valid
+        uint32 GetStyleGeneration() { return m_styleGeneration; };
+
         void AddNewStyle(const wchar_t* name, Style* style)
         {
             if (!name || !style)
@@ -67,6 +61,16 @@ class Storage
 
             m_styleMap[name] = style;
         }
+        // marks font of style to be built again, parser calls it for every font property of style
+        void RequestStyleFont(Style* style)
+        {
+            if (!style || style->fontId == -2)
+                return;
+
+            style->fontId = -2;
+            m_pendingFontStyles.push_back(style);
+        }
+        bool HasPendingFonts() { return !m_pendingFontStyles.empty(); };
         Style* GetStyle(const wchar_t* name)
         {
             for (StyleMap::iterator itr = m_styleMap.begin(); itr != m_styleMap.end(); ++itr)
@@ -95,6 +99,7 @@ class Storage
                     return itr->second;
             return NULL;
         }
+        EffectMap* GetEffectMap() { return &m_effectMap; };
 
         void AddNewTemplate(const wchar_t* name, SlideTemplate* st)
         {
@@ -147,7 +152,7 @@ class Storage
 
             return m_slideData[pos];
         }
-        SlideElement* GetSlideElementById(std::wstring id)
+        SlideElement* GetSlideElementById(const std::wstring &id)
         {
             for (SlideElementVector::iterator itr = m_slideData.begin(); itr != m_slideData.end(); ++itr)
             {
@@ -203,6 +208,9 @@ class Storage
             m_postParseList.push_back(elem);
         }
         void PostParseElements();
+        void BuildExpressionDependencies(SlideElement* elem);
+        // program is bound to the first element with given id, when there's some
+        void AddExpressionDependent(StyledTextCache* cache, uint32 index, const wchar_t* elementId, uint8 properties, ExpressionProgram* program);
 
         // Resources.cpp
         uint32 PrepareResource(const wchar_t* name, ResourceEntry* res);
@@ -265,6 +273,7 @@ class Storage
         uint32 m_originalScreenWidth;
         uint32 m_originalScreenHeight;
         bool m_fullscreen;
+        bool m_cpuBlur;
 
         SlideElementVector::iterator m_lastOverwrittenElement;
 
@@ -278,7 +287,8 @@ class Storage
         std::list<MacroPair> m_macros;
 
         int32 m_defaultFontId;
-        std::list<StoredFont> m_fontMap;
+        uint32 m_styleGeneration;
+        std::vector<Style*> m_pendingFontStyles;  // styles waiting for their font to be built
         Style* m_defaultTextStyle;
         std::wstring m_defaultStyleName;
 
@@ -0,0 +1,317 @@
+#include "Global.h"
+#include "Easing.h"
+
+#include <cwchar>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define EASING_USE_SSE2
+#endif
+
+struct EasingName
+{
+    const wchar_t* name;
+    uint8 id;
+};
+
+static const EasingName easingNames[] = {
+    {L"linear",      EP_LINEAR},
+    {L"sinus",       EP_SINUS},
+    {L"quadratic",   EP_QUADRATIC},
+    {L"ease",        EP_EASE},
+    {L"ease-in",     EP_EASE_IN},
+    {L"ease-out",    EP_EASE_OUT},
+    {L"ease-in-out", EP_EASE_IN_OUT},
+    {L"back-in",     EP_BACK_IN},
+    {L"back-out",    EP_BACK_OUT},
+    {L"back",        EP_BACK_OUT},
+    {L"elastic",     EP_ELASTIC},
+    {L"bounce",      EP_BOUNCE},
+    {NULL,           EP_INVALID}
+};
+
+EasingMgr::EasingMgr()
+{
+    m_curves.resize(MAX_EP_PREDEFINED, NULL);
+
+    m_curves[EP_LINEAR]      = CreateCurve(EASING_LINEAR);
+    m_curves[EP_SINUS]       = CreateCurve(EASING_SINUS);
+    m_curves[EP_QUADRATIC]   = CreateCurve(EASING_QUADRATIC);
+    m_curves[EP_EASE]        = CreateCurve(EASING_CUBIC_BEZIER, 0.25f, 0.1f, 0.25f, 1.0f);
+    m_curves[EP_EASE_IN]     = CreateCurve(EASING_CUBIC_BEZIER, 0.42f, 0.0f, 1.0f, 1.0f);
+    m_curves[EP_EASE_OUT]    = CreateCurve(EASING_CUBIC_BEZIER, 0.0f, 0.0f, 0.58f, 1.0f);
+    m_curves[EP_EASE_IN_OUT] = CreateCurve(EASING_CUBIC_BEZIER, 0.42f, 0.0f, 0.58f, 1.0f);
+    m_curves[EP_BACK_IN]     = CreateCurve(EASING_BACK_IN);
+    m_curves[EP_BACK_OUT]    = CreateCurve(EASING_BACK_OUT);
+    m_curves[EP_ELASTIC]     = CreateCurve(EASING_ELASTIC);
+    m_curves[EP_BOUNCE]      = CreateCurve(EASING_BOUNCE);
+
+    // custom curves are stored from fixed id, so the predefined ones can be extended in future
+    m_curves.resize(EP_CUSTOM_START, NULL);
+}
+
+EasingMgr::~EasingMgr()
+{
+    for (uint32 i = 0; i < m_curves.size(); i++)
+        delete m_curves[i];
+}
+
+EasingCurve* EasingMgr::CreateCurve(uint8 function, float p0, float p1, float p2, float p3)
+{
+    EasingCurve* curve = new EasingCurve;
+
+    curve->function = function;
+    curve->params[0] = p0;
+    curve->params[1] = p1;
+    curve->params[2] = p2;
+    curve->params[3] = p3;
+
+    for (uint32 i = 0; i <= EASING_TABLE_SIZE; i++)
+        curve->table[i] = EvaluateFunction(function, curve->params, float(i) / float(EASING_TABLE_SIZE));
+
+    // the ends has to be exact, so the effects finish where they should
+    curve->table[0] = EvaluateFunction(function, curve->params, 0.0f);
+    curve->table[EASING_TABLE_SIZE] = 1.0f;
+
+    return curve;
+}
+
+uint8 EasingMgr::RegisterCurve(uint8 function, float p0, float p1, float p2, float p3)
+{
+    // reuse already registered curve with the same definition
+    for (uint32 i = EP_CUSTOM_START; i < m_curves.size(); i++)
+    {
+        EasingCurve* curve = m_curves[i];
+        if (curve && curve->function == function && curve->params[0] == p0 && curve->params[1] == p1
+            && curve->params[2] == p2 && curve->params[3] == p3)
+            return uint8(i);
+    }
+
+    if (m_curves.size() >= EP_INVALID)
+        return EP_INVALID;
+
+    m_curves.push_back(CreateCurve(function, p0, p1, p2, p3));
+
+    return uint8(m_curves.size() - 1);
+}
+
+uint8 EasingMgr::ParseCurve(const wchar_t* input)
+{
+    if (!input)
+        return EP_INVALID;
+
+    for (uint32 i = 0; easingNames[i].name != NULL; i++)
+        if (EqualString(input, easingNames[i].name, true))
+            return easingNames[i].id;
+
+    const wchar_t* lower = ToLowercase(input);
+    float p[4];
+    int steps;
+    uint8 id = EP_INVALID;
+
+    if (swscanf(lower, L"cubic-bezier(%f,%f,%f,%f)", &p[0], &p[1], &p[2], &p[3]) == 4)
+    {
+        // x coordinates of control points has to stay within <0;1>, otherwise the curve is not a function
+        if (p[0] >= 0.0f && p[0] <= 1.0f && p[2] >= 0.0f && p[2] <= 1.0f)
+            id = RegisterCurve(EASING_CUBIC_BEZIER, p[0], p[1], p[2], p[3]);
+    }
+    else if (swscanf(lower, L"steps(%d)", &steps) == 1)
+    {
+        if (steps > 0)
+            id = RegisterCurve(EASING_STEPS, float(steps), 0.0f, 0.0f, 0.0f);
+    }
+
+    delete[] lower;
+
+    return id;
+}
+
+EasingCurve* EasingMgr::GetCurve(uint8 id)
+{
+    if (id >= m_curves.size() || !m_curves[id])
+        return m_curves[EP_LINEAR];
+
+    return m_curves[id];
+}
+
+float EasingMgr::Evaluate(uint8 id, float x)
+{
+    return GetCurve(id)->Evaluate(x);
+}
+
+void EasingMgr::EvaluateBatch(uint8 id, const float* in, float* out, uint32 count)
+{
+    EasingCurve* curve = GetCurve(id);
+    float* table = curve->table;
+    uint32 i = 0;
+
+    // steps are not interpolated, see EasingCurve::Evaluate
+    if (curve->function == EASING_STEPS)
+    {
+        for ( ; i < count; i++)
+            out[i] = curve->Evaluate(in[i]);
+        return;
+    }
+
+#ifdef EASING_USE_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 size = _mm_set1_ps(float(EASING_TABLE_SIZE));
+    // the last index used as left sample is size-1, value 1.0 is then interpolated with fraction 1
+    const __m128i lastIndex = _mm_set1_epi32(EASING_TABLE_SIZE - 1);
+
+    int32 index[4];
+    float left[4], right[4];
+
+    for ( ; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&in[i]);
+        x = _mm_min_ps(_mm_max_ps(x, zero), one);
+
+        __m128 pos = _mm_mul_ps(x, size);
+        __m128i idx = _mm_cvttps_epi32(pos);
+        // min for epi32 is not available in SSE2, so compare and select
+        __m128i over = _mm_cmpgt_epi32(idx, lastIndex);
+        idx = _mm_or_si128(_mm_and_si128(over, lastIndex), _mm_andnot_si128(over, idx));
+        __m128 frac = _mm_sub_ps(pos, _mm_cvtepi32_ps(idx));
+
+        _mm_storeu_si128((__m128i*)index, idx);
+        for (uint32 j = 0; j < 4; j++)
+        {
+            left[j] = table[index[j]];
+            right[j] = table[index[j]+1];
+        }
+
+        __m128 l = _mm_loadu_ps(left);
+        __m128 r = _mm_loadu_ps(right);
+        _mm_storeu_ps(&out[i], _mm_add_ps(l, _mm_mul_ps(_mm_sub_ps(r, l), frac)));
+    }
+#endif
+
+    for ( ; i < count; i++)
+    {
+        float x = in[i];
+        if (x < 0.0f)
+            x = 0.0f;
+        else if (x > 1.0f)
+            x = 1.0f;
+
+        float pos = x * float(EASING_TABLE_SIZE);
+        uint32 index = uint32(pos);
+        if (index >= EASING_TABLE_SIZE)
+            index = EASING_TABLE_SIZE - 1;
+
+        float frac = pos - float(index);
+        out[i] = table[index] + (table[index+1] - table[index]) * frac;
+    }
+}
+
+float EasingMgr::SolveCubicBezier(float x1, float y1, float x2, float y2, float x)
+{
+    // find parameter t for given x by Newton's method, bisection is used when it does not converge
+    float t = x;
+    uint32 i;
+
+    for (i = 0; i < 8; i++)
+    {
+        float inv = 1.0f - t;
+        float curX = 3.0f*inv*inv*t*x1 + 3.0f*inv*t*t*x2 + t*t*t;
+        float dX = 3.0f*inv*inv*x1 + 6.0f*inv*t*(x2 - x1) + 3.0f*t*t*(1.0f - x2);
+
+        if (fabs(curX - x) < 1e-6f)
+            break;
+        if (fabs(dX) < 1e-6f)
+        {
+            i = 8;
+            break;
+        }
+
+        t -= (curX - x) / dX;
+    }
+
+    if (i == 8 || t < 0.0f || t > 1.0f)
+    {
+        float lo = 0.0f, hi = 1.0f;
+        t = x;
+        for (i = 0; i < 32; i++)
+        {
+            float inv = 1.0f - t;
+            float curX = 3.0f*inv*inv*t*x1 + 3.0f*inv*t*t*x2 + t*t*t;
+            if (fabs(curX - x) < 1e-6f)
+                break;
+
+            if (curX < x)
+                lo = t;
+            else
+                hi = t;
+
+            t = (lo + hi) / 2.0f;
+        }
+    }
+
+    float inv = 1.0f - t;
+    return 3.0f*inv*inv*t*y1 + 3.0f*inv*t*t*y2 + t*t*t;
+}
+
+float EasingMgr::EvaluateFunction(uint8 function, float* params, float x)
+{
+    switch (function)
+    {
+        case EASING_LINEAR:
+        default:
+            return x;
+        case EASING_SINUS:
+            return sin(x * float(M_PI) / 2.0f);
+        case EASING_QUADRATIC:
+            return x*x;
+        case EASING_CUBIC_BEZIER:
+            return SolveCubicBezier(params[0], params[1], params[2], params[3], x);
+        case EASING_BACK_IN:
+        {
+            const float s = 1.70158f;
+            return x*x*((s + 1.0f)*x - s);
+        }
+        case EASING_BACK_OUT:
+        {
+            const float s = 1.70158f;
+            float t = x - 1.0f;
+            return t*t*((s + 1.0f)*t + s) + 1.0f;
+        }
+        case EASING_ELASTIC:
+        {
+            if (x <= 0.0f || x >= 1.0f)
+                return x;
+
+            return pow(2.0f, -10.0f*x) * sin((x*10.0f - 0.75f) * (2.0f*float(M_PI)/3.0f)) + 1.0f;
+        }
+        case EASING_BOUNCE:
+        {
+            const float n = 7.5625f;
+            const float d = 2.75f;
+
+            if (x < 1.0f/d)
+                return n*x*x;
+            else if (x < 2.0f/d)
+            {
+                x -= 1.5f/d;
+                return n*x*x + 0.75f;
+            }
+            else if (x < 2.5f/d)
+            {
+                x -= 2.25f/d;
+                return n*x*x + 0.9375f;
+            }
+
+            x -= 2.625f/d;
+            return n*x*x + 0.984375f;
+        }
+        case EASING_STEPS:
+        {
+            if (x >= 1.0f)
+                return 1.0f;
+
+            return floor(x * params[0]) / params[0];
+        }
+    }
+}
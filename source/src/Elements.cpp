@@ -6,8 +6,26 @@
 #include "Defines/Styles.h"
 #include "Defines/Effects.h"
 #include "Handlers/EffectHandler.h"
+#include "Handlers/DrawBatch.h"
+#include "Handlers/GlyphAtlas.h"
+#include "Handlers/TextMetrics.h"
+#include "Handlers/FontRegistry.h"
+#include "Handlers/Profiler.h"
 #include "Presentation.h"
 
+// Splits position to whole units of original resolution and the rest, rounded to whole pixels of real screen
+// Glyphs are rasterized to pixel grid, so the text would be blurred when drawn at sub-pixel position
+static void SnapTextPosition(float* position, int32* whole, float* rest)
+{
+    float screenScale = (float)sStorage->GetScreenHeight() / (float)sStorage->GetOriginalScreenHeight();
+
+    for (uint32 i = 0; i <= 1; i++)
+    {
+        whole[i] = int32(floor(position[i]));
+        rest[i] = floor((position[i] - float(whole[i])) * screenScale + 0.5f) / screenScale;
+    }
+}
+
 void SlideElement::CreateEffectIfAny()
 {
     myEffect = NULL;
@@ -18,7 +36,7 @@ void SlideElement::CreateEffectIfAny()
         if (tmp)
         {
             if (elemType != SLIDE_ELEM_PLAY_EFFECT)
-                myEffect = new EffectHandler(this, tmp);
+                myEffect = sPresentation->GetEffectPool()->Acquire(this, tmp);
         }
     }
 }
@@ -26,6 +44,7 @@ void SlideElement::CreateEffectIfAny()
 void SlideElement::OnCreate()
 {
     needRecalc = false;
+    BindDependents();
     CalculatePosition();
 }
 
@@ -42,18 +61,35 @@ void SlideElement::CalculatePosition()
         myStyle = sStorage->GetDefaultStyle();
 
     uint32 width = 0, height = 0;
+    bool provisional = false;
     if (elemType == SLIDE_ELEM_TEXT)
     {
-        if (typeText.outlist && typeText.outlist->size() > 0)
+        bool styled = (typeText.outlist && typeText.outlist->size() > 0);
+
+        // text drawn by glyph atlas is measured by its shaped runs, SimplyFlat metrics are used for the rest
+        float atlasSize[2];
+        bool measured = false;
+        if (styled)
+            measured = sGlyphAtlas->MeasureStyledText(typeText.outlist, atlasSize[0], atlasSize[1], provisional);
+        else if (myStyle->fontId >= 0)
+            measured = sGlyphAtlas->MeasureText(myStyle->fontId, elemTextData::GetFeatureArrayIndexOf(myStyle), typeText.text,
+                                                atlasSize[0], atlasSize[1], provisional);
+
+        if (measured)
+        {
+            width = uint32(atlasSize[0] + 0.5f);
+            height = uint32(atlasSize[1] + 0.5f);
+        }
+        else if (styled)
         {
             for (StyledTextList::const_iterator itr = typeText.outlist->begin(); itr != typeText.outlist->end(); ++itr)
             {
                 if ((*itr)->fontId >= 0)
-                    if (SF->Drawing->GetFontHeight((*itr)->fontId) > height)
-                        height = SF->Drawing->GetFontHeight((*itr)->fontId);
+                    if (sTextMetrics->GetFontHeight((*itr)->fontId) > height)
+                        height = sTextMetrics->GetFontHeight((*itr)->fontId);
 
                 if ((*itr)->fontId >= 0)
-                    width += SF->Drawing->GetTextWidth((*itr)->fontId, (*itr)->feature, (*itr)->text);
+                    width += sTextMetrics->GetTextWidth((*itr)->fontId, (*itr)->feature, (*itr)->text);
                 else
                     needRecalc = true;
             }
@@ -62,8 +98,8 @@ void SlideElement::CalculatePosition()
         {
             if (myStyle->fontId >= 0)
             {
-                width = SF->Drawing->GetTextWidth(myStyle->fontId, elemTextData::GetFeatureArrayIndexOf(myStyle), typeText.text);
-                height = SF->Drawing->GetFontHeight(myStyle->fontId);
+                width = sTextMetrics->GetTextWidth(myStyle->fontId, elemTextData::GetFeatureArrayIndexOf(myStyle), typeText.text);
+                height = sTextMetrics->GetFontHeight(myStyle->fontId);
             }
             else
                 needRecalc = true;
@@ -77,19 +113,54 @@ void SlideElement::CalculatePosition()
 
     if (!needRecalc)
     {
-        if (position[0] == POS_CENTER)
-            position[0] = (sStorage->GetOriginalScreenWidth()-width) / 2;
-        else if (position[0] == POS_LEFT)
-            position[0] = 0;
-        else if (position[0] == POS_RIGHT)
-            position[0] = sStorage->GetOriginalScreenWidth()-width;
+        // special positions are resolved once the size is known, numbers are used directly
+        if (positionSpec[0] == POS_CENTER)
+            position[0] = float(int32(sStorage->GetOriginalScreenWidth()-width) / 2);
+        else if (positionSpec[0] == POS_LEFT)
+            position[0] = 0.0f;
+        else if (positionSpec[0] == POS_RIGHT)
+            position[0] = float(int32(sStorage->GetOriginalScreenWidth()-width));
+
+        if (positionSpec[1] == POS_CENTER)
+            position[1] = float(int32(sStorage->GetOriginalScreenHeight()-height) / 2);
+        else if (positionSpec[1] == POS_TOP)
+            position[1] = 0.0f;
+        else if (positionSpec[1] == POS_BOTTOM)
+            position[1] = float(int32(sStorage->GetOriginalScreenHeight()-height));
+    }
+
+    NotifyMoved();
+
+    // fallback glyphs are only temporary, the text is measured again until the real ones arrive
+    if (provisional)
+        needRecalc = true;
+}
+
+void SlideElement::NotifyMoved(uint8 properties)
+{
+    if (!dependents)
+        return;
 
-        if (position[1] == POS_CENTER)
-            position[1] = (sStorage->GetOriginalScreenHeight()-height) / 2;
-        else if (position[1] == POS_TOP)
-            position[1] = 0;
-        else if (position[1] == POS_BOTTOM)
-            position[1] = sStorage->GetOriginalScreenHeight()-height;
+    for (ExpressionDependentList::iterator itr = dependents->begin(); itr != dependents->end(); ++itr)
+    {
+        if (itr->properties & properties)
+        {
+            itr->cache->flags[itr->expression] |= STYLED_EXPRESSION_DIRTY;
+            itr->cache->dirty = true;
+        }
+    }
+}
+
+void SlideElement::BindDependents()
+{
+    if (!dependents)
+        return;
+
+    // this instance is bound only if it's the first one created, the rest of work is done by NotifyMoved
+    for (ExpressionDependentList::iterator itr = dependents->begin(); itr != dependents->end(); ++itr)
+    {
+        if (itr->expression < itr->cache->programs.size() && itr->cache->programs[itr->expression])
+            itr->cache->programs[itr->expression]->BindElement(this, true);
     }
 }
 
@@ -107,10 +178,157 @@ void SlideElement::PlayEffect(Effect* eff)
     if (!eff)
         return;
 
+    if (eff->isConcurrent)
+    {
+        AddEffectLayer(eff);
+        return;
+    }
+
     if (myEffect)
         myEffect->QueueEffect(eff);
     else
-        myEffect = new EffectHandler(this, eff);
+        myEffect = sPresentation->GetEffectPool()->Acquire(this, eff);
+}
+
+void SlideElement::AddEffectLayer(Effect* eff)
+{
+    if (!effectLayers)
+        effectLayers = new EffectLayerList;
+
+    // after all layers with the same or lower priority, so the order is given only by priority and playing order
+    EffectLayerList::iterator itr = effectLayers->begin();
+    while (itr != effectLayers->end() && (*itr)->getEffectProto()->priority <= eff->priority)
+        ++itr;
+
+    effectLayers->insert(itr, sPresentation->GetEffectPool()->Acquire(this, eff, false, true));
+}
+
+void SlideElement::ClearEffectLayers()
+{
+    for (uint32 i = 0; i <= 1; i++)
+        expiredLayerPosition[i] = 0.0f;
+    expiredLayerOpacity = 255.0f;
+    expiredLayerScale = 1.0f;
+
+    // element may not be drawn again, so its dependents would see the movement of removed layers
+    if (layerPosition[0] != 0.0f || layerPosition[1] != 0.0f)
+    {
+        layerPosition[0] = 0.0f;
+        layerPosition[1] = 0.0f;
+        NotifyMoved();
+    }
+
+    if (!effectLayers)
+        return;
+
+    for (EffectLayerList::iterator itr = effectLayers->begin(); itr != effectLayers->end(); ++itr)
+        sPresentation->GetEffectPool()->Release(*itr);
+
+    effectLayers->clear();
+}
+
+void SlideElement::ResetEffects()
+{
+    ClearEffectLayers();
+
+    if (!myEffect)
+        return;
+
+    // restores values from the start of effect and removes played effects from queue
+    myEffect->RollBack();
+
+    // effect was not given by element definition, but created by the first played one
+    if (wcslen(elemEffect) == 0 || myEffect->getEffectProto() != sStorage->GetEffect(elemEffect))
+    {
+        sPresentation->GetEffectPool()->Release(myEffect);
+        myEffect = NULL;
+    }
+}
+
+void SlideElement::FinishEffects()
+{
+    if (myEffect)
+        myEffect->Finish();
+
+    if (effectLayers)
+    {
+        for (EffectLayerList::iterator itr = effectLayers->begin(); itr != effectLayers->end(); ++itr)
+            (*itr)->Finish();
+    }
+}
+
+void SlideElement::SeekEffects(Effect* last, bool queued, uint32 elapsed)
+{
+    if (!last)
+    {
+        FinishEffects();
+        return;
+    }
+
+    if (myEffect)
+    {
+        if (last->isConcurrent)
+            myEffect->Finish();
+        else if (queued)
+            myEffect->SeekQueue(elapsed);
+        else
+            myEffect->Seek(elapsed);
+    }
+
+    if (!effectLayers)
+        return;
+
+    // the last played layer of that effect
+    EffectHandler* seeked = NULL;
+    if (last->isConcurrent)
+    {
+        for (uint32 i = effectLayers->size(); i > 0; i--)
+        {
+            if ((*effectLayers)[i-1]->getEffectProto() == last)
+            {
+                seeked = (*effectLayers)[i-1];
+                break;
+            }
+        }
+    }
+
+    for (EffectLayerList::iterator itr = effectLayers->begin(); itr != effectLayers->end(); ++itr)
+    {
+        if ((*itr) == seeked)
+            (*itr)->Seek(elapsed);
+        else
+            (*itr)->Finish();
+    }
+}
+
+void SlideElement::ComposeEffectLayers()
+{
+    // composition is commutative, so the final values of expired layers could be applied at once
+    float composedOpacity = float(opacity) * expiredLayerOpacity / 255.0f;
+    position[0] += expiredLayerPosition[0];
+    position[1] += expiredLayerPosition[1];
+    scale *= expiredLayerScale;
+
+    for (uint32 i = 0; effectLayers && i < effectLayers->size(); )
+    {
+        EffectHandler* layer = (*effectLayers)[i];
+        if (!layer->isExpired())
+            layer->Animate();
+
+        layer->ComposeLayer(position, composedOpacity, scale);
+
+        // expired layer is kept only by its final values
+        if (layer->isExpired())
+        {
+            layer->ComposeLayer(expiredLayerPosition, expiredLayerOpacity, expiredLayerScale);
+            sPresentation->GetEffectPool()->Release(layer);
+            effectLayers->erase(effectLayers->begin() + i);
+        }
+        else
+            i++;
+    }
+
+    opacity = uint8((composedOpacity < 0.0f) ? 0.0f : ((composedOpacity > 255.0f) ? 255.0f : composedOpacity));
 }
 
 void SlideElement::Draw()
@@ -120,9 +338,34 @@ void SlideElement::Draw()
 
     sSimplyFlat->Drawing->PushMatrix();
 
-    if (myEffect && !myEffect->isExpired())
+    // concurrent effects are composed with element state only for drawing, the state itself is kept
+    bool composed = (effectLayers && !effectLayers->empty()) || expiredLayerPosition[0] != 0.0f || expiredLayerPosition[1] != 0.0f
+                    || expiredLayerOpacity != 255.0f || expiredLayerScale != 1.0f;
+    bool animated = (myEffect && !myEffect->isExpired());
+
+    uint64 animateStart = (animated || composed) ? FrameProfiler::GetTime() : 0;
+
+    if (animated)
         myEffect->Animate();
 
+    float basePosition[2] = {position[0], position[1]};
+    uint8 baseOpacity = opacity;
+    float baseScale = scale;
+
+    if (composed)
+        ComposeEffectLayers();
+
+    if (animated || composed)
+        EffectHandler::AddAnimateTime(uint32(FrameProfiler::GetTime() - animateStart));
+
+    // expressions refer to the element where it's drawn
+    if (position[0] - basePosition[0] != layerPosition[0] || position[1] - basePosition[1] != layerPosition[1])
+    {
+        layerPosition[0] = position[0] - basePosition[0];
+        layerPosition[1] = position[1] - basePosition[1];
+        NotifyMoved();
+    }
+
     switch (elemType)
     {
         case SLIDE_ELEM_TEXT:
@@ -134,9 +377,47 @@ void SlideElement::Draw()
             break;
     }
 
+    if (composed)
+    {
+        position[0] = basePosition[0];
+        position[1] = basePosition[1];
+        opacity = baseOpacity;
+        scale = baseScale;
+    }
+
     sSimplyFlat->Drawing->PopMatrix();
 }
 
+bool SlideElement::IsStatic()
+{
+    // static element is the one, which would draw exactly the same geometry in every next frame
+    if (!drawable)
+        return true;
+
+    if (needRecalc)
+        return false;
+
+    if (myEffect && !myEffect->isExpired())
+        return false;
+
+    if (effectLayers)
+    {
+        for (EffectLayerList::iterator itr = effectLayers->begin(); itr != effectLayers->end(); ++itr)
+            if (!(*itr)->isExpired())
+                return false;
+    }
+
+    // expressions may refer to another element, which has moved
+    if (elemType == SLIDE_ELEM_TEXT && !typeText.outlistExpressions.empty())
+    {
+        StyledTextCache* cache = typeText.outlistCache;
+        if (!cache || !cache->valid || cache->dirty || cache->anyVolatile)
+            return false;
+    }
+
+    return true;
+}
+
 uint8 SlideElement::elemTextData::GetFeatureArrayIndexOf(Style* style)
 {
     return (style->bold << 0 | style->italic << 1 | style->underline << 2 | style->strikeout << 3);
@@ -155,27 +436,29 @@ void SlideElement::elemTextData::Draw(SlideElement* parent)
     {
         // Set color if any
         uint32 color = 0;
+        uint32 textColor = MAKE_COLOR_RGBA(255, 255, 255, parent->opacity);
         if (myStyle->fontColor)
         {
             color = (*(myStyle->fontColor));
 
             if (!myStyle->overlayColor)
-                glColor4ub(COLOR_R(color),COLOR_G(color),COLOR_B(color), parent->opacity);
+                textColor = MAKE_COLOR_RGBA(COLOR_R(color), COLOR_G(color), COLOR_B(color), parent->opacity);
             else
-                glColor4ub(uint8(COLOR_R(color)+(1-(float)COLOR_A((*myStyle->overlayColor))/255.0f)*(COLOR_R(color)-COLOR_R((*myStyle->overlayColor)))),
-                           uint8(COLOR_G(color)+(1-(float)COLOR_A((*myStyle->overlayColor))/255.0f)*(COLOR_G(color)-COLOR_G((*myStyle->overlayColor)))),
-                           uint8(COLOR_B(color)+(1-(float)COLOR_A((*myStyle->overlayColor))/255.0f)*(COLOR_B(color)-COLOR_B((*myStyle->overlayColor)))),
-                           parent->opacity);
+                textColor = MAKE_COLOR_RGBA(uint8(COLOR_R(color)+(1-(float)COLOR_A((*myStyle->overlayColor))/255.0f)*(COLOR_R(color)-COLOR_R((*myStyle->overlayColor)))),
+                                            uint8(COLOR_G(color)+(1-(float)COLOR_A((*myStyle->overlayColor))/255.0f)*(COLOR_G(color)-COLOR_G((*myStyle->overlayColor)))),
+                                            uint8(COLOR_B(color)+(1-(float)COLOR_A((*myStyle->overlayColor))/255.0f)*(COLOR_B(color)-COLOR_B((*myStyle->overlayColor)))),
+                                            parent->opacity);
         }
         else if (myStyle->overlayColor)
         {
             color = (*(myStyle->overlayColor));
-            glColor4ub(COLOR_R(color),COLOR_G(color),COLOR_B(color), parent->opacity);
+            textColor = MAKE_COLOR_RGBA(COLOR_R(color), COLOR_G(color), COLOR_B(color), parent->opacity);
         }
 
-        glTranslatef((GLfloat)parent->position[0], (GLfloat)parent->position[1], 0);
-        glScalef(parent->scale, parent->scale, parent->scale);
-        glTranslatef(-(GLfloat)parent->position[0], -(GLfloat)parent->position[1], 0);
+        // text is printed at whole coordinates, the rest of movement is done by whole screen pixels
+        int32 textPos[2];
+        float textOffset[2];
+        SnapTextPosition(parent->position, textPos, textOffset);
 
         int32 wrap = WW_NO_WRAP;
         if (parent->typeText.wrapSign == WW_PREWRAP)
@@ -188,35 +471,96 @@ void SlideElement::elemTextData::Draw(SlideElement* parent)
         else
             wrap = parent->typeText.wrapSign;
 
+        int32 fontId = (myStyle->fontId >= 0) ? myStyle->fontId : sStorage->GetDefaultFontId();
+        uint8 feature = (myStyle->fontId >= 0) ? GetFeatureArrayIndexOf(myStyle) : FA_NORMAL;
+
+        if (outlist && outlist->size() > 0)
+            UpdateOutlist(parent);
+
+        // glyph atlas puts the text to the batch together with other quads, SimplyFlat is used only for fonts atlas can't handle
+        BatchTransform transform(parent->position[0], parent->position[1], parent->scale);
+        float atlasPos[2] = {float(textPos[0]) + textOffset[0], float(textPos[1]) + textOffset[1]};
+
+        if (outlist && outlist->size() > 0)
+        {
+            if (sGlyphAtlas->PrintStyledText(atlasPos[0], atlasPos[1], wrap, outlist, textColor, &transform))
+                return;
+        }
+        else if (sGlyphAtlas->PrintText(fontId, feature, atlasPos[0], atlasPos[1], wrap, parent->typeText.text, textColor, &transform))
+            return;
+
+        glColor4ub(COLOR_R(textColor), COLOR_G(textColor), COLOR_B(textColor), COLOR_A(textColor));
+
+        // text is drawn directly by SimplyFlat, so everything batched before has to be submitted to keep drawing order
+        sDrawBatch->Flush();
+
+        glTranslatef(parent->position[0], parent->position[1], 0);
+        glScalef(parent->scale, parent->scale, parent->scale);
+        glTranslatef(-parent->position[0], -parent->position[1], 0);
+        glTranslatef(textOffset[0], textOffset[1], 0);
+
         // draw text with own font. If not set, use default font
+        // SimplyFlat has its own font ids, the font is built now if it's the first text atlas could not draw with it
         if (outlist && outlist->size() > 0)
+            sSimplyFlat->Drawing->PrintStyledText(textPos[0], textPos[1], wrap, sFontRegistry->GetSimplyFlatList(outlist));
+        else
+            sSimplyFlat->Drawing->PrintText(sFontRegistry->GetSimplyFlatFont(fontId), textPos[0], textPos[1], feature, wrap, parent->typeText.text);
+
+        // Set color back to white
+        glColor4ub(255, 255, 255, 255);
+    }
+}
+
+void SlideElement::elemTextData::UpdateOutlist(SlideElement* parent)
+{
+    if (!outlistCache)
+    {
+        // element without dependency graph, we have to evaluate everything every time
+        outlistCache = new StyledTextCache;
+        outlistCache->values.resize(outlistExpressions.size(), 0);
+        outlistCache->flags.resize(outlistExpressions.size(), STYLED_EXPRESSION_VOLATILE);
+        outlistCache->anyVolatile = true;
+    }
+
+    StyledTextCache* cache = outlistCache;
+    bool rebuild = !cache->valid || cache->styleGeneration != sStorage->GetStyleGeneration();
+
+    // only expressions, which refer to moved element, are evaluated, and the text is formatted only when the result differs
+    if (rebuild || cache->dirty || cache->anyVolatile)
+    {
+        uint32 i = 0;
+        for (ExprMap::iterator itr = outlistExpressions.begin(); itr != outlistExpressions.end(); ++itr, i++)
         {
-            StyledTextList *tmp = new StyledTextList(outlist->begin(), outlist->end());
-            for (ExprMap::iterator itr = outlistExpressions.begin(); itr != outlistExpressions.end(); ++itr)
-            {
-                int64 val = sPresentation->NumerateExpression(&(*itr).second);
-                swprintf(((*tmp)[(*itr).first])->text, 255, L"%li", val);
-            }
+            if (!rebuild && !(cache->flags[i] & (STYLED_EXPRESSION_DIRTY | STYLED_EXPRESSION_VOLATILE)))
+                continue;
 
-            for (StyledTextList::iterator itr = tmp->begin(); itr != tmp->end(); ++itr)
-            {
-                (*itr)->color &= 0xFFFFFF00; // remove alpha value
-                (*itr)->color |= uint8(parent->opacity); // and add parent opacity
-            }
+            cache->flags[i] &= ~STYLED_EXPRESSION_DIRTY;
 
-            sSimplyFlat->Drawing->PrintStyledText(parent->position[0], parent->position[1], wrap, tmp);
+            ExpressionProgram* program = (i < cache->programs.size()) ? cache->programs[i] : NULL;
+            int64 val = sPresentation->EvaluateExpression(program, &(*itr).second);
+            if (!rebuild && cache->values[i] == val)
+                continue;
 
-            delete tmp;
+            cache->values[i] = val;
+            swprintf(((*outlist)[(*itr).first])->text, STYLED_EXPRESSION_TEXT_LEN, L"%lld", val);
+        }
+
+        cache->dirty = false;
+    }
+
+    if (rebuild || cache->opacity != parent->opacity)
+    {
+        for (StyledTextList::iterator itr = outlist->begin(); itr != outlist->end(); ++itr)
+        {
+            (*itr)->color &= 0xFFFFFF00; // remove alpha value
+            (*itr)->color |= uint8(parent->opacity); // and add parent opacity
         }
-        else if (myStyle->fontId >= 0)
-            sSimplyFlat->Drawing->PrintText(myStyle->fontId, parent->position[0], parent->position[1], GetFeatureArrayIndexOf(myStyle), wrap, parent->typeText.text);
-        else
-            sSimplyFlat->Drawing->PrintText(sStorage->GetDefaultFontId(), parent->position[0], parent->position[1], FA_NORMAL, wrap, parent->typeText.text);
 
-        // Set color back to white if necessary
-        if (myStyle->fontColor || myStyle->overlayColor)
-            glColor4ub(255, 255, 255, 255);
+        cache->opacity = parent->opacity;
     }
+
+    cache->styleGeneration = sStorage->GetStyleGeneration();
+    cache->valid = true;
 }
 
 void SlideElement::elemImageData::Draw(SlideElement* parent)
@@ -240,9 +584,12 @@ void SlideElement::elemImageData::Draw(SlideElement* parent)
 
         color = (color & 0xFFFFFF00) | newOpacity;
 
+        // both texture and overlay goes to the batch, they will be submitted together with other images
+        BatchTransform transform(parent->position[0], parent->position[1], parent->scale);
+
         if (res && res->image)
-            sSimplyFlat->Drawing->DrawRectangle(parent->position[0], parent->position[1], parent->typeImage.size[0], parent->typeImage.size[1], MAKE_COLOR_RGBA(255,255,255,parent->opacity), res->image->textureId);
+            sDrawBatch->AddQuad(parent->position[0], parent->position[1], (float)parent->typeImage.size[0], (float)parent->typeImage.size[1], MAKE_COLOR_RGBA(255,255,255,parent->opacity), res->image->textureId, BATCH_BLEND_ALPHA, &transform);
 
-        sSimplyFlat->Drawing->DrawRectangle(parent->position[0], parent->position[1], parent->typeImage.size[0], parent->typeImage.size[1], color, 0);
+        sDrawBatch->AddQuad(parent->position[0], parent->position[1], (float)parent->typeImage.size[0], (float)parent->typeImage.size[1], color, 0, BATCH_BLEND_ALPHA, &transform);
     }
 }
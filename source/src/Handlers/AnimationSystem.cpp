@@ -0,0 +1,179 @@
+#include "Global.h"
+#include "Storage.h"
+#include "Easing.h"
+#include "Handlers/EffectHandler.h"
+#include "Handlers/AnimationSystem.h"
+
+AnimationSystem::AnimationSystem()
+{
+}
+
+int32 AnimationSystem::Add(EffectHandler* handler, SlideElement* owner, uint8 properties, clock_t startTime, uint32 duration, uint8 curve,
+                           float* fromPos, float* toPos, float fromOpacity, float toOpacity, float fromScale, float toScale)
+{
+    if (!handler || !owner || duration == 0)
+        return ANIMATION_INVALID_SLOT;
+
+    m_handler.push_back(handler);
+    m_owner.push_back(owner);
+    m_properties.push_back(properties);
+
+    m_startTime.push_back(startTime);
+    m_invDuration.push_back(1.0f / float(duration));
+    m_curve.push_back(curve);
+
+    m_fromX.push_back(fromPos ? fromPos[0] : 0.0f);
+    m_fromY.push_back(fromPos ? fromPos[1] : 0.0f);
+    m_toX.push_back(toPos ? toPos[0] : 0.0f);
+    m_toY.push_back(toPos ? toPos[1] : 0.0f);
+    m_fromOpacity.push_back(fromOpacity);
+    m_toOpacity.push_back(toOpacity);
+    m_fromScale.push_back(fromScale);
+    m_toScale.push_back(toScale);
+
+    return int32(m_owner.size() - 1);
+}
+
+void AnimationSystem::Remove(int32 slot)
+{
+    if (slot < 0 || uint32(slot) >= m_owner.size())
+        return;
+
+    // move last animation to the removed slot, so the arrays stay dense
+    uint32 last = m_owner.size() - 1;
+    if (uint32(slot) != last)
+    {
+        m_handler[slot] = m_handler[last];
+        m_owner[slot] = m_owner[last];
+        m_properties[slot] = m_properties[last];
+        m_startTime[slot] = m_startTime[last];
+        m_invDuration[slot] = m_invDuration[last];
+        m_curve[slot] = m_curve[last];
+        m_fromX[slot] = m_fromX[last];
+        m_fromY[slot] = m_fromY[last];
+        m_toX[slot] = m_toX[last];
+        m_toY[slot] = m_toY[last];
+        m_fromOpacity[slot] = m_fromOpacity[last];
+        m_toOpacity[slot] = m_toOpacity[last];
+        m_fromScale[slot] = m_fromScale[last];
+        m_toScale[slot] = m_toScale[last];
+
+        m_handler[slot]->SetAnimationSlot(slot);
+    }
+
+    m_handler.pop_back();
+    m_owner.pop_back();
+    m_properties.pop_back();
+    m_startTime.pop_back();
+    m_invDuration.pop_back();
+    m_curve.pop_back();
+    m_fromX.pop_back();
+    m_fromY.pop_back();
+    m_toX.pop_back();
+    m_toY.pop_back();
+    m_fromOpacity.pop_back();
+    m_toOpacity.pop_back();
+    m_fromScale.pop_back();
+    m_toScale.pop_back();
+}
+
+void AnimationSystem::Update(clock_t now, uint32 frame)
+{
+    uint32 count = m_owner.size();
+    if (count == 0)
+        return;
+
+    uint32 i, j;
+
+    // interpolated animations are linear movements or effects without movement
+    for (i = 0; i < count; i++)
+        EffectHandler::CountEvaluations((m_properties[i] & ANIM_PROP_POSITION) ? uint8(MOVE_TYPE_LINEAR) : uint8(EFFECT_STAT_NO_MOVE), 1);
+
+    m_time.resize(count);
+    m_coef.resize(count);
+    m_x.resize(count);
+    m_y.resize(count);
+    m_opacity.resize(count);
+    m_scale.resize(count);
+
+    // time pass
+    for (i = 0; i < count; i++)
+    {
+        float t = float(now - m_startTime[i]) * m_invDuration[i];
+        m_time[i] = (t < 0.0f) ? 0.0f : ((t > 1.0f) ? 1.0f : t);
+    }
+
+    // easing pass, animations with the same curve next to each other are evaluated at once
+    for (i = 0; i < count; i = j)
+    {
+        for (j = i + 1; j < count && m_curve[j] == m_curve[i]; j++)
+            ;
+
+        sEasing->EvaluateBatch(m_curve[i], &m_time[i], &m_coef[i], j - i);
+    }
+
+    // interpolation passes
+    for (i = 0; i < count; i++)
+        m_x[i] = m_fromX[i] + (m_toX[i] - m_fromX[i]) * m_coef[i];
+    for (i = 0; i < count; i++)
+        m_y[i] = m_fromY[i] + (m_toY[i] - m_fromY[i]) * m_coef[i];
+    for (i = 0; i < count; i++)
+        m_opacity[i] = m_fromOpacity[i] + (m_toOpacity[i] - m_fromOpacity[i]) * m_coef[i];
+    for (i = 0; i < count; i++)
+        m_scale[i] = m_fromScale[i] + (m_toScale[i] - m_fromScale[i]) * m_coef[i];
+
+    // write back
+    m_finished.clear();
+    m_notify.clear();
+    for (i = 0; i < count; i++)
+    {
+        SlideElement* owner = m_owner[i];
+
+        if (owner->activeFrame != frame)
+        {
+            if (m_time[i] >= 1.0f)
+            {
+                m_finished.push_back(i);
+                m_notify.push_back(false);
+            }
+            continue;
+        }
+
+        if (m_properties[i] & ANIM_PROP_POSITION)
+        {
+            owner->position[0] = m_x[i];
+            owner->position[1] = m_y[i];
+            owner->NotifyMoved();
+        }
+        if (m_properties[i] & ANIM_PROP_OPACITY)
+        {
+            float opacity = m_opacity[i];
+            owner->opacity = uint8((opacity < 0.0f) ? 0.0f : ((opacity > 255.0f) ? 255.0f : opacity));
+        }
+        if (m_properties[i] & ANIM_PROP_SCALE)
+            owner->scale = m_scale[i];
+
+        if (m_time[i] >= 1.0f)
+        {
+            m_finished.push_back(i);
+            m_notify.push_back(true);
+        }
+    }
+
+    if (m_finished.empty())
+        return;
+
+    // remove finished animations first (from the end, so the indexes stay valid), handlers may add new ones when notified
+    m_finishedHandlers.clear();
+    for (i = m_finished.size(); i > 0; i--)
+    {
+        uint32 slot = m_finished[i-1];
+        if (m_notify[i-1])
+            m_finishedHandlers.push_back(m_handler[slot]);
+        m_handler[slot]->SetAnimationSlot(ANIMATION_INVALID_SLOT);
+        Remove(slot);
+    }
+
+    for (i = 0; i < m_finishedHandlers.size(); i++)
+        m_finishedHandlers[i]->AnimationFinished();
+}
@@ -0,0 +1,279 @@
+#include "Global.h"
+#include "Defines/Styles.h"
+#include "Handlers/DrawBatch.h"
+
+#include <algorithm>
+
+DrawBatch::DrawBatch()
+{
+    m_lastQuadCount = 0;
+    m_lastDrawCalls = 0;
+}
+
+BatchQuad* DrawBatch::PrepareQuad(float x, float y, float width, float height, uint32 textureId, uint8 blend, BatchTransform* transform)
+{
+    m_quads.resize(m_quads.size()+1);
+    BatchQuad* quad = &m_quads.back();
+
+    float x1 = x, y1 = y, x2 = x + width, y2 = y + height;
+
+    // apply scale around transform origin, the same way as glTranslate-glScale-glTranslate sequence did
+    if (transform && transform->scale != 1.0f)
+    {
+        x1 = transform->originX + (x1 - transform->originX) * transform->scale;
+        y1 = transform->originY + (y1 - transform->originY) * transform->scale;
+        x2 = transform->originX + (x2 - transform->originX) * transform->scale;
+        y2 = transform->originY + (y2 - transform->originY) * transform->scale;
+    }
+
+    quad->vertex[0][0] = x1; quad->vertex[0][1] = y1;
+    quad->vertex[1][0] = x2; quad->vertex[1][1] = y1;
+    quad->vertex[2][0] = x2; quad->vertex[2][1] = y2;
+    quad->vertex[3][0] = x1; quad->vertex[3][1] = y2;
+
+    quad->bounds[0] = (x1 < x2) ? x1 : x2;
+    quad->bounds[1] = (y1 < y2) ? y1 : y2;
+    quad->bounds[2] = (x1 < x2) ? x2 : x1;
+    quad->bounds[3] = (y1 < y2) ? y2 : y1;
+
+    quad->textureId = textureId;
+    quad->blend = blend;
+    quad->sequence = m_quads.size()-1;
+
+    return quad;
+}
+
+uint32 DrawBatch::GetGridCell(float coord)
+{
+    if (coord <= 0.0f)
+        return 0;
+
+    uint32 cell = uint32(coord / BATCH_GRID_CELL);
+    return (cell < BATCH_GRID_SIZE) ? cell : BATCH_GRID_SIZE - 1;
+}
+
+void DrawBatch::ComputeLayer(BatchQuad* quad)
+{
+    // The quad has to be drawn after every earlier quad it overlaps with. If the overlapped quad
+    // shares the same state, it's enough to stay in the same layer, since the sort keeps submission
+    // order within the same state. Otherwise we need to move one layer up.
+    quad->layer = 0;
+
+    uint32 index = quad->sequence;
+    m_visited.resize(index + 1);
+    m_visited[index] = index;
+
+    // only the quads sharing some cell of grid could overlap
+    uint32 minX = GetGridCell(quad->bounds[0]), maxX = GetGridCell(quad->bounds[2]);
+    uint32 minY = GetGridCell(quad->bounds[1]), maxY = GetGridCell(quad->bounds[3]);
+
+    for (uint32 y = minY; y <= maxY; y++)
+    {
+        for (uint32 x = minX; x <= maxX; x++)
+        {
+            std::vector<uint32> &cell = m_grid[y * BATCH_GRID_SIZE + x];
+
+            for (uint32 i = 0; i < cell.size(); i++)
+            {
+                // quad covering more cells is compared only once
+                if (m_visited[cell[i]] == index)
+                    continue;
+                m_visited[cell[i]] = index;
+
+                BatchQuad* prev = &m_quads[cell[i]];
+                if (prev->bounds[0] >= quad->bounds[2] || prev->bounds[2] <= quad->bounds[0] ||
+                    prev->bounds[1] >= quad->bounds[3] || prev->bounds[3] <= quad->bounds[1])
+                    continue;
+
+                uint32 needed = prev->layer;
+                if (prev->textureId != quad->textureId || prev->blend != quad->blend)
+                    needed++;
+
+                if (needed > quad->layer)
+                    quad->layer = needed;
+            }
+
+            cell.push_back(index);
+        }
+    }
+}
+
+void DrawBatch::AddQuad(float x, float y, float width, float height, uint32 color, uint32 textureId, uint8 blend, BatchTransform* transform)
+{
+    AddTexturedQuad(x, y, width, height, color, textureId, 0.0f, 0.0f, 1.0f, 1.0f, blend, transform);
+}
+
+void DrawBatch::AddTexturedQuad(float x, float y, float width, float height, uint32 color, uint32 textureId, float u0, float v0, float u1, float v1, uint8 blend, BatchTransform* transform)
+{
+    // fully transparent quads does not need to be drawn at all
+    if (blend == BATCH_BLEND_ALPHA && COLOR_A(color) == 0)
+        return;
+
+    BatchQuad* quad = PrepareQuad(x, y, width, height, textureId, blend, transform);
+
+    quad->texCoord[0][0] = u0; quad->texCoord[0][1] = v0;
+    quad->texCoord[1][0] = u1; quad->texCoord[1][1] = v0;
+    quad->texCoord[2][0] = u1; quad->texCoord[2][1] = v1;
+    quad->texCoord[3][0] = u0; quad->texCoord[3][1] = v1;
+
+    for (uint32 i = 0; i < 4; i++)
+        quad->color[i] = color;
+
+    ComputeLayer(quad);
+}
+
+void DrawBatch::AddGradientQuad(float x, float y, float width, float height, uint32 colorFrom, uint32 colorTo, uint32 direction, BatchTransform* transform)
+{
+    BatchQuad* quad = PrepareQuad(x, y, width, height, 0, BATCH_BLEND_ALPHA, transform);
+
+    for (uint32 i = 0; i < 4; i++)
+    {
+        quad->texCoord[i][0] = 0.0f;
+        quad->texCoord[i][1] = 0.0f;
+    }
+
+    // direction means the side, where the gradient ends with its destination color
+    switch (direction)
+    {
+        case VERT_TOP:
+            quad->color[0] = colorTo;   quad->color[1] = colorTo;
+            quad->color[2] = colorFrom; quad->color[3] = colorFrom;
+            break;
+        case VERT_BOTTOM:
+        default:
+            quad->color[0] = colorFrom; quad->color[1] = colorFrom;
+            quad->color[2] = colorTo;   quad->color[3] = colorTo;
+            break;
+        case VERT_LEFT:
+            quad->color[0] = colorTo;   quad->color[1] = colorFrom;
+            quad->color[2] = colorFrom; quad->color[3] = colorTo;
+            break;
+        case VERT_RIGHT:
+            quad->color[0] = colorFrom; quad->color[1] = colorTo;
+            quad->color[2] = colorTo;   quad->color[3] = colorFrom;
+            break;
+    }
+
+    ComputeLayer(quad);
+}
+
+struct BatchQuadOrder
+{
+    BatchQuadOrder(std::vector<BatchQuad>* quads): m_quads(quads) {};
+
+    bool operator()(uint32 a, uint32 b) const
+    {
+        const BatchQuad& qa = (*m_quads)[a];
+        const BatchQuad& qb = (*m_quads)[b];
+
+        if (qa.layer != qb.layer)
+            return qa.layer < qb.layer;
+        if (qa.blend != qb.blend)
+            return qa.blend < qb.blend;
+        if (qa.textureId != qb.textureId)
+            return qa.textureId < qb.textureId;
+
+        return qa.sequence < qb.sequence;
+    }
+
+    std::vector<BatchQuad>* m_quads;
+};
+
+void DrawBatch::Flush()
+{
+    m_lastQuadCount = m_quads.size();
+    m_lastDrawCalls = 0;
+
+    if (m_quads.empty())
+        return;
+
+    uint32 i, j, count = m_quads.size();
+
+    m_order.resize(count);
+    for (i = 0; i < count; i++)
+        m_order[i] = i;
+
+    std::sort(m_order.begin(), m_order.end(), BatchQuadOrder(&m_quads));
+
+    // Fill vertex arrays in sorted order
+    m_vertexArray.resize(count*4*2);
+    m_texCoordArray.resize(count*4*2);
+    m_colorArray.resize(count*4*4);
+
+    for (i = 0; i < count; i++)
+    {
+        BatchQuad* quad = &m_quads[m_order[i]];
+        for (j = 0; j < 4; j++)
+        {
+            m_vertexArray[(i*4+j)*2+0] = quad->vertex[j][0];
+            m_vertexArray[(i*4+j)*2+1] = quad->vertex[j][1];
+            m_texCoordArray[(i*4+j)*2+0] = quad->texCoord[j][0];
+            m_texCoordArray[(i*4+j)*2+1] = quad->texCoord[j][1];
+            m_colorArray[(i*4+j)*4+0] = COLOR_R(quad->color[j]);
+            m_colorArray[(i*4+j)*4+1] = COLOR_G(quad->color[j]);
+            m_colorArray[(i*4+j)*4+2] = COLOR_B(quad->color[j]);
+            m_colorArray[(i*4+j)*4+3] = COLOR_A(quad->color[j]);
+        }
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    glVertexPointer(2, GL_FLOAT, 0, &m_vertexArray[0]);
+    glTexCoordPointer(2, GL_FLOAT, 0, &m_texCoordArray[0]);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, &m_colorArray[0]);
+
+    // And submit every run of quads with the same state with single draw call
+    uint32 runStart = 0;
+    for (i = 1; i <= count; i++)
+    {
+        BatchQuad* first = &m_quads[m_order[runStart]];
+        if (i < count)
+        {
+            BatchQuad* quad = &m_quads[m_order[i]];
+            if (quad->textureId == first->textureId && quad->blend == first->blend)
+                continue;
+        }
+
+        if (first->textureId > 0)
+        {
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, first->textureId);
+        }
+        else
+            glDisable(GL_TEXTURE_2D);
+
+        if (first->blend == BATCH_BLEND_ALPHA)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        else if (first->blend == BATCH_BLEND_ADD)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        else
+            glDisable(GL_BLEND);
+
+        glDrawArrays(GL_QUADS, runStart*4, (i-runStart)*4);
+        m_lastDrawCalls++;
+
+        runStart = i;
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_BLEND);
+    glColor4ub(255, 255, 255, 255);
+
+    // clear() keeps allocated memory, so next frame won't allocate again
+    m_quads.clear();
+    m_visited.clear();
+    for (i = 0; i < BATCH_GRID_SIZE * BATCH_GRID_SIZE; i++)
+        m_grid[i].clear();
+}
@@ -5,24 +5,28 @@
 #include "Defines/Effects.h"
 #include "Parsers/EffectParser.h"
 #include "Handlers/EffectHandler.h"
+#include "Handlers/AnimationSystem.h"
 #include "Defines/Slides.h"
 #include "Vector.h"
-#include "Position.h"
+#include <new>
 
-EffectHandler::EffectHandler(SlideElement *parent, Effect *elementEffect, bool fromQueue)
+EffectStatistics EffectHandler::s_statistics = {0, 0, {0}, 0};
+
+EffectHandler::EffectHandler(SlideElement *parent, Effect *elementEffect, bool fromQueue, bool asLayer)
 {
     effectOwner = parent;
     effectProto = elementEffect;
+    m_layer = asLayer;
 
     m_queuePos = 0;
 
-    int32 relativeOffset[2] = {0, 0};
+    float relativeOffset[2] = {0.0f, 0.0f};
     if (effectProto->offsetType)
     {
         if ((*effectProto->offsetType) == OFFSET_TYPE_RELATIVE)
         {
             for (uint32 i = 0; i <= 1; i++)
-                relativeOffset[i] = int32(parent->position[i]);
+                relativeOffset[i] = parent->position[i];
         }
     }
 
@@ -37,52 +41,40 @@ EffectHandler::EffectHandler(SlideElement *parent, Effect *elementEffect, bool f
     if (effectProto->startPos)
     {
         for (uint32 i = 0; i <= 1; i++)
-            startPos[i] = effectProto->startPos[i] + relativeOffset[i];
+            startPos[i] = float(effectProto->startPos[i]) + relativeOffset[i];
     }
     if (effectProto->endPos)
     {
         for (uint32 i = 0; i <= 1; i++)
-            endPos[i] = effectProto->endPos[i] + relativeOffset[i];
+            endPos[i] = float(effectProto->endPos[i]) + relativeOffset[i];
     }
 
     // Fill effect queue from chained effects defined in effect def
-    // for future: allow recursive chaining, but don't forget to avoid endless loop! (effect 1 -> effect 2 -> effect 1 -> ...)
-    // note: reversed to make queue building easier from ordered vector of chained effects
-    if (effectProto->m_effectChain)
-    {
-        Effect* tmp = NULL;
-        for (std::vector<std::wstring>::reverse_iterator itr = effectProto->m_effectChain->rbegin(); itr != effectProto->m_effectChain->rend(); ++itr)
-        {
-            const wchar_t* name = (*itr).c_str();
-            tmp = sStorage->GetEffect(itr->c_str());
-            if (tmp)
-            {
-                m_effectQueue.push_back(tmp);
-                m_queuePos++;
-            }
-        }
-    }
+    // chain is resolved after parsing including chains of chained effects, so queued handlers does not fill their own queue
+    // layers does not run chained effects, they would write to the element directly
+    if (!fromQueue && !m_layer)
+        QueueChain();
     m_queuedEffectHandler = NULL;
 
     expired = false;
     runningQueue = false;
 
     // set parent final position for this effect (only if we are not listed as queued effect)
-    if (!fromQueue)
+    if (!fromQueue && !m_layer)
     {
         for (uint32 i = 0; i <= 1; i++)
-            parent->finalPosition[i] = endPos[i];
+            parent->finalPosition[i] = int32(endPos[i]);
 
         Effect* tmp = NULL;
-        for (std::list<Effect*>::const_reverse_iterator itr = m_effectQueue.rbegin(); itr != m_effectQueue.rend(); ++itr)
+        for (EffectQueue::const_reverse_iterator itr = m_effectQueue.rbegin(); itr != m_effectQueue.rend(); ++itr)
         {
-            tmp = (*itr);
+            tmp = itr->first;
             if (tmp->moveType)
             {
                 if (tmp->offsetType && (*(tmp->offsetType)) == OFFSET_TYPE_RELATIVE)
                 {
                     for (uint32 i = 0; i <= 1; i++)
-                        parent->finalPosition[i] = endPos[i] + tmp->endPos[i];
+                        parent->finalPosition[i] = int32(endPos[i]) + tmp->endPos[i];
                 }
                 else
                     for (uint32 i = 0; i <= 1; i++)
@@ -91,61 +83,94 @@ EffectHandler::EffectHandler(SlideElement *parent, Effect *elementEffect, bool f
         }
     }
 
-    if (effectProto->moveType && (*(effectProto->moveType)) == MOVE_TYPE_CIRCULAR)
+    if (m_layer)
+    {
+        // layer values multiply the element ones, so they start from neutral values
+        startOpacity = effectProto->srcOpacity ? (*effectProto->srcOpacity) : 255;
+        startScale = effectProto->srcScale ? (*effectProto->srcScale) : 1.0f;
+    }
+    else
     {
-        // phase is constant deviation from the mathematical "zero" angle
-        // ..kind of magic here, yes.
-        phase = acos(  ((startPos[0] - endPos[0])/2)  /  (sqrt(pow(float(startPos[0] - endPos[0]), 2) + pow(float(startPos[1] - endPos[1]), 2)) / 2 ) );
-        // radius is the distance from any end point to center of the line between start and end points
-        radius = sqrt(pow(float(endPos[0] - startPos[0]), 2) + pow(float(endPos[1] - startPos[1]), 2)) / 2;
-
-        // this vector is used as radius vector - when computing coords, we have to move to the center of rotation
-        movementVector[0].x = float(endPos[0] - startPos[0]) / 2.0f;
-        movementVector[0].y = float(endPos[1] - startPos[1]) / 2.0f;
+        if (effectProto->srcOpacity)
+            effectOwner->opacity = (*effectProto->srcOpacity);
+
+        // save starting opacity for later calculation
+        startOpacity = effectOwner->opacity;
+
+        if (effectProto->srcScale)
+            effectOwner->scale = (*effectProto->srcScale);
+
+        startScale = effectOwner->scale;
     }
 
-    if (effectProto->srcOpacity)
-        effectOwner->opacity = (*effectProto->srcOpacity);
+    for (uint32 i = 0; i <= 1; i++)
+        m_state.position[i] = startPos[i];
+    m_state.opacity = float(startOpacity);
+    m_state.scale = startScale;
 
-    // save starting opacity for later calculation
-    startOpacity = effectOwner->opacity;
+    // compile prototype at first usage, and bind it to our cached values
+    if (!effectProto->program)
+        effectProto->program = CompileEffect(effectProto);
+    m_program = effectProto->program;
 
-    if (effectProto->srcScale)
-        effectOwner->scale = (*effectProto->srcScale);
+    m_statType = effectProto->moveType ? uint8(*effectProto->moveType) : EFFECT_STAT_NO_MOVE;
+    if (m_statType > EFFECT_STAT_NO_MOVE)
+        m_statType = EFFECT_STAT_NO_MOVE;
 
-    startScale = effectOwner->scale;
+    BindTracks();
 
     startTime = clock();
+
+    m_animSlot = ANIMATION_INVALID_SLOT;
+    RegisterAnimation();
 }
 
 EffectHandler::~EffectHandler()
 {
+    if (m_animSlot != ANIMATION_INVALID_SLOT)
+        sAnimation->Remove(m_animSlot);
+
+    ReleaseQueuedHandler();
+    SetQueuePos(0);
 }
 
 void EffectHandler::RollBack()
 {
-    if (effectOwner)
+    if (effectOwner && !m_layer)
     {
         for (uint32 i = 0; i <= 1; i++)
             effectOwner->position[i] = startPos[i];
 
         effectOwner->opacity = startOpacity;
         effectOwner->scale = startScale;
+
+        effectOwner->NotifyMoved();
     }
 
     startTime = clock();
     SetExpired(false);
     runningQueue = false;
 
-    for (std::list<Effect*>::iterator itr = m_effectQueue.begin(); itr != m_effectQueue.end(); )
+    // queued effect in progress is not valid anymore
+    ReleaseQueuedHandler();
+
+    // start interpolation again from the beginning
+    if (m_animSlot != ANIMATION_INVALID_SLOT)
+    {
+        sAnimation->Remove(m_animSlot);
+        m_animSlot = ANIMATION_INVALID_SLOT;
+    }
+    RegisterAnimation();
+
+    for (EffectQueue::iterator itr = m_effectQueue.begin(); itr != m_effectQueue.end(); )
     {
-        if (!(*itr))
+        if (!itr->first)
         {
             itr = m_effectQueue.erase(itr);
             continue;
         }
 
-        if (m_effectQueueFlags.find(*itr) != m_effectQueueFlags.end())
+        if (itr->second)
         {
             itr = m_effectQueue.erase(itr);
             continue;
@@ -154,29 +179,93 @@ void EffectHandler::RollBack()
         itr++;
     }
 
-    m_queuePos = m_effectQueue.size();
+    SetQueuePos(m_effectQueue.size());
+}
+
+void EffectHandler::Seek(uint32 elapsed)
+{
+    ReleaseQueuedHandler();
+    runningQueue = false;
+    SetExpired(false);
+    SetQueuePos(m_effectQueue.size());
+
+    startTime = clock() - clock_t(elapsed);
+
+    if (m_animSlot != ANIMATION_INVALID_SLOT)
+    {
+        sAnimation->Remove(m_animSlot);
+        m_animSlot = ANIMATION_INVALID_SLOT;
+    }
+
+    // the state at given time is written right away, so the dependents and static check see it before the next update
+    Animate();
+
+    // finished effect is not registered again, Animate has set its final values
+    if (!isExpired() && !isRunningQueue() && elapsed < m_program->duration)
+        RegisterAnimation();
 }
 
-void EffectHandler::RollBackLastQueued()
+void EffectHandler::SeekQueue(uint32 elapsed)
 {
-    if (m_queuePos == m_effectQueue.size())
+    if (m_queuePos == 0)
+    {
+        Seek(elapsed);
         return;
+    }
+
+    FinishQueue(1);
+
+    // the last queued effect runs from the final state of the previous ones, as if it was reached by Animate
+    EffectQueue::iterator it = m_effectQueue.end();
+    it--;
+
+    m_queuedEffectHandler = sPresentation->GetEffectPool()->Acquire(effectOwner, it->first, true);
+    if (it->second)
+        m_queuedEffectHandler->QueueChain();
+
+    m_queuedEffectHandler->Seek(elapsed);
+
+    runningQueue = true;
+    SetExpired(false);
+}
+
+void EffectHandler::Finish()
+{
+    FinishQueue(0);
+
+    runningQueue = false;
+    SetExpired(true);
+}
+
+void EffectHandler::FinishQueue(uint32 keep)
+{
+    ReleaseQueuedHandler();
+
+    if (m_animSlot != ANIMATION_INVALID_SLOT)
+    {
+        sAnimation->Remove(m_animSlot);
+        m_animSlot = ANIMATION_INVALID_SLOT;
+    }
 
-    uint32 i;
-    std::list<EffectHandler*>::iterator itr = m_effectQueueHandlers.end();
-    --itr;
-    for (i = 1; i < m_queuePos; i++)
-        if (itr != m_effectQueueHandlers.begin())
-            --itr;
+    timeCoef = 1.0f;
+    FinishTracks();
 
-    for (i = 0; i <= 1; i++)
-        effectOwner->position[i] = (*itr)->startPos[i];
+    // queued effects, every one starts from the final state of the previous
+    while (m_queuePos > keep)
+    {
+        EffectQueue::iterator it = m_effectQueue.end();
+        for (uint32 i = 0; i < m_queuePos; i++)
+            it--;
+
+        EffectHandler* queued = sPresentation->GetEffectPool()->Acquire(effectOwner, it->first, true);
+        if (it->second)
+            queued->QueueChain();
 
-    effectOwner->opacity = (*itr)->startOpacity;
-    effectOwner->scale = (*itr)->startScale;
+        queued->Finish();
+        sPresentation->GetEffectPool()->Release(queued);
 
-    if (m_queuePos != 0)
-        m_queuePos--;
+        SetQueuePos(m_queuePos - 1);
+    }
 }
 
 void EffectHandler::QueueEffect(Effect* eff)
@@ -184,17 +273,15 @@ void EffectHandler::QueueEffect(Effect* eff)
     if (isExpired())
         SetExpired(false);
 
-    m_effectQueue.push_back(eff);
-    m_queuePos++; // due to moving every single element by one
-
-    m_effectQueueFlags[eff] = EFFECT_QF_ADDED_LATER;
+    m_effectQueue.push_back(EffectQueueEntry(eff, true));
+    SetQueuePos(m_queuePos + 1); // due to moving every single element by one
 
     if (eff->moveType)
     {
         if (eff->offsetType && (*(eff->offsetType)) == OFFSET_TYPE_RELATIVE)
         {
             for (uint32 i = 0; i <= 1; i++)
-                effectOwner->finalPosition[i] = endPos[i] + eff->endPos[i];
+                effectOwner->finalPosition[i] = int32(endPos[i]) + eff->endPos[i];
         }
         else
             for (uint32 i = 0; i <= 1; i++)
@@ -202,6 +289,19 @@ void EffectHandler::QueueEffect(Effect* eff)
     }
 }
 
+void EffectHandler::QueueChain()
+{
+    if (!effectProto->chain)
+        return;
+
+    // note: reversed to make queue building easier from ordered vector of chained effects
+    for (std::vector<Effect*>::reverse_iterator itr = effectProto->chain->rbegin(); itr != effectProto->chain->rend(); ++itr)
+    {
+        m_effectQueue.push_back(EffectQueueEntry(*itr, false));
+        SetQueuePos(m_queuePos + 1);
+    }
+}
+
 void EffectHandler::QueuedEffectExpired()
 {
     if (m_effectQueue.empty())
@@ -212,14 +312,41 @@ void EffectHandler::QueuedEffectExpired()
 
     // remove last effect from queue
     //m_effectQueue.erase(--m_effectQueue.end());
-    m_queuePos--;
-    //delete m_queuedEffectHandler;
-    m_queuedEffectHandler = NULL;
+    SetQueuePos(m_queuePos - 1);
+
+    // its final state was written to the element, so the handler could be recycled
+    ReleaseQueuedHandler();
 
     if (m_queuePos == 0)
         SetExpired();
 }
 
+void EffectHandler::SetQueuePos(uint32 pos)
+{
+    s_statistics.queuedEffects += pos;
+    s_statistics.queuedEffects -= m_queuePos;
+
+    m_queuePos = pos;
+}
+
+void EffectHandler::ResetFrameStatistics(EffectStatistics* target)
+{
+    if (target)
+        memcpy(target, &s_statistics, sizeof(EffectStatistics));
+
+    for (uint32 i = 0; i <= MAX_MOVE_TYPE; i++)
+        s_statistics.evaluations[i] = 0;
+    s_statistics.animateTime = 0;
+}
+
+void EffectHandler::ReleaseQueuedHandler()
+{
+    if (m_queuedEffectHandler)
+        sPresentation->GetEffectPool()->Release(m_queuedEffectHandler);
+
+    m_queuedEffectHandler = NULL;
+}
+
 void EffectHandler::UnblockPresentationIfNeeded()
 {
     if (effectProto->isBlocking)
@@ -228,8 +355,7 @@ void EffectHandler::UnblockPresentationIfNeeded()
 
 void EffectHandler::Animate()
 {
-    // Dispatcher for effect types
-    // Here we only determine the type and call appropriate function
+    // Effect prototype was compiled to list of tracks, so here we only compute time and run their kernels
 
     if (isRunningQueue())
     {
@@ -242,12 +368,15 @@ void EffectHandler::Animate()
         // If no effect handler defined, create one from last available effect
         if (!m_queuedEffectHandler)
         {
-            std::list<Effect*>::iterator it = m_effectQueue.end();
+            EffectQueue::iterator it = m_effectQueue.end();
             for (uint32 i = 0; i < m_queuePos; i++)
                 it--;
 
-            m_queuedEffectHandler = new EffectHandler(effectOwner ,(*it), true);
-            m_effectQueueHandlers.push_back(m_queuedEffectHandler);
+            m_queuedEffectHandler = sPresentation->GetEffectPool()->Acquire(effectOwner, it->first, true);
+
+            // effect played later is not part of resolved chain, so it plays its own
+            if (it->second)
+                m_queuedEffectHandler->QueueChain();
         }
 
         if (m_queuedEffectHandler->isExpired())
@@ -258,11 +387,15 @@ void EffectHandler::Animate()
         return;
     }
 
+    // values are computed by animation system
+    if (m_animSlot != ANIMATION_INVALID_SLOT)
+        return;
+
     // Calculate time coefficient to determine position
     // if this method returns false, the effect just finished
-    if (!(effectProto->effectTimer))
+    if (m_program->duration == 0)
     {
-        timeCoef = 1.0;
+        timeCoef = 1.0f;
         SetSelfExpired();
     }
     else
@@ -270,160 +403,384 @@ void EffectHandler::Animate()
         if (!GetTimeCoef(timeCoef))
             SetSelfExpired();
 
-        CalculateEffectProgress(timeCoef);
+        timeCoef = m_program->progress->Evaluate(timeCoef);
+    }
+
+    for (uint32 i = 0; i < m_trackCount; i++)
+        m_tracks[i].kernel(&m_tracks[i], &m_state, timeCoef);
+
+    CountEvaluations(m_statType, 1);
+
+    // Synchronize ending values with demanded ones
+    if (isExpired())
+        FinishTracks();
+    else
+        ApplyState();
+}
+
+void EffectHandler::ApplyState()
+{
+    if (m_layer)
+        return;
+
+    uint8 properties = m_program->properties;
+
+    if (properties & (1 << EFFECT_TRACK_POSITION))
+    {
+        effectOwner->position[0] = m_state.position[0];
+        effectOwner->position[1] = m_state.position[1];
+        effectOwner->NotifyMoved();
+    }
+    if (properties & (1 << EFFECT_TRACK_OPACITY))
+        effectOwner->opacity = uint8(m_state.opacity);
+    if (properties & (1 << EFFECT_TRACK_SCALE))
+        effectOwner->scale = m_state.scale;
+}
+
+void EffectHandler::ComposeLayer(float* position, float &opacity, float &scale)
+{
+    // movement is added as the distance travelled from start, opacity and scale are multiplied
+    for (uint32 i = 0; i < m_trackCount; i++)
+    {
+        switch (m_tracks[i].property)
+        {
+            case EFFECT_TRACK_POSITION:
+                position[0] += m_state.position[0] - startPos[0];
+                position[1] += m_state.position[1] - startPos[1];
+                break;
+            case EFFECT_TRACK_OPACITY:
+                opacity *= m_state.opacity / 255.0f;
+                break;
+            case EFFECT_TRACK_SCALE:
+                scale *= m_state.scale;
+                break;
+        }
     }
+}
+
+void EffectHandler::CalculateEffectProgress(float &coef, uint8 progressType)
+{
+    coef = sEasing->Evaluate(progressType, coef);
+}
+
+EffectProgram* EffectHandler::CompileEffect(Effect* eff)
+{
+    EffectProgram* prog = new EffectProgram;
+
+    prog->duration = eff->effectTimer ? (*eff->effectTimer) : 0;
+    prog->progress = sEasing->GetCurve(eff->progressType ? uint8(*eff->progressType) : EP_LINEAR);
+    prog->trackCount = 0;
+    prog->properties = 0;
 
     // movement
-    if (effectProto->moveType)
+    if (eff->moveType)
     {
-        // Linear movement
-        if ((*effectProto->moveType) == MOVE_TYPE_LINEAR)
-            AnimateMoveLinear();
-        // Circle movement
-        else if ((*effectProto->moveType) == MOVE_TYPE_CIRCULAR)
-            AnimateMoveCircular();
-        // Bezier movement (cubic)
-        else if ((*effectProto->moveType) == MOVE_TYPE_BEZIER)
-            AnimateMoveBezier();
+        EffectTrackKernel kernel = &EffectHandler::KernelNone;
+
+        // without required points the element just jumps to its final position at the end
+        if (eff->startPos && eff->endPos)
+        {
+            switch (*eff->moveType)
+            {
+                case MOVE_TYPE_LINEAR:
+                    kernel = &EffectHandler::KernelMoveLinear;
+                    break;
+                // curves are sampled by length when the handler is created
+                case MOVE_TYPE_CIRCULAR:
+                case MOVE_TYPE_POLYLINE:
+                case MOVE_TYPE_SPLINE:
+                    kernel = &EffectHandler::KernelMovePath;
+                    break;
+                case MOVE_TYPE_BEZIER:
+                    if (eff->bezierVector)
+                        kernel = &EffectHandler::KernelMovePath;
+                    break;
+            }
+        }
+
+        prog->properties |= (1 << EFFECT_TRACK_POSITION);
+        prog->trackProperty[prog->trackCount] = EFFECT_TRACK_POSITION;
+        prog->trackKernel[prog->trackCount] = kernel;
+        prog->trackCount++;
     }
 
-    // fade
-    if (effectProto->fadeType)
+    // fade in and fade out differs only in direction, which is given by source and destination opacity
+    if (eff->fadeType && eff->destOpacity && (*eff->fadeType) < MAX_FADE_TYPE)
     {
-        // Fade in
-        if ((*effectProto->fadeType) == FADE_TYPE_IN)
-            AnimateFadeIn();
-        // Fade out
-        else if ((*effectProto->fadeType) == FADE_TYPE_OUT)
-            AnimateFadeOut();
+        prog->properties |= (1 << EFFECT_TRACK_OPACITY);
+        prog->trackProperty[prog->trackCount] = EFFECT_TRACK_OPACITY;
+        prog->trackKernel[prog->trackCount] = &EffectHandler::KernelOpacity;
+        prog->trackCount++;
     }
 
     // scale
-    if (effectProto->scaleType)
+    if (eff->scaleType && eff->destScale && (*eff->scaleType) == SCALE_TYPE_SCALE)
     {
-        if ((*effectProto->scaleType) == SCALE_TYPE_SCALE)
-            AnimateScaleScale();
+        prog->properties |= (1 << EFFECT_TRACK_SCALE);
+        prog->trackProperty[prog->trackCount] = EFFECT_TRACK_SCALE;
+        prog->trackKernel[prog->trackCount] = &EffectHandler::KernelScale;
+        prog->trackCount++;
     }
 
-    // Synchronization
-    if (isExpired())
+    return prog;
+}
+
+void EffectHandler::BindTracks()
+{
+    m_trackCount = m_program->trackCount;
+
+    for (uint32 i = 0; i < m_trackCount; i++)
     {
-        // Synchronize ending position with demanded coordinates
-        if (effectProto->moveType && (effectOwner->position[0] != endPos[0] || effectOwner->position[1] != endPos[1]))
+        EffectTrack* track = &m_tracks[i];
+        track->kernel = m_program->trackKernel[i];
+        track->property = m_program->trackProperty[i];
+        track->path = NULL;
+
+        switch (track->property)
         {
-            effectOwner->position[0] = endPos[0];
-            effectOwner->position[1] = endPos[1];
-        }
+            case EFFECT_TRACK_POSITION:
+            {
+                for (uint32 j = 0; j <= 1; j++)
+                {
+                    track->from[j] = startPos[j];
+                    track->to[j] = endPos[j];
+                }
 
-        // Synchronize also opacity
-        if (effectProto->fadeType && effectProto->destOpacity && effectOwner->opacity != (*effectProto->destOpacity))
-            effectOwner->opacity = (*effectProto->destOpacity);
+                if (track->kernel == &EffectHandler::KernelMovePath)
+                    BuildPath(track);
+                break;
+            }
+            case EFFECT_TRACK_OPACITY:
+                track->from[0] = float(startOpacity);
+                track->to[0] = float(*effectProto->destOpacity);
+                break;
+            case EFFECT_TRACK_SCALE:
+                track->from[0] = startScale;
+                track->to[0] = *effectProto->destScale;
+                break;
+        }
     }
 }
 
-void EffectHandler::CalculateEffectProgress(float &coef, uint8 progressType)
+void EffectHandler::BuildPath(EffectTrack* track)
 {
-    switch (progressType)
+    track->path = &m_path;
+
+    switch (*effectProto->moveType)
     {
-        case EP_LINEAR:
-        default:
+        case MOVE_TYPE_CIRCULAR:
+        {
+            // radius vector - when computing coords, we have to move to the center of rotation
+            float mvX = (track->to[0] - track->from[0]) / 2.0f;
+            float mvY = (track->to[1] - track->from[1]) / 2.0f;
+            // radius is the distance from any end point to center of the line between start and end points
+            float radius = sqrt(mvX*mvX + mvY*mvY);
+            // phase is constant deviation from the mathematical "zero" angle
+            float phase = (radius > 0.0f) ? acos(-mvX / radius) : 0.0f;
+            float sweep = (effectProto->circlePlus && (*effectProto->circlePlus)) ? -float(M_PI) : float(M_PI);
+
+            m_path.BuildCircular(track->from[0] + mvX, track->from[1] + mvY, radius, phase, sweep);
             break;
-        case EP_SINUS:
-            coef = sin(coef * M_PI / 2);
+        }
+        case MOVE_TYPE_BEZIER:
+        {
+            // cubic curve with control points start+vector1 and end+vector2
+            float control1[2] = {track->from[0] + effectProto->bezierVector[0].x, track->from[1] + effectProto->bezierVector[0].y};
+            float control2[2] = {track->to[0] + effectProto->bezierVector[1].x, track->to[1] + effectProto->bezierVector[1].y};
+
+            m_path.BuildBezier(track->from, control1, control2, track->to);
             break;
-        case EP_QUADRATIC:
-            coef = pow(coef, 2);
+        }
+        case MOVE_TYPE_POLYLINE:
+        case MOVE_TYPE_SPLINE:
+        {
+            // start position, all path points (moved the same way as start and end position) and end position
+            std::vector<float> points;
+            points.push_back(track->from[0]);
+            points.push_back(track->from[1]);
+
+            if (effectProto->pathPoints)
+            {
+                float offset[2] = {startPos[0] - float(effectProto->startPos[0]), startPos[1] - float(effectProto->startPos[1])};
+                for (std::vector<CVector2>::const_iterator itr = effectProto->pathPoints->begin(); itr != effectProto->pathPoints->end(); ++itr)
+                {
+                    points.push_back(itr->x + offset[0]);
+                    points.push_back(itr->y + offset[1]);
+                }
+            }
+
+            points.push_back(track->to[0]);
+            points.push_back(track->to[1]);
+
+            if ((*effectProto->moveType) == MOVE_TYPE_SPLINE)
+                m_path.BuildSpline(&points[0], points.size() / 2);
+            else
+                m_path.BuildPolyline(&points[0], points.size() / 2);
             break;
+        }
     }
-}
 
-void EffectHandler::CalculateEffectProgress(float &coef)
-{
-    if (effectProto->progressType)
-        CalculateEffectProgress(coef, *effectProto->progressType);
+    if (!m_path.IsBuilt())
+        track->kernel = &EffectHandler::KernelMoveLinear;
 }
 
-void EffectHandler::AnimateMoveLinear()
+void EffectHandler::FinishTracks()
 {
-    // Check for required things
-    if (!(effectProto->startPos && effectProto->endPos))
-        return;
+    for (uint32 i = 0; i < m_trackCount; i++)
+    {
+        switch (m_tracks[i].property)
+        {
+            case EFFECT_TRACK_POSITION:
+                m_state.position[0] = endPos[0];
+                m_state.position[1] = endPos[1];
+                break;
+            case EFFECT_TRACK_OPACITY:
+                m_state.opacity = m_tracks[i].to[0];
+                break;
+            case EFFECT_TRACK_SCALE:
+                m_state.scale = m_tracks[i].to[0];
+                break;
+            default:
+                break;
+        }
+    }
 
-    for (uint32 i = 0; i <= 1; i++)
-        effectOwner->position[i] = int32(startPos[i]) + int32(timeCoef * float(int32(endPos[i]) - int32(startPos[i])));
+    ApplyState();
 }
 
-void EffectHandler::AnimateMoveCircular()
+void EffectHandler::RegisterAnimation()
 {
-    // Check for required things
-    if (!(effectProto->startPos && effectProto->endPos))
+    // animation system writes directly to the element, layers has to be evaluated by themselves
+    if (m_program->duration == 0 || m_trackCount == 0 || m_layer)
         return;
 
-    float angle = phase;
+    uint8 properties = 0;
+    float fromPos[2] = {0.0f, 0.0f}, toPos[2] = {0.0f, 0.0f};
+    float fromOpacity = 0.0f, toOpacity = 0.0f, fromScale = 1.0f, toScale = 1.0f;
 
-    if (effectProto->circlePlus && (*effectProto->circlePlus))
-        angle -= timeCoef*M_PI;
-    else
-        angle += timeCoef*M_PI;
+    // only simple interpolation could be done by animation system, movement along curves stays here
+    for (uint32 i = 0; i < m_trackCount; i++)
+    {
+        EffectTrack* track = &m_tracks[i];
+
+        if (track->kernel == &EffectHandler::KernelMoveLinear)
+        {
+            properties |= ANIM_PROP_POSITION;
+            fromPos[0] = track->from[0];
+            fromPos[1] = track->from[1];
+            toPos[0] = track->to[0];
+            toPos[1] = track->to[1];
+        }
+        else if (track->kernel == &EffectHandler::KernelOpacity)
+        {
+            properties |= ANIM_PROP_OPACITY;
+            fromOpacity = track->from[0];
+            toOpacity = track->to[0];
+        }
+        else if (track->kernel == &EffectHandler::KernelScale)
+        {
+            properties |= ANIM_PROP_SCALE;
+            fromScale = track->from[0];
+            toScale = track->to[0];
+        }
+        else
+            return;
+    }
+
+    uint8 curve = effectProto->progressType ? uint8(*effectProto->progressType) : EP_LINEAR;
 
-    effectOwner->position[0] = int32(startPos[0] + movementVector[0].x + cos(angle)*radius);
-    effectOwner->position[1] = int32(startPos[1] + movementVector[0].y + sin(angle)*radius);
+    m_animSlot = sAnimation->Add(this, effectOwner, properties, startTime, m_program->duration, curve,
+                                 fromPos, toPos, fromOpacity, toOpacity, fromScale, toScale);
 }
 
-void EffectHandler::AnimateMoveBezier()
+void EffectHandler::AnimationFinished()
 {
-    // Check for required things
-    if (!(effectProto->startPos && effectProto->endPos && effectProto->bezierVector))
-        return;
-
-    CVector2 AC = effectProto->bezierVector[0];
-    CVector2 BD = effectProto->bezierVector[1];
+    m_animSlot = ANIMATION_INVALID_SLOT;
 
-    Position2 A(startPos);
-    Position2 B(endPos);
-    Position2 C = A + AC;
-    Position2 D = B + BD;
+    timeCoef = 1.0f;
+    SetSelfExpired();
+    FinishTracks();
+}
 
-    CVector2 CD = Position2::makeVector(C,D);
+void EffectHandler::KernelNone(EffectTrack* track, EffectState* target, float coef)
+{
+}
 
-    Position2 M = A + AC * timeCoef;
-    Position2 N = B + BD * (1 - timeCoef);
-    Position2 P = C + CD * timeCoef;
+void EffectHandler::KernelMoveLinear(EffectTrack* track, EffectState* target, float coef)
+{
+    target->position[0] = track->from[0] + (track->to[0] - track->from[0])*coef;
+    target->position[1] = track->from[1] + (track->to[1] - track->from[1])*coef;
+}
 
-    CVector2 MP = Position2::makeVector(M,P);
-    CVector2 NP = Position2::makeVector(N,P);
+void EffectHandler::KernelMovePath(EffectTrack* track, EffectState* target, float coef)
+{
+    float x, y;
+    track->path->Evaluate(coef, x, y);
 
-    Position2 Q = M + MP * timeCoef;
-    Position2 R = N + NP * (1 - timeCoef);
+    target->position[0] = x;
+    target->position[1] = y;
+}
 
-    CVector2 QR = Position2::makeVector(Q,R);
+void EffectHandler::KernelOpacity(EffectTrack* track, EffectState* target, float coef)
+{
+    // some curves overshoot the end, but opacity cannot
+    float value = track->from[0] + (track->to[0] - track->from[0])*coef;
+    if (value < 0.0f)
+        value = 0.0f;
+    else if (value > 255.0f)
+        value = 255.0f;
+
+    target->opacity = value;
+}
 
-    effectOwner->position[0] = int32(Q.x + QR.x * timeCoef);
-    effectOwner->position[1] = int32(Q.y + QR.y * timeCoef);
+void EffectHandler::KernelScale(EffectTrack* track, EffectState* target, float coef)
+{
+    target->scale = track->from[0] + (track->to[0] - track->from[0])*coef;
 }
 
-void EffectHandler::AnimateFadeIn()
+EffectHandlerPool::EffectHandlerPool()
 {
-    // Check for required things
-    if (!(effectProto->destOpacity))
-        return;
+    m_live = 0;
+    m_allocated = 0;
+}
 
-    effectOwner->opacity = uint8(startOpacity + float((*effectProto->destOpacity) - startOpacity)*timeCoef);
+EffectHandlerPool::~EffectHandlerPool()
+{
+    for (std::vector<void*>::iterator itr = m_free.begin(); itr != m_free.end(); ++itr)
+        ::operator delete(*itr);
 }
 
-void EffectHandler::AnimateFadeOut()
+EffectHandler* EffectHandlerPool::Acquire(SlideElement* parent, Effect* elementEffect, bool fromQueue, bool asLayer)
 {
-    // Check for required things
-    if (!(effectProto->destOpacity))
-        return;
+    void* memory = NULL;
+
+    if (!m_free.empty())
+    {
+        memory = m_free.back();
+        m_free.pop_back();
+    }
+    else
+    {
+        memory = ::operator new(sizeof(EffectHandler));
+        m_allocated++;
+    }
+
+    m_live++;
+    EffectHandler::s_statistics.liveHandlers++;
 
-    effectOwner->opacity = uint8(startOpacity - float(startOpacity - (*effectProto->destOpacity))*timeCoef);
+    return new (memory) EffectHandler(parent, elementEffect, fromQueue, asLayer);
 }
 
-void EffectHandler::AnimateScaleScale()
+void EffectHandlerPool::Release(EffectHandler* handler)
 {
-    if (!(effectProto->destScale))
+    if (!handler)
         return;
 
-    effectOwner->scale = startScale + ((*effectProto->destScale) - startScale)*timeCoef;
+    handler->~EffectHandler();
+    m_free.push_back(handler);
+
+    if (m_live > 0)
+        m_live--;
+    if (EffectHandler::s_statistics.liveHandlers > 0)
+        EffectHandler::s_statistics.liveHandlers--;
 }
@@ -0,0 +1,155 @@
+#include "Global.h"
+#include "Log.h"
+#include "Storage.h"
+#include "Handlers/FontRegistry.h"
+#include "Handlers/GlyphAtlas.h"
+#include "Handlers/TextMetrics.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+  #define snprintf _snprintf
+#endif
+
+FontRegistry::FontRegistry()
+{
+    m_entryCount = 0;
+    m_simplyFlatCount = 0;
+}
+
+int32 FontRegistry::Find(FontRegistryKey &key, const std::wstring &family)
+{
+    std::map<FontRegistryKey, std::vector<FontRegistryEntry> >::iterator itr = m_entries.find(key);
+    if (itr == m_entries.end())
+        return -1;
+
+    for (std::vector<FontRegistryEntry>::iterator entry = itr->second.begin(); entry != itr->second.end(); ++entry)
+    {
+        if (entry->family == family)
+            return entry->fontId;
+    }
+
+    return -1;
+}
+
+void FontRegistry::Insert(FontRegistryKey &key, const std::wstring &family, int32 fontId)
+{
+    FontRegistryEntry entry;
+    entry.family = family;
+    entry.fontId = fontId;
+
+    m_entries[key].push_back(entry);
+    m_entryCount++;
+}
+
+int32 FontRegistry::GetFont(const wchar_t* family, uint32 size, uint8 feature)
+{
+    if (!family)
+        return -1;
+
+    std::wstring folded(family);
+    for (uint32 i = 0; i < folded.size(); i++)
+        folded[i] = UpperChar(folded[i]);
+
+    FontRegistryKey key;
+    key.hash = HashString(folded.c_str(), folded.size());
+    key.size = size;
+    key.feature = feature;
+
+    int32 fontId = Find(key, folded);
+    if (fontId >= 0)
+        return fontId;
+
+    // the variant is in font without features, if it's built already
+    FontRegistryKey baseKey = key;
+    baseKey.feature = 0;
+
+    fontId = Find(baseKey, folded);
+    if (fontId < 0)
+    {
+        FontRegistryFont font;
+        font.family = family;
+        font.size = size;
+        font.simplyFlatId = -1;
+        font.simplyFlatBuilt = false;
+
+        fontId = int32(m_fonts.size());
+        m_fonts.push_back(font);
+
+        Insert(baseKey, folded, fontId);
+
+        bool newFamily = true;
+        for (std::vector<std::wstring>::iterator itr = m_families.begin(); itr != m_families.end(); ++itr)
+        {
+            if (*itr == folded)
+            {
+                newFamily = false;
+                break;
+            }
+        }
+        if (newFamily)
+            m_families.push_back(folded);
+
+        // fonts changed, measurements made so far are not trusted anymore
+        sTextMetrics->Invalidate();
+
+        // glyph atlas rasterizes its own glyphs in worker threads, it needs to know, what the font looks like
+        sGlyphAtlas->RegisterFont(fontId, family, size, false, false, false, false);
+    }
+
+    if (feature != 0)
+        Insert(key, folded, fontId);
+
+    return fontId;
+}
+
+int32 FontRegistry::GetSimplyFlatFont(int32 fontId)
+{
+    if (fontId < 0 || uint32(fontId) >= m_fonts.size())
+        return -1;
+
+    FontRegistryFont* font = &m_fonts[fontId];
+    if (!font->simplyFlatBuilt)
+    {
+        font->simplyFlatBuilt = true;
+        font->simplyFlatId = sSimplyFlat->BuildFont(ToMultiByteString(font->family.c_str()), font->size);
+
+        if (font->simplyFlatId >= 0)
+            m_simplyFlatCount++;
+        else
+            sLog->ErrorLog("FontRegistry: Could not build font '%S' of size %u", font->family.c_str(), font->size);
+    }
+
+    if (font->simplyFlatId < 0 && fontId != sStorage->GetDefaultFontId())
+        return GetSimplyFlatFont(sStorage->GetDefaultFontId());
+
+    return font->simplyFlatId;
+}
+
+StyledTextList* FontRegistry::GetSimplyFlatList(StyledTextList* list)
+{
+    // entries are resized first, so the pointers to them stay valid
+    m_simplyFlatEntries.resize(list->size());
+    m_simplyFlatList.resize(list->size());
+
+    for (uint32 i = 0; i < list->size(); i++)
+    {
+        m_simplyFlatEntries[i] = *((*list)[i]);
+        m_simplyFlatEntries[i].fontId = GetSimplyFlatFont((*list)[i]->fontId);
+        m_simplyFlatList[i] = &m_simplyFlatEntries[i];
+    }
+
+    return &m_simplyFlatList;
+}
+
+uint32 FontRegistry::FormatReport(char* buffer, uint32 size)
+{
+    int32 len = snprintf(buffer, size, "FONTS families=%u fonts=%u variants=%u simplyFlatFonts=%u atlasFaces=%u atlasPages=%u rasterPending=%u\n",
+                         GetFamilyCount(), GetFontCount(), GetEntryCount(), GetSimplyFlatFontCount(), sGlyphAtlas->GetFaceCount(),
+                         sGlyphAtlas->GetPageCount(), sGlyphAtlas->GetPendingJobCount());
+
+    if (len < 0 || uint32(len) >= size)
+        return (size > 0) ? size - 1 : 0;
+
+    return uint32(len);
+}
@@ -0,0 +1,1377 @@
+#include "Global.h"
+#include "Log.h"
+#include "Storage.h"
+#include "Handlers/GlyphAtlas.h"
+#include "Handlers/LineBreak.h"
+
+#include <cfloat>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#include FT_SYNTHESIS_H
+
+#ifndef _WIN32
+  #include <dirent.h>
+  #include <sys/stat.h>
+  #include <cerrno>
+#endif
+
+GlyphAtlas::GlyphAtlas()
+{
+    m_scale = 0.0f;
+    m_resetPending = false;
+    m_generation = 0;
+    m_runSerial = 0;
+    m_faceSerial = 0;
+    m_fontFilesScanned = false;
+
+    m_layout = NULL;
+    m_penX = 0.0f;
+    m_line = 0;
+    m_lineStart = 0;
+    m_lastBreak = 0;
+    m_prevChar = 0;
+
+    m_busyWorkers = 0;
+    m_stopWorkers = false;
+    m_workersStarted = false;
+    m_rasterGeneration = 0;
+
+    InitRasterizer(&m_rasterizer);
+
+    m_workerCount = 0;
+    m_semaphoreReady = false;
+
+#ifdef _WIN32
+    InitializeCriticalSection(&m_jobLock);
+    m_jobSemaphore = NULL;
+    for (uint32 i = 0; i < GLYPH_RASTER_THREADS; i++)
+        m_workers[i] = NULL;
+#else
+    pthread_mutex_init(&m_jobLock, NULL);
+#endif
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    // workers write to faces, they have to end before the faces are deleted
+    StopWorkers();
+
+    for (std::list<GlyphRasterJob*>::iterator itr = m_queuedJobs.begin(); itr != m_queuedJobs.end(); ++itr)
+        delete (*itr);
+    for (std::list<GlyphRasterJob*>::iterator itr = m_doneJobs.begin(); itr != m_doneJobs.end(); ++itr)
+        delete (*itr);
+
+    // textures are left to the context, it may not exist anymore
+    for (std::map<uint32, GlyphFace*>::iterator itr = m_faces.begin(); itr != m_faces.end(); ++itr)
+        delete itr->second;
+
+    FreeRasterizer(&m_rasterizer);
+
+#ifdef _WIN32
+    DeleteCriticalSection(&m_jobLock);
+#else
+    pthread_mutex_destroy(&m_jobLock);
+#endif
+}
+
+void GlyphAtlas::RegisterFont(int32 fontId, const wchar_t* family, uint32 size, bool bold, bool italic, bool underline, bool strikeout)
+{
+    if (fontId < 0 || !family)
+        return;
+
+    GlyphFontDesc desc;
+    desc.family = family;
+    desc.size = size;
+    desc.features = (bold ? GLYPH_FEATURE_BOLD : 0) | (italic ? GLYPH_FEATURE_ITALIC : 0)
+                  | (underline ? GLYPH_FEATURE_UNDERLINE : 0) | (strikeout ? GLYPH_FEATURE_STRIKEOUT : 0);
+
+    m_fonts[fontId] = desc;
+}
+
+void GlyphAtlas::Prepare()
+{
+    // glyphs are rasterized in screen resolution, so they have to be built again when it changes
+    float scale = float(sStorage->GetScreenHeight()) / float(sStorage->GetOriginalScreenHeight());
+    if (scale != m_scale)
+    {
+        Reset(true);
+        m_scale = scale;
+    }
+    else if (m_resetPending)
+        Reset(false);
+
+    // fonts and glyphs made by worker threads since the last time
+    CollectJobs();
+
+    // runs and layouts only point to glyphs, so they could be dropped any time
+    if (m_runs.size() > GLYPH_RUN_CACHE_MAX)
+        m_runs.clear();
+    if (m_layouts.size() > GLYPH_RUN_CACHE_MAX)
+        m_layouts.clear();
+}
+
+void GlyphAtlas::Reset(bool dropFaces)
+{
+    CancelJobs(dropFaces);
+
+    // quads waiting in batch still use current contents of atlas pages
+    if (!m_pages.empty())
+        sDrawBatch->Flush();
+
+    m_runs.clear();
+    m_layouts.clear();
+
+    for (std::map<uint32, GlyphFace*>::iterator itr = m_faces.begin(); itr != m_faces.end(); ++itr)
+    {
+        if (dropFaces)
+            delete itr->second;
+        else
+            itr->second->glyphs.clear();
+    }
+
+    if (dropFaces)
+        m_faces.clear();
+
+    // textures are kept, the glyphs are uploaded with their padding, so the old contents does not need to be cleared
+    for (uint32 i = 0; i < m_pages.size(); i++)
+    {
+        m_pages[i].cursor[0] = GLYPH_ATLAS_SOLID_SIZE + GLYPH_ATLAS_PADDING;
+        m_pages[i].cursor[1] = 0;
+        m_pages[i].shelfHeight = GLYPH_ATLAS_SOLID_SIZE + GLYPH_ATLAS_PADDING;
+    }
+
+    m_resetPending = false;
+    m_generation++;
+}
+
+GlyphAtlasPage* GlyphAtlas::AddPage()
+{
+    if (m_pages.size() >= GLYPH_ATLAS_MAX_PAGES)
+        return NULL;
+
+    GLuint textureId = 0;
+    glGenTextures(1, &textureId);
+    if (textureId == 0)
+        return NULL;
+
+    // empty page with small opaque block in the corner
+    m_uploadBuffer.assign(GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 0);
+    for (uint32 y = 0; y < GLYPH_ATLAS_SOLID_SIZE; y++)
+        for (uint32 x = 0; x < GLYPH_ATLAS_SOLID_SIZE; x++)
+            m_uploadBuffer[y * GLYPH_ATLAS_SIZE + x] = 255;
+
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, 0, GL_ALPHA, GL_UNSIGNED_BYTE, &m_uploadBuffer[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GlyphAtlasPage page;
+    page.textureId = textureId;
+    page.cursor[0] = GLYPH_ATLAS_SOLID_SIZE + GLYPH_ATLAS_PADDING;
+    page.cursor[1] = 0;
+    page.shelfHeight = GLYPH_ATLAS_SOLID_SIZE + GLYPH_ATLAS_PADDING;
+    m_pages.push_back(page);
+
+    return &m_pages.back();
+}
+
+bool GlyphAtlas::AllocateRect(uint32 width, uint32 height, GlyphAtlasPage* &page, uint32 &x, uint32 &y)
+{
+    if (width > GLYPH_ATLAS_SIZE || height > GLYPH_ATLAS_SIZE)
+        return false;
+
+    // shelf packing - glyphs are put next to each other in rows as high as the highest glyph in them
+    for (uint32 i = 0; i <= m_pages.size(); i++)
+    {
+        if (i == m_pages.size() && !AddPage())
+            return false;
+
+        page = &m_pages[i];
+
+        if (page->cursor[0] + width > GLYPH_ATLAS_SIZE)
+        {
+            page->cursor[0] = 0;
+            page->cursor[1] += page->shelfHeight;
+            page->shelfHeight = 0;
+        }
+
+        if (page->cursor[1] + height > GLYPH_ATLAS_SIZE)
+            continue;
+
+        x = page->cursor[0];
+        y = page->cursor[1];
+
+        page->cursor[0] += width;
+        if (height > page->shelfHeight)
+            page->shelfHeight = height;
+
+        return true;
+    }
+
+    return false;
+}
+
+GlyphFace* GlyphAtlas::GetFace(int32 fontId, uint8 feature)
+{
+    uint32 key = (uint32(fontId) << 8) | feature;
+
+    std::map<uint32, GlyphFace*>::iterator itr = m_faces.find(key);
+    if (itr != m_faces.end())
+        return (itr->second->state != GLYPH_FACE_INVALID) ? itr->second : NULL;
+
+    std::map<int32, GlyphFontDesc>::iterator desc = m_fonts.find(fontId);
+    if (desc == m_fonts.end())
+        return NULL;
+
+    GlyphFace* face = new GlyphFace;
+    face->state = GLYPH_FACE_QUEUED;
+    face->synchronous = (fontId == sStorage->GetDefaultFontId());
+    face->features = desc->second.features | feature;
+    face->ascent = 0.0f;
+    face->lineHeight = 0.0f;
+    face->lineThickness = 0.0f;
+    face->serial = ++m_faceSerial;
+    face->pixelSize = uint32(float(desc->second.size) * m_scale + 0.5f);
+
+    m_faces[key] = face;
+
+    if (!FindFontFile(face, desc->second.family))
+    {
+        sLog->ErrorLog("GlyphAtlas: Could not find font file of %S", desc->second.family.c_str());
+        face->state = GLYPH_FACE_INVALID;
+        return NULL;
+    }
+
+    // default font is the fallback for all the others, so it has to be ready right away
+    if (face->synchronous)
+    {
+        if (!CreateFace(&m_rasterizer, face, m_scale))
+        {
+            sLog->ErrorLog("GlyphAtlas: Could not create font %S", desc->second.family.c_str());
+            face->state = GLYPH_FACE_INVALID;
+            return NULL;
+        }
+
+        face->state = GLYPH_FACE_READY;
+        return face;
+    }
+
+    GlyphRasterJob* job = new GlyphRasterJob;
+    job->face = face;
+    job->character = 0;
+    job->family = desc->second.family;
+    job->scale = m_scale;
+    job->success = false;
+    QueueJob(job);
+
+    return face;
+}
+
+void GlyphAtlas::InitRasterizer(GlyphRasterizer* rasterizer)
+{
+    if (FT_Init_FreeType(&rasterizer->library) != 0)
+        rasterizer->library = NULL;
+}
+
+void GlyphAtlas::FreeRasterizer(GlyphRasterizer* rasterizer)
+{
+    for (std::map<uint32, FT_Face>::iterator itr = rasterizer->faces.begin(); itr != rasterizer->faces.end(); ++itr)
+        FT_Done_Face(itr->second);
+    rasterizer->faces.clear();
+
+    if (rasterizer->library)
+        FT_Done_FreeType(rasterizer->library);
+    rasterizer->library = NULL;
+}
+
+// style is given by the last words of font name, they are removed from it
+static uint8 SplitFontStyle(std::wstring &name)
+{
+    static const wchar_t* suffixes[] = {L" BOLD ITALIC", L" BOLD OBLIQUE", L" BOLD", L" ITALIC", L" OBLIQUE", L" REGULAR"};
+    static const uint8 features[] = {GLYPH_FEATURE_BOLD | GLYPH_FEATURE_ITALIC, GLYPH_FEATURE_BOLD | GLYPH_FEATURE_ITALIC,
+                                     GLYPH_FEATURE_BOLD, GLYPH_FEATURE_ITALIC, GLYPH_FEATURE_ITALIC, 0};
+
+    for (uint32 i = 0; i < sizeof(features) / sizeof(uint8); i++)
+    {
+        uint32 length = wcslen(suffixes[i]);
+        if (name.size() > length && name.compare(name.size() - length, length, suffixes[i]) == 0)
+        {
+            name.erase(name.size() - length);
+            return features[i];
+        }
+    }
+
+    return 0;
+}
+
+void GlyphAtlas::AddFontFile(const std::wstring &family, uint8 features, const std::string &path, int32 index)
+{
+    GlyphFontFile file;
+    file.family = family;
+    for (uint32 i = 0; i < file.family.size(); i++)
+        file.family[i] = UpperChar(file.family[i]);
+    file.features = features;
+    file.path = path;
+    file.index = index;
+
+    m_fontFiles.push_back(file);
+}
+
+void GlyphAtlas::ScanFontFiles()
+{
+    m_fontFilesScanned = true;
+
+#ifdef _WIN32
+    // installed fonts are listed in registry by name with style and type, i.e. "Arial Bold Italic (TrueType)" = "arialbi.ttf"
+    char windowsDir[MAX_PATH];
+    UINT dirLength = GetWindowsDirectoryA(windowsDir, MAX_PATH);
+    std::string fontDir = std::string(windowsDir, (dirLength < MAX_PATH) ? dirLength : 0) + "\\Fonts\\";
+
+    // fonts installed only for current user have full path
+    HKEY roots[2] = {HKEY_LOCAL_MACHINE, HKEY_CURRENT_USER};
+    for (uint32 r = 0; r < 2; r++)
+    {
+        HKEY key;
+        if (RegOpenKeyExW(roots[r], L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\Fonts", 0, KEY_READ, &key) != ERROR_SUCCESS)
+            continue;
+
+        wchar_t name[256];
+        wchar_t file[MAX_PATH];
+        for (DWORD i = 0; ; i++)
+        {
+            DWORD nameLength = 256;
+            DWORD fileSize = sizeof(file) - sizeof(wchar_t);
+            DWORD type;
+
+            LONG result = RegEnumValueW(key, i, name, &nameLength, NULL, &type, (LPBYTE)file, &fileSize);
+            if (result == ERROR_NO_MORE_ITEMS)
+                break;
+            if (result != ERROR_SUCCESS || type != REG_SZ)
+                continue;
+
+            file[fileSize / sizeof(wchar_t)] = L'\0';
+
+            char path[MAX_PATH];
+            if (WideCharToMultiByte(CP_ACP, 0, file, -1, path, MAX_PATH, NULL, NULL) == 0)
+                continue;
+
+            std::wstring entry(name, nameLength);
+            for (uint32 j = 0; j < entry.size(); j++)
+                entry[j] = UpperChar(entry[j]);
+
+            // type in parentheses is not part of name
+            std::wstring::size_type typePos = entry.rfind(L" (");
+            if (typePos != std::wstring::npos)
+                entry.erase(typePos);
+
+            std::string fullPath = (strchr(path, '\\') || strchr(path, ':')) ? std::string(path) : fontDir + path;
+
+            // collections have names of all their faces joined by ampersand
+            int32 index = 0;
+            std::wstring::size_type start = 0;
+            while (start <= entry.size())
+            {
+                std::wstring::size_type end = entry.find(L" & ", start);
+                if (end == std::wstring::npos)
+                    end = entry.size();
+
+                std::wstring family = entry.substr(start, end - start);
+                uint8 features = SplitFontStyle(family);
+                AddFontFile(family, features, fullPath, index++);
+
+                start = end + 3;
+            }
+        }
+
+        RegCloseKey(key);
+    }
+#else
+    if (!m_rasterizer.library)
+        return;
+
+    std::vector<std::string> dirs;
+    dirs.push_back("/usr/share/fonts");
+    dirs.push_back("/usr/local/share/fonts");
+
+    const char* home = getenv("HOME");
+    if (home)
+    {
+        dirs.push_back(std::string(home) + "/.fonts");
+        dirs.push_back(std::string(home) + "/.local/share/fonts");
+    }
+
+    // subdirectories are appended to the list, so the whole tree is walked
+    for (uint32 i = 0; i < dirs.size(); i++)
+    {
+        DIR* dir = opendir(dirs[i].c_str());
+        if (!dir)
+            continue;
+
+        while (dirent* entry = readdir(dir))
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            std::string path = dirs[i] + "/" + entry->d_name;
+
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0)
+                continue;
+
+            if (S_ISDIR(info.st_mode))
+            {
+                dirs.push_back(path);
+                continue;
+            }
+
+            std::string extension = (path.size() > 4) ? path.substr(path.size() - 4) : "";
+            for (uint32 j = 0; j < extension.size(); j++)
+                extension[j] = tolower(extension[j]);
+
+            if (extension != ".ttf" && extension != ".otf" && extension != ".ttc")
+                continue;
+
+            // every face of collection has its own family and style
+            int32 count = 1;
+            for (int32 index = 0; index < count; index++)
+            {
+                FT_Face ftFace;
+                if (FT_New_Face(m_rasterizer.library, path.c_str(), index, &ftFace) != 0)
+                    break;
+
+                count = ftFace->num_faces;
+
+                if (ftFace->family_name)
+                {
+                    std::wstring family;
+                    for (const char* c = ftFace->family_name; *c; c++)
+                        family += wchar_t((unsigned char)(*c));
+
+                    uint8 features = ((ftFace->style_flags & FT_STYLE_FLAG_BOLD) ? GLYPH_FEATURE_BOLD : 0)
+                                   | ((ftFace->style_flags & FT_STYLE_FLAG_ITALIC) ? GLYPH_FEATURE_ITALIC : 0);
+
+                    AddFontFile(family, features, path, index);
+                }
+
+                FT_Done_Face(ftFace);
+            }
+        }
+
+        closedir(dir);
+    }
+#endif
+
+    if (m_fontFiles.empty())
+        sLog->ErrorLog("GlyphAtlas: No font files found, the text is left to SimplyFlat");
+}
+
+bool GlyphAtlas::FindFontFile(GlyphFace* face, const std::wstring &family)
+{
+    if (!m_fontFilesScanned)
+        ScanFontFiles();
+
+    std::wstring folded(family);
+    for (uint32 i = 0; i < folded.size(); i++)
+        folded[i] = UpperChar(folded[i]);
+
+    uint8 wanted = face->features & (GLYPH_FEATURE_BOLD | GLYPH_FEATURE_ITALIC);
+
+    // the style with most of wanted features and nothing else, the rest is made by synthesis
+    // style with unwanted features is taken only when there's nothing else in the family
+    GlyphFontFile* best = NULL;
+    int32 bestScore = -1;
+    for (std::vector<GlyphFontFile>::iterator itr = m_fontFiles.begin(); itr != m_fontFiles.end(); ++itr)
+    {
+        if (itr->family != folded)
+            continue;
+
+        int32 score = 0;
+        if ((itr->features & ~wanted) == 0)
+            score = 1 + ((itr->features & GLYPH_FEATURE_BOLD) ? 1 : 0) + ((itr->features & GLYPH_FEATURE_ITALIC) ? 1 : 0);
+
+        if (score > bestScore)
+        {
+            best = &(*itr);
+            bestScore = score;
+        }
+    }
+
+    if (!best)
+        return false;
+
+    face->path = best->path;
+    face->index = best->index;
+    face->synthetic = wanted & ~best->features;
+
+    return true;
+}
+
+FT_Face GlyphAtlas::OpenFace(GlyphRasterizer* rasterizer, GlyphFace* face)
+{
+    if (!rasterizer->library)
+        return NULL;
+
+    std::map<uint32, FT_Face>::iterator itr = rasterizer->faces.find(face->serial);
+    if (itr != rasterizer->faces.end())
+        return itr->second;
+
+    // rasterizer does not know, which faces were dropped, so all of them are closed once in a while
+    if (rasterizer->faces.size() >= GLYPH_RASTER_FACE_CACHE)
+    {
+        for (itr = rasterizer->faces.begin(); itr != rasterizer->faces.end(); ++itr)
+            FT_Done_Face(itr->second);
+        rasterizer->faces.clear();
+    }
+
+    FT_Face ftFace;
+    if (FT_New_Face(rasterizer->library, face->path.c_str(), face->index, &ftFace) != 0)
+        return NULL;
+
+    // em square of given pixel height, as the font size means
+    if (FT_Set_Pixel_Sizes(ftFace, 0, face->pixelSize) != 0)
+    {
+        FT_Done_Face(ftFace);
+        return NULL;
+    }
+
+    rasterizer->faces[face->serial] = ftFace;
+    return ftFace;
+}
+
+bool GlyphAtlas::CreateFace(GlyphRasterizer* rasterizer, GlyphFace* face, float scale)
+{
+    FT_Face ftFace = OpenFace(rasterizer, face);
+    if (!ftFace)
+        return false;
+
+    // size metrics are in 26.6 fixed point pixels
+    face->ascent = float(ftFace->size->metrics.ascender) / 64.0f / scale;
+    face->lineHeight = float(ftFace->size->metrics.height) / 64.0f / scale;
+    face->lineThickness = float((face->pixelSize >= 32) ? face->pixelSize / 16 : 1) / scale;
+
+    if (!FT_HAS_KERNING(ftFace))
+        return true;
+
+    // kerning pairs could not be listed, so they are looked up for latin characters including the czech ones
+    std::vector<wchar_t> chars;
+    std::vector<FT_UInt> indices;
+    for (uint32 c = 0x20; c <= 0x17F; c++)
+    {
+        if (c > 0x7E && c < 0xA0)
+            continue;
+
+        FT_UInt index = FT_Get_Char_Index(ftFace, c);
+        if (index == 0)
+            continue;
+
+        chars.push_back(wchar_t(c));
+        indices.push_back(index);
+    }
+
+    FT_Vector delta;
+    for (uint32 i = 0; i < indices.size(); i++)
+    {
+        for (uint32 j = 0; j < indices.size(); j++)
+        {
+            if (FT_Get_Kerning(ftFace, indices[i], indices[j], FT_KERNING_DEFAULT, &delta) == 0 && delta.x != 0)
+                face->kerning[(uint32(chars[i]) << 16) | uint32(chars[j])] = float(delta.x) / 64.0f / scale;
+        }
+    }
+
+    return true;
+}
+
+GlyphInfo* GlyphAtlas::GetGlyph(GlyphFace* face, wchar_t character)
+{
+    std::map<wchar_t, GlyphInfo>::iterator itr = face->glyphs.find(character);
+    if (itr != face->glyphs.end())
+        return &itr->second;
+
+    // glyph, which failed to rasterize, stays empty, so we won't try it again
+    GlyphInfo* glyph = &face->glyphs[character];
+    memset(glyph, 0, sizeof(GlyphInfo));
+
+    if (face->synchronous)
+    {
+        if (RasterizeGlyph(&m_rasterizer, face, character, &m_bitmap))
+            UploadGlyph(&m_bitmap, glyph);
+
+        return glyph;
+    }
+
+    glyph->pending = true;
+
+    GlyphRasterJob* job = new GlyphRasterJob;
+    job->face = face;
+    job->character = character;
+    job->scale = m_scale;
+    job->success = false;
+    QueueJob(job);
+
+    return glyph;
+}
+
+bool GlyphAtlas::RasterizeGlyph(GlyphRasterizer* rasterizer, GlyphFace* face, wchar_t character, GlyphBitmap* bitmap)
+{
+    FT_Face ftFace = OpenFace(rasterizer, face);
+    if (!ftFace)
+        return false;
+
+    // synthetic styles need outline, embedded bitmaps could not be slanted
+    if (FT_Load_Char(ftFace, FT_ULong(character), face->synthetic ? FT_LOAD_NO_BITMAP : FT_LOAD_DEFAULT) != 0)
+        return false;
+
+    FT_GlyphSlot slot = ftFace->glyph;
+    if (face->synthetic & GLYPH_FEATURE_ITALIC)
+        FT_GlyphSlot_Oblique(slot);
+    if (face->synthetic & GLYPH_FEATURE_BOLD)
+        FT_GlyphSlot_Embolden(slot);
+
+    if (slot->format != FT_GLYPH_FORMAT_BITMAP && FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) != 0)
+        return false;
+
+    bitmap->advance = int32((slot->advance.x + 32) >> 6);
+    bitmap->origin[0] = slot->bitmap_left;
+    bitmap->origin[1] = slot->bitmap_top;
+    bitmap->width = 0;
+    bitmap->height = 0;
+    bitmap->pixels.clear();
+
+    // whitespace has only advance
+    if (slot->bitmap.width == 0 || slot->bitmap.rows == 0)
+        return true;
+
+    FT_Bitmap* source = &slot->bitmap;
+    if (source->pixel_mode != FT_PIXEL_MODE_GRAY && source->pixel_mode != FT_PIXEL_MODE_MONO)
+        return false;
+
+    uint32 width = source->width;
+    uint32 height = source->rows;
+    uint32 paddedWidth = width + 2 * GLYPH_ATLAS_PADDING;
+    uint32 paddedHeight = height + 2 * GLYPH_ATLAS_PADDING;
+    uint32 maxLevel = (source->num_grays > 1) ? source->num_grays - 1 : 255;
+
+    // rendered glyph has gray levels or bits in rows of pitch bytes, we need alpha with padding around
+    bitmap->pixels.assign(paddedWidth * paddedHeight, 0);
+    for (uint32 row = 0; row < height; row++)
+    {
+        const uint8* line = source->buffer + int32(row) * source->pitch;
+        uint8* target = &bitmap->pixels[(row + GLYPH_ATLAS_PADDING) * paddedWidth + GLYPH_ATLAS_PADDING];
+
+        for (uint32 col = 0; col < width; col++)
+        {
+            if (source->pixel_mode == FT_PIXEL_MODE_MONO)
+                target[col] = ((line[col >> 3] >> (7 - (col & 7))) & 1) ? 255 : 0;
+            else
+                target[col] = uint8(uint32(line[col]) * 255 / maxLevel);
+        }
+    }
+
+    bitmap->width = width;
+    bitmap->height = height;
+
+    return true;
+}
+
+bool GlyphAtlas::UploadGlyph(GlyphBitmap* bitmap, GlyphInfo* glyph)
+{
+    glyph->advance = float(bitmap->advance) / m_scale;
+
+    // whitespace has only advance
+    if (bitmap->pixels.empty())
+        return true;
+
+    uint32 paddedWidth = bitmap->width + 2 * GLYPH_ATLAS_PADDING;
+    uint32 paddedHeight = bitmap->height + 2 * GLYPH_ATLAS_PADDING;
+
+    // no reset would make room for it, the text using it goes to SimplyFlat instead
+    if (paddedWidth > GLYPH_ATLAS_SIZE || paddedHeight > GLYPH_ATLAS_SIZE)
+    {
+        glyph->oversized = true;
+        return false;
+    }
+
+    GlyphAtlasPage* page = NULL;
+    uint32 x, y;
+    if (!AllocateRect(paddedWidth, paddedHeight, page, x, y))
+    {
+        // all pages are full, glyph won't be visible until the atlas starts again
+        m_resetPending = true;
+        return true;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, page->textureId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, paddedWidth, paddedHeight, GL_ALPHA, GL_UNSIGNED_BYTE, &bitmap->pixels[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glyph->textureId = page->textureId;
+    glyph->texCoord[0] = float(x + GLYPH_ATLAS_PADDING) / float(GLYPH_ATLAS_SIZE);
+    glyph->texCoord[1] = float(y + GLYPH_ATLAS_PADDING) / float(GLYPH_ATLAS_SIZE);
+    glyph->texCoord[2] = float(x + GLYPH_ATLAS_PADDING + bitmap->width) / float(GLYPH_ATLAS_SIZE);
+    glyph->texCoord[3] = float(y + GLYPH_ATLAS_PADDING + bitmap->height) / float(GLYPH_ATLAS_SIZE);
+
+    // origin of glyph is its left upper corner relative to pen position, with y going up
+    glyph->offset[0] = float(bitmap->origin[0]) / m_scale;
+    glyph->offset[1] = -float(bitmap->origin[1]) / m_scale;
+    glyph->size[0] = float(bitmap->width) / m_scale;
+    glyph->size[1] = float(bitmap->height) / m_scale;
+
+    return true;
+}
+
+void GlyphAtlas::Lock()
+{
+#ifdef _WIN32
+    EnterCriticalSection(&m_jobLock);
+#else
+    pthread_mutex_lock(&m_jobLock);
+#endif
+}
+
+void GlyphAtlas::Unlock()
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&m_jobLock);
+#else
+    pthread_mutex_unlock(&m_jobLock);
+#endif
+}
+
+void GlyphAtlas::SignalJobs(uint32 count)
+{
+#ifdef _WIN32
+    ReleaseSemaphore(m_jobSemaphore, count, NULL);
+#else
+    for (uint32 i = 0; i < count; i++)
+        sem_post(&m_jobSemaphore);
+#endif
+}
+
+void GlyphAtlas::WaitForJob()
+{
+#ifdef _WIN32
+    WaitForSingleObject(m_jobSemaphore, INFINITE);
+#else
+    // interrupted wait is not a job
+    while (sem_wait(&m_jobSemaphore) != 0 && errno == EINTR)
+        ;
+#endif
+}
+
+void GlyphAtlas::StartWorkers()
+{
+    m_workersStarted = true;
+
+#ifdef _WIN32
+    m_jobSemaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    m_semaphoreReady = (m_jobSemaphore != NULL);
+#else
+    m_semaphoreReady = (sem_init(&m_jobSemaphore, 0, 0) == 0);
+#endif
+
+    if (!m_semaphoreReady)
+    {
+        sLog->ErrorLog("GlyphAtlas: Could not create job semaphore, glyphs will be rasterized in main thread");
+        return;
+    }
+
+    for (uint32 i = 0; i < GLYPH_RASTER_THREADS; i++)
+    {
+#ifdef _WIN32
+        m_workers[m_workerCount] = CreateThread(NULL, 0, &GlyphAtlas::WorkerThread, this, 0, NULL);
+        bool started = (m_workers[m_workerCount] != NULL);
+#else
+        bool started = (pthread_create(&m_workers[m_workerCount], NULL, &GlyphAtlas::WorkerThread, this) == 0);
+#endif
+        if (started)
+            m_workerCount++;
+        else
+            sLog->ErrorLog("GlyphAtlas: Could not start rasterizing thread");
+    }
+}
+
+void GlyphAtlas::StopWorkers()
+{
+    if (!m_semaphoreReady)
+        return;
+
+    Lock();
+    m_stopWorkers = true;
+    Unlock();
+
+    SignalJobs(m_workerCount);
+
+    for (uint32 i = 0; i < m_workerCount; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(m_workers[i], INFINITE);
+        CloseHandle(m_workers[i]);
+        m_workers[i] = NULL;
+#else
+        pthread_join(m_workers[i], NULL);
+#endif
+    }
+    m_workerCount = 0;
+
+#ifdef _WIN32
+    CloseHandle(m_jobSemaphore);
+    m_jobSemaphore = NULL;
+#else
+    sem_destroy(&m_jobSemaphore);
+#endif
+    m_semaphoreReady = false;
+}
+
+#ifdef _WIN32
+DWORD WINAPI GlyphAtlas::WorkerThread(LPVOID param)
+{
+    ((GlyphAtlas*)param)->RunWorker();
+    return 0;
+}
+#else
+void* GlyphAtlas::WorkerThread(void* param)
+{
+    ((GlyphAtlas*)param)->RunWorker();
+    return NULL;
+}
+#endif
+
+void GlyphAtlas::RunWorker()
+{
+    GlyphRasterizer rasterizer;
+    InitRasterizer(&rasterizer);
+
+    while (true)
+    {
+        WaitForJob();
+
+        Lock();
+        if (m_stopWorkers)
+        {
+            Unlock();
+            break;
+        }
+
+        // cancelled jobs leave the semaphore raised
+        if (m_queuedJobs.empty())
+        {
+            Unlock();
+            continue;
+        }
+
+        GlyphRasterJob* job = m_queuedJobs.front();
+        m_queuedJobs.pop_front();
+        m_busyWorkers++;
+        Unlock();
+
+        if (job->character == 0)
+            job->success = CreateFace(&rasterizer, job->face, job->scale);
+        else
+            job->success = RasterizeGlyph(&rasterizer, job->face, job->character, &job->bitmap);
+
+        Lock();
+        m_doneJobs.push_back(job);
+        m_busyWorkers--;
+        Unlock();
+    }
+
+    FreeRasterizer(&rasterizer);
+}
+
+void GlyphAtlas::QueueJob(GlyphRasterJob* job)
+{
+    if (!m_workersStarted)
+        StartWorkers();
+
+    if (m_workerCount > 0)
+    {
+        Lock();
+        m_queuedJobs.push_back(job);
+        Unlock();
+
+        SignalJobs(1);
+        return;
+    }
+
+    // without worker threads the job is done right away, and collected with the others
+    if (job->character == 0)
+        job->success = CreateFace(&m_rasterizer, job->face, job->scale);
+    else
+        job->success = RasterizeGlyph(&m_rasterizer, job->face, job->character, &job->bitmap);
+
+    Lock();
+    m_doneJobs.push_back(job);
+    Unlock();
+}
+
+void GlyphAtlas::CollectJobs()
+{
+    std::list<GlyphRasterJob*> done;
+
+    Lock();
+    done.swap(m_doneJobs);
+    Unlock();
+
+    if (done.empty())
+        return;
+
+    for (std::list<GlyphRasterJob*>::iterator itr = done.begin(); itr != done.end(); ++itr)
+    {
+        GlyphRasterJob* job = (*itr);
+
+        if (job->character == 0)
+        {
+            job->face->state = job->success ? GLYPH_FACE_READY : GLYPH_FACE_INVALID;
+            if (!job->success)
+                sLog->ErrorLog("GlyphAtlas: Could not create font %S", job->family.c_str());
+        }
+        else
+        {
+            // glyph, which failed to rasterize, stays empty
+            GlyphInfo* glyph = &job->face->glyphs[job->character];
+            if (job->success)
+                UploadGlyph(&job->bitmap, glyph);
+            glyph->pending = false;
+        }
+
+        delete job;
+    }
+
+    // provisional runs will be shaped again
+    m_rasterGeneration++;
+}
+
+static void DropJobs(std::list<GlyphRasterJob*> &jobs, bool dropFaces)
+{
+    for (std::list<GlyphRasterJob*>::iterator itr = jobs.begin(); itr != jobs.end(); )
+    {
+        if (dropFaces || (*itr)->character != 0)
+        {
+            delete (*itr);
+            itr = jobs.erase(itr);
+        }
+        else
+            ++itr;
+    }
+}
+
+void GlyphAtlas::CancelJobs(bool dropFaces)
+{
+    // glyphs are useless after reset, created fonts too when their faces are dropped
+    Lock();
+    DropJobs(m_queuedJobs, dropFaces);
+    Unlock();
+
+    // jobs in progress write to their faces, we have to wait for them
+    while (true)
+    {
+        Lock();
+        uint32 busy = m_busyWorkers;
+        Unlock();
+
+        if (busy == 0)
+            break;
+
+#ifdef _WIN32
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+    }
+
+    Lock();
+    DropJobs(m_doneJobs, dropFaces);
+    Unlock();
+}
+
+uint32 GlyphAtlas::GetPendingJobCount()
+{
+    Lock();
+    uint32 count = m_queuedJobs.size() + m_busyWorkers;
+    Unlock();
+
+    return count;
+}
+
+bool GlyphAtlas::ShapeRun(ShapedRun* run, GlyphFace* face, const wchar_t* text, uint32 length)
+{
+    run->face = face;
+    run->glyphs.resize(length);
+    run->oversized = false;
+
+    // all missing glyphs are requested at once, so they are rasterized in parallel
+    bool complete = true;
+    float pen = 0.0f;
+    for (uint32 i = 0; i < length; i++)
+    {
+        ShapedGlyph* shaped = &run->glyphs[i];
+
+        if (i > 0 && !face->kerning.empty())
+        {
+            std::map<uint32, float>::iterator kern = face->kerning.find((uint32(text[i-1]) << 16) | uint32(text[i]));
+            if (kern != face->kerning.end())
+                pen += kern->second;
+        }
+
+        shaped->character = text[i];
+        shaped->glyph = GetGlyph(face, text[i]);
+        shaped->x = pen;
+
+        if (shaped->glyph->pending)
+            complete = false;
+        if (shaped->glyph->oversized)
+            run->oversized = true;
+
+        pen += shaped->glyph->advance;
+    }
+    run->width = pen;
+
+    return complete;
+}
+
+ShapedRun* GlyphAtlas::GetShapedRun(int32 fontId, uint8 feature, const wchar_t* text)
+{
+    GlyphFace* face = GetFace(fontId, feature);
+    if (!face)
+        return NULL;
+
+    // the text itself is compared only when the key matches
+    uint32 length = wcslen(text);
+    TextRunKey key(fontId, feature, text, length);
+
+    std::map<TextRunKey, ShapedRun>::iterator itr = m_runs.find(key);
+    if (itr != m_runs.end() && itr->second.text.compare(text) == 0)
+    {
+        // provisional run stays until some of the glyphs it waits for could have arrived
+        if (!itr->second.provisional || itr->second.generation == m_rasterGeneration)
+            return itr->second.oversized ? NULL : &itr->second;
+    }
+
+    // not cached yet (or colliding with other text, which is then replaced)
+    ShapedRun* run = &m_runs[key];
+    run->text = text;
+    run->serial = ++m_runSerial;
+    run->provisional = false;
+
+    // runs with oversized glyphs stay cached, so they are not shaped again every frame
+    if (face->state == GLYPH_FACE_READY && ShapeRun(run, face, text, length))
+        return run->oversized ? NULL : run;
+
+    // until the font and all the glyphs are ready, the text is drawn with default font
+    GlyphFace* fallback = GetFace(sStorage->GetDefaultFontId(), feature);
+    if (!fallback || !fallback->synchronous)
+    {
+        m_runs.erase(key);
+        return NULL;
+    }
+
+    ShapeRun(run, fallback, text, length);
+    run->provisional = true;
+    run->generation = m_rasterGeneration;
+
+    return run->oversized ? NULL : run;
+}
+
+float GlyphAtlas::GetWrapLimit(float x, int32 wrap)
+{
+    if (wrap == WW_NO_WRAP)
+        return 0.0f;
+
+    float canvasWidth = float(sStorage->GetScreenWidth()) / m_scale;
+
+    // wrap at the edge of canvas, or keep right margin of given size, or wrap at given width
+    if (wrap == WW_WRAP_CANVAS)
+        return canvasWidth - x;
+    else if (wrap < 0)
+        return canvasWidth - x + float(wrap);
+
+    return float(wrap);
+}
+
+TextLayout* GlyphAtlas::GetLayout(const void* source, float limit)
+{
+    TextLayout* layout = &m_layouts[source];
+
+    bool valid = (layout->runSerials.size() == m_styledRuns.size());
+    for (uint32 i = 0; valid && i < m_styledRuns.size(); i++)
+        valid = (layout->runSerials[i] == m_styledRuns[i]->serial);
+
+    // wrapped text moving over canvas changes its limit all the time, but it does not matter until some line breaks elsewhere
+    if (valid && limit != layout->limit)
+        valid = (limit > 0.0f && layout->limit > 0.0f && limit >= layout->minLimit && limit < layout->maxLimit);
+
+    if (valid)
+        return layout;
+
+    BeginLayout(layout, limit);
+    for (uint32 i = 0; i < m_styledRuns.size(); i++)
+        LayoutRun(m_styledRuns[i], i);
+    EndLayout();
+
+    return layout;
+}
+
+void GlyphAtlas::BeginLayout(TextLayout* layout, float limit)
+{
+    m_layout = layout;
+
+    layout->runSerials.clear();
+    layout->glyphs.clear();
+    layout->lineAscent.clear();
+    layout->lineHeight.clear();
+    layout->limit = limit;
+    layout->minLimit = 0.0f;
+    layout->maxLimit = FLT_MAX;
+
+    m_penX = 0.0f;
+    m_line = 0;
+    m_lineStart = 0;
+    m_lastBreak = 0;
+    m_prevChar = 0;
+}
+
+void GlyphAtlas::PushLine(GlyphFace* face)
+{
+    m_layout->lineAscent.push_back(face->ascent);
+    m_layout->lineHeight.push_back(face->lineHeight);
+}
+
+void GlyphAtlas::BreakLine(float trigger)
+{
+    std::vector<LaidGlyph> &glyphs = m_layout->glyphs;
+
+    // with limit at least as wide as the position of glyph, which did not fit, the line would continue
+    if (trigger < m_layout->maxLimit)
+        m_layout->maxLimit = trigger;
+
+    // everything after the last break opportunity goes to the next line
+    float shift = (m_lastBreak < glyphs.size()) ? glyphs[m_lastBreak].x : m_penX;
+
+    m_line++;
+    PushLine(glyphs[m_lastBreak-1].face);
+
+    for (uint32 i = m_lastBreak; i < glyphs.size(); i++)
+    {
+        glyphs[i].x -= shift;
+        glyphs[i].line = m_line;
+
+        if (glyphs[i].face->ascent > m_layout->lineAscent[m_line])
+            m_layout->lineAscent[m_line] = glyphs[i].face->ascent;
+        if (glyphs[i].face->lineHeight > m_layout->lineHeight[m_line])
+            m_layout->lineHeight[m_line] = glyphs[i].face->lineHeight;
+    }
+
+    m_penX -= shift;
+    m_lineStart = m_lastBreak;
+}
+
+void GlyphAtlas::LayoutRun(ShapedRun* run, uint32 index)
+{
+    GlyphFace* face = run->face;
+    std::vector<LaidGlyph> &glyphs = m_layout->glyphs;
+
+    m_layout->runSerials.push_back(run->serial);
+
+    if (m_layout->lineAscent.empty())
+        PushLine(face);
+
+    uint32 count = run->glyphs.size();
+    for (uint32 i = 0; i < count; i++)
+    {
+        ShapedGlyph* shaped = &run->glyphs[i];
+        float advance = ((i + 1 < count) ? run->glyphs[i+1].x : run->width) - shaped->x;
+
+        if (shaped->character == L'\n')
+        {
+            m_line++;
+            PushLine(face);
+            m_penX = 0.0f;
+            m_lineStart = glyphs.size();
+            m_lastBreak = m_lineStart;
+            m_prevChar = 0;
+            continue;
+        }
+
+        // break opportunities are found between characters, so they work across runs too
+        if (m_prevChar && IsLineBreakOpportunity(m_prevChar, shaped->character))
+            m_lastBreak = glyphs.size();
+        m_prevChar = shaped->character;
+
+        bool space = (GetLineBreakClass(shaped->character) == LBC_SP);
+        if (!space && m_layout->limit > 0.0f && m_penX + advance > m_layout->limit && m_lastBreak > m_lineStart)
+            BreakLine(m_penX + advance);
+
+        LaidGlyph laid;
+        laid.glyph = shaped->glyph;
+        laid.face = face;
+        laid.x = m_penX;
+        laid.advance = advance;
+        laid.line = m_line;
+        laid.run = index;
+        laid.space = space;
+        glyphs.push_back(laid);
+
+        if (face->ascent > m_layout->lineAscent[m_line])
+            m_layout->lineAscent[m_line] = face->ascent;
+        if (face->lineHeight > m_layout->lineHeight[m_line])
+            m_layout->lineHeight[m_line] = face->lineHeight;
+
+        m_penX += advance;
+    }
+}
+
+void GlyphAtlas::EndLayout()
+{
+    // any narrower limit would break some line, which fits now
+    for (std::vector<LaidGlyph>::iterator itr = m_layout->glyphs.begin(); itr != m_layout->glyphs.end(); ++itr)
+    {
+        if (!itr->space && itr->x + itr->advance > m_layout->minLimit)
+            m_layout->minLimit = itr->x + itr->advance;
+    }
+
+    m_layout = NULL;
+}
+
+void GlyphAtlas::SubmitLayout(TextLayout* layout, float x, float y, BatchTransform* transform)
+{
+    if (layout->glyphs.empty())
+        return;
+
+    if (m_pages.empty() && !AddPage())
+        return;
+
+    // underline and strikeout use opaque block of the first page, so they share state with most of glyphs
+    uint32 solidTexture = m_pages[0].textureId;
+    float solidCoord = float(GLYPH_ATLAS_SOLID_SIZE) * 0.5f / float(GLYPH_ATLAS_SIZE);
+
+    uint32 line = 0;
+    float top = 0.0f;
+    float baseline = layout->lineAscent[0];
+
+    for (uint32 i = 0; i < layout->glyphs.size(); i++)
+    {
+        LaidGlyph* laid = &layout->glyphs[i];
+        GlyphInfo* glyph = laid->glyph;
+        uint32 color = m_runColors[laid->run];
+
+        while (line < laid->line)
+        {
+            top += layout->lineHeight[line];
+            line++;
+            baseline = top + layout->lineAscent[line];
+        }
+
+        float penX = Snap(x + laid->x);
+        float penY = Snap(y + baseline);
+
+        if (glyph->textureId)
+            sDrawBatch->AddTexturedQuad(penX + glyph->offset[0], penY + glyph->offset[1], glyph->size[0], glyph->size[1], color, glyph->textureId,
+                                        glyph->texCoord[0], glyph->texCoord[1], glyph->texCoord[2], glyph->texCoord[3], BATCH_BLEND_ALPHA, transform);
+
+        float thickness = laid->face->lineThickness;
+        if (laid->face->features & GLYPH_FEATURE_UNDERLINE)
+            sDrawBatch->AddTexturedQuad(penX, penY + thickness, laid->advance, thickness, color, solidTexture,
+                                        solidCoord, solidCoord, solidCoord, solidCoord, BATCH_BLEND_ALPHA, transform);
+        if (laid->face->features & GLYPH_FEATURE_STRIKEOUT)
+            sDrawBatch->AddTexturedQuad(penX, Snap(penY - laid->face->ascent * 0.3f), laid->advance, thickness, color, solidTexture,
+                                        solidCoord, solidCoord, solidCoord, solidCoord, BATCH_BLEND_ALPHA, transform);
+    }
+}
+
+bool GlyphAtlas::MeasureText(int32 fontId, uint8 feature, const wchar_t* text, float &width, float &height, bool &provisional)
+{
+    if (!text)
+        return false;
+
+    Prepare();
+
+    ShapedRun* run = GetShapedRun(fontId, feature, text);
+    if (!run)
+        return false;
+
+    width = run->width;
+    height = run->face->lineHeight;
+    provisional = run->provisional;
+
+    return true;
+}
+
+bool GlyphAtlas::MeasureStyledText(StyledTextList* list, float &width, float &height, bool &provisional)
+{
+    if (!list)
+        return false;
+
+    Prepare();
+
+    width = 0.0f;
+    height = 0.0f;
+    provisional = false;
+
+    for (uint32 i = 0; i < list->size(); i++)
+    {
+        ShapedRun* run = GetShapedRun((*list)[i]->fontId, (*list)[i]->feature, (*list)[i]->text);
+        if (!run)
+            return false;
+
+        width += run->width;
+        if (run->face->lineHeight > height)
+            height = run->face->lineHeight;
+        if (run->provisional)
+            provisional = true;
+    }
+
+    return true;
+}
+
+bool GlyphAtlas::PrintText(int32 fontId, uint8 feature, float x, float y, int32 wrap, const wchar_t* text, uint32 color, BatchTransform* transform)
+{
+    if (!text)
+        return false;
+
+    Prepare();
+
+    ShapedRun* run = GetShapedRun(fontId, feature, text);
+    if (!run)
+        return false;
+
+    m_styledRuns.assign(1, run);
+    m_runColors.assign(1, color);
+
+    SubmitLayout(GetLayout(text, GetWrapLimit(x, wrap)), x, y, transform);
+
+    return true;
+}
+
+bool GlyphAtlas::PrintStyledText(float x, float y, int32 wrap, StyledTextList* list, uint32 color, BatchTransform* transform)
+{
+    if (!list)
+        return false;
+
+    Prepare();
+
+    // every run has to be available before anything is drawn, otherwise the whole text is left to SimplyFlat
+    m_styledRuns.resize(list->size());
+    m_runColors.resize(list->size());
+    for (uint32 i = 0; i < list->size(); i++)
+    {
+        m_styledRuns[i] = GetShapedRun((*list)[i]->fontId, (*list)[i]->feature, (*list)[i]->text);
+        if (!m_styledRuns[i])
+            return false;
+
+        m_runColors[i] = (*list)[i]->colorize ? (*list)[i]->color : color;
+    }
+
+    SubmitLayout(GetLayout(list, GetWrapLimit(x, wrap)), x, y, transform);
+
+    return true;
+}
@@ -0,0 +1,123 @@
+#include "Global.h"
+#include "Handlers/LineBreak.h"
+
+LineBreakClass GetLineBreakClass(wchar_t character)
+{
+    switch (character)
+    {
+        case L' ':
+            return LBC_SP;
+        case L'\n':
+        case L'\r':
+        case 0x2028:    // line separator
+        case 0x2029:    // paragraph separator
+            return LBC_BK;
+        case 0x00A0:    // no-break space
+        case 0x202F:    // narrow no-break space
+        case 0x2060:    // word joiner
+        case 0xFEFF:    // zero width no-break space
+            return LBC_GL;
+        case 0x200B:
+            return LBC_ZW;
+        case L'-':
+            return LBC_HY;
+        case L'\t':
+        case 0x00AD:    // soft hyphen
+        case 0x2010:    // hyphen
+        case 0x2012:    // figure dash
+        case 0x2013:    // en dash
+        case 0x2014:    // em dash
+        case 0x3000:    // ideographic space
+            return LBC_BA;
+        case L'(':
+        case L'[':
+        case L'{':
+        case 0x00A1:    // inverted exclamation mark
+        case 0x00BF:    // inverted question mark
+        case 0x201E:    // low double quotation mark
+        case 0x3008:
+        case 0x300A:
+        case 0x300C:
+        case 0x300E:
+        case 0x3010:
+        case 0xFF08:    // fullwidth left parenthesis
+        case 0xFF3B:
+        case 0xFF5B:
+            return LBC_OP;
+        case L')':
+        case L']':
+        case L'}':
+        case L',':
+        case L'.':
+        case L':':
+        case L';':
+        case L'!':
+        case L'?':
+        case L'%':
+        case 0x2026:    // ellipsis
+        case 0x3001:    // ideographic comma
+        case 0x3002:    // ideographic full stop
+        case 0x3005:    // ideographic iteration mark
+        case 0x3009:
+        case 0x300B:
+        case 0x300D:
+        case 0x300F:
+        case 0x3011:
+        case 0x30FC:    // prolonged sound mark
+        case 0xFF01:
+        case 0xFF09:    // fullwidth right parenthesis
+        case 0xFF0C:
+        case 0xFF0E:
+        case 0xFF1A:
+        case 0xFF1B:
+        case 0xFF1F:
+        case 0xFF3D:
+        case 0xFF5D:
+            return LBC_CL;
+        default:
+            break;
+    }
+
+    if (character >= L'0' && character <= L'9')
+        return LBC_NU;
+
+    // CJK ideographs, kana and hangul syllables, fullwidth forms
+    if ((character >= 0x2E80 && character <= 0x9FFF) || (character >= 0xAC00 && character <= 0xD7AF)
+        || (character >= 0xF900 && character <= 0xFAFF) || (character >= 0xFF00 && character <= 0xFFEF))
+        return LBC_ID;
+
+    return LBC_AL;
+}
+
+bool IsLineBreakOpportunity(wchar_t before, wchar_t after)
+{
+    LineBreakClass a = GetLineBreakClass(before);
+    LineBreakClass b = GetLineBreakClass(after);
+
+    // rules in order of UAX #14, the first matching one decides
+    if (a == LBC_BK)
+        return true;
+    if (b == LBC_BK || b == LBC_SP || b == LBC_ZW)
+        return false;
+    if (a == LBC_ZW)
+        return true;
+    if (a == LBC_GL || b == LBC_GL)
+        return false;
+    if (b == LBC_CL)
+        return false;
+    if (a == LBC_OP)
+        return false;
+    if (a == LBC_SP)
+        return true;
+    if (b == LBC_HY || b == LBC_BA)
+        return false;
+    // minus sign of number stays with it
+    if (a == LBC_HY)
+        return (b != LBC_NU);
+    if (a == LBC_BA)
+        return true;
+    if (a == LBC_ID || b == LBC_ID)
+        return true;
+
+    return false;
+}
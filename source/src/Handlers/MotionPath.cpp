@@ -0,0 +1,173 @@
+#include "Global.h"
+#include "Handlers/MotionPath.h"
+
+struct MotionPathPoints
+{
+    float* points;
+    uint32 count;
+};
+
+MotionPath::MotionPath()
+{
+    m_length = 0.0f;
+    m_built = false;
+
+    for (uint32 i = 0; i <= MOTION_PATH_SAMPLES; i++)
+        m_points[i][0] = m_points[i][1] = 0.0f;
+}
+
+void MotionPath::Build(MotionPathSampler sampler, void* data)
+{
+    const uint32 dense = MOTION_PATH_SAMPLES * MOTION_PATH_OVERSAMPLE;
+    float points[dense+1][2];
+    float lengths[dense+1];
+    uint32 i, j;
+
+    // measure the curve
+    lengths[0] = 0.0f;
+    sampler(data, 0.0f, points[0][0], points[0][1]);
+    for (i = 1; i <= dense; i++)
+    {
+        sampler(data, float(i) / float(dense), points[i][0], points[i][1]);
+
+        float dx = points[i][0] - points[i-1][0];
+        float dy = points[i][1] - points[i-1][1];
+        lengths[i] = lengths[i-1] + sqrt(dx*dx + dy*dy);
+    }
+
+    m_length = lengths[dense];
+
+    // and pick points with equal distance between them
+    m_points[0][0] = points[0][0];
+    m_points[0][1] = points[0][1];
+    j = 0;
+    for (i = 1; i < MOTION_PATH_SAMPLES; i++)
+    {
+        float target = m_length * float(i) / float(MOTION_PATH_SAMPLES);
+        while (j < dense - 1 && lengths[j+1] < target)
+            j++;
+
+        float segment = lengths[j+1] - lengths[j];
+        float frac = (segment > 0.0f) ? (target - lengths[j]) / segment : 0.0f;
+
+        m_points[i][0] = points[j][0] + (points[j+1][0] - points[j][0]) * frac;
+        m_points[i][1] = points[j][1] + (points[j+1][1] - points[j][1]) * frac;
+    }
+    m_points[MOTION_PATH_SAMPLES][0] = points[dense][0];
+    m_points[MOTION_PATH_SAMPLES][1] = points[dense][1];
+
+    m_built = true;
+}
+
+void MotionPath::Evaluate(float coef, float &x, float &y)
+{
+    float pos = coef * float(MOTION_PATH_SAMPLES);
+
+    // values outside <0;1> (curves overshooting the end) continue in direction of the first or last segment
+    int32 index = int32(floor(pos));
+    if (index < 0)
+        index = 0;
+    else if (index > MOTION_PATH_SAMPLES - 1)
+        index = MOTION_PATH_SAMPLES - 1;
+
+    float frac = pos - float(index);
+
+    x = m_points[index][0] + (m_points[index+1][0] - m_points[index][0]) * frac;
+    y = m_points[index][1] + (m_points[index+1][1] - m_points[index][1]) * frac;
+}
+
+void MotionPath::SampleBezier(void* data, float t, float &x, float &y)
+{
+    float* p = (float*)data;
+    float inv = 1.0f - t;
+    float a = inv*inv*inv;
+    float b = 3.0f*inv*inv*t;
+    float c = 3.0f*inv*t*t;
+    float d = t*t*t;
+
+    x = a*p[0] + b*p[2] + c*p[4] + d*p[6];
+    y = a*p[1] + b*p[3] + c*p[5] + d*p[7];
+}
+
+void MotionPath::BuildBezier(float* start, float* control1, float* control2, float* end)
+{
+    float data[8] = {start[0], start[1], control1[0], control1[1], control2[0], control2[1], end[0], end[1]};
+
+    Build(&MotionPath::SampleBezier, data);
+}
+
+void MotionPath::SampleCircular(void* data, float t, float &x, float &y)
+{
+    float* p = (float*)data;
+    float angle = p[3] + p[4]*t;
+
+    x = p[0] + cos(angle)*p[2];
+    y = p[1] + sin(angle)*p[2];
+}
+
+void MotionPath::BuildCircular(float centerX, float centerY, float radius, float phase, float sweep)
+{
+    float data[5] = {centerX, centerY, radius, phase, sweep};
+
+    Build(&MotionPath::SampleCircular, data);
+}
+
+void MotionPath::SamplePolyline(void* data, float t, float &x, float &y)
+{
+    MotionPathPoints* p = (MotionPathPoints*)data;
+
+    float pos = t * float(p->count - 1);
+    uint32 index = uint32(pos);
+    if (index >= p->count - 1)
+        index = p->count - 2;
+
+    float frac = pos - float(index);
+    float* a = &p->points[index*2];
+    float* b = &p->points[(index+1)*2];
+
+    x = a[0] + (b[0] - a[0]) * frac;
+    y = a[1] + (b[1] - a[1]) * frac;
+}
+
+void MotionPath::BuildPolyline(float* points, uint32 count)
+{
+    if (count < 2)
+        return;
+
+    MotionPathPoints data = {points, count};
+
+    Build(&MotionPath::SamplePolyline, &data);
+}
+
+void MotionPath::SampleSpline(void* data, float t, float &x, float &y)
+{
+    MotionPathPoints* p = (MotionPathPoints*)data;
+
+    float pos = t * float(p->count - 1);
+    uint32 index = uint32(pos);
+    if (index >= p->count - 1)
+        index = p->count - 2;
+
+    float u = pos - float(index);
+    float u2 = u*u;
+    float u3 = u2*u;
+
+    // Catmull-Rom segment between points 1 and 2, outer points are repeated at both ends
+    float* p0 = &p->points[((index > 0) ? index-1 : 0)*2];
+    float* p1 = &p->points[index*2];
+    float* p2 = &p->points[(index+1)*2];
+    float* p3 = &p->points[((index+2 < p->count) ? index+2 : p->count-1)*2];
+
+    x = 0.5f * (2.0f*p1[0] + (p2[0] - p0[0])*u + (2.0f*p0[0] - 5.0f*p1[0] + 4.0f*p2[0] - p3[0])*u2 + (3.0f*p1[0] - p0[0] - 3.0f*p2[0] + p3[0])*u3);
+    y = 0.5f * (2.0f*p1[1] + (p2[1] - p0[1])*u + (2.0f*p0[1] - 5.0f*p1[1] + 4.0f*p2[1] - p3[1])*u2 + (3.0f*p1[1] - p0[1] - 3.0f*p2[1] + p3[1])*u3);
+}
+
+void MotionPath::BuildSpline(float* points, uint32 count)
+{
+    if (count < 2)
+        return;
+
+    MotionPathPoints data = {points, count};
+
+    Build(&MotionPath::SampleSpline, &data);
+}
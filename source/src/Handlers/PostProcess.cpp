@@ -0,0 +1,326 @@
+#include "Global.h"
+#include "Storage.h"
+#include "Log.h"
+#include "Defines/Styles.h"
+#include "Handlers/DrawBatch.h"
+#include "Handlers/PostProcess.h"
+
+PostProcess::PostProcess()
+{
+    m_cpuFallback = false;
+}
+
+uint32 PostProcess::ComputeKernel(float sigma, uint32* weights)
+{
+    if (sigma < 0.1f)
+    {
+        weights[0] = 255;
+        return 0;
+    }
+
+    uint32 taps = uint32(ceil(2.0f*sigma));
+    if (taps > BLUR_MAX_TAPS)
+        taps = BLUR_MAX_TAPS;
+
+    float gauss[BLUR_MAX_TAPS+1];
+    float total = 0.0f;
+    for (uint32 i = 0; i <= taps; i++)
+    {
+        gauss[i] = exp(-float(i*i) / (2.0f*sigma*sigma));
+        total += (i == 0) ? gauss[i] : 2.0f*gauss[i];
+    }
+
+    // side weights are rounded down and the rest goes to the center, so the sum is exactly 255
+    uint32 sum = 0;
+    for (uint32 i = 1; i <= taps; i++)
+    {
+        weights[i] = uint32(255.0f * gauss[i] / total);
+        sum += 2*weights[i];
+    }
+    weights[0] = 255 - sum;
+
+    return taps;
+}
+
+void PostProcess::BlurImage(uint8* pixels, uint32 width, uint32 height, uint32* weights, uint32 taps, uint8* temp)
+{
+    int32 x, y, k, sx, sy, w = width, h = height;
+    uint32 acc[4];
+    uint8* src;
+
+    // horizontal pass from pixels to temp
+    for (y = 0; y < h; y++)
+    {
+        for (x = 0; x < w; x++)
+        {
+            acc[0] = acc[1] = acc[2] = acc[3] = 0;
+            for (k = -int32(taps); k <= int32(taps); k++)
+            {
+                sx = x + k;
+                if (sx < 0)
+                    sx = 0;
+                else if (sx >= w)
+                    sx = w - 1;
+
+                src = &pixels[(y*w + sx)*4];
+                uint32 weight = weights[(k < 0) ? -k : k];
+                acc[0] += src[0] * weight;
+                acc[1] += src[1] * weight;
+                acc[2] += src[2] * weight;
+                acc[3] += src[3] * weight;
+            }
+
+            for (k = 0; k < 4; k++)
+                temp[(y*w + x)*4 + k] = uint8(acc[k] / 255);
+        }
+    }
+
+    // and vertical pass back
+    for (y = 0; y < h; y++)
+    {
+        for (x = 0; x < w; x++)
+        {
+            acc[0] = acc[1] = acc[2] = acc[3] = 0;
+            for (k = -int32(taps); k <= int32(taps); k++)
+            {
+                sy = y + k;
+                if (sy < 0)
+                    sy = 0;
+                else if (sy >= h)
+                    sy = h - 1;
+
+                src = &temp[(sy*w + x)*4];
+                uint32 weight = weights[(k < 0) ? -k : k];
+                acc[0] += src[0] * weight;
+                acc[1] += src[1] * weight;
+                acc[2] += src[2] * weight;
+                acc[3] += src[3] * weight;
+            }
+
+            for (k = 0; k < 4; k++)
+                pixels[(y*w + x)*4 + k] = uint8(acc[k] / 255);
+        }
+    }
+}
+
+bool PostProcess::CheckCPUBlur()
+{
+    uint32 weights[BLUR_MAX_TAPS+1];
+
+    // small image, so the widest kernel reaches over both edges
+    const uint32 width = 5, height = 3;
+    uint8 pixels[width*height*4];
+    uint8 temp[width*height*4];
+    const uint8 color[4] = {200, 100, 37, 255};
+
+    for (float sigma = 0.0f; sigma <= BLUR_MAX_SIGMA; sigma += 0.25f)
+    {
+        uint32 taps = ComputeKernel(sigma, weights);
+
+        uint32 sum = weights[0];
+        for (uint32 i = 1; i <= taps; i++)
+            sum += 2*weights[i];
+
+        if (sum != 255)
+        {
+            sLog->ErrorLog("PostProcess: blur kernel of sigma %f sums up to %u instead of 255", sigma, sum);
+            return false;
+        }
+
+        for (uint32 i = 0; i < width*height*4; i++)
+            pixels[i] = color[i % 4];
+
+        BlurImage(pixels, width, height, weights, taps, temp);
+
+        for (uint32 i = 0; i < width*height*4; i++)
+        {
+            if (pixels[i] != color[i % 4])
+            {
+                sLog->ErrorLog("PostProcess: blur of sigma %f changed constant image at pixel %u", sigma, i / 4);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool PostProcess::ForceCPUFallback()
+{
+    m_cpuFallback = true;
+
+    return CheckCPUBlur();
+}
+
+void PostProcess::Blur(float radius)
+{
+    if (radius <= 0.0f || sStorage->GetOriginalScreenWidth() == 0)
+        return;
+
+    // radius is defined in presentation units, but the kernel works with real pixels
+    float sigma = (radius / 2.0f) * float(sStorage->GetScreenWidth()) / float(sStorage->GetOriginalScreenWidth());
+
+    // wide blur is done on smaller image, so the number of taps stays low
+    uint32 downsample = 1;
+    while (sigma / float(downsample) > BLUR_MAX_SIGMA && downsample < BLUR_MAX_DOWNSAMPLE)
+        downsample *= 2;
+
+    uint32 weights[BLUR_MAX_TAPS+1];
+    uint32 taps = ComputeKernel(sigma / float(downsample), weights);
+
+    if (taps == 0 && downsample == 1)
+        return;
+
+    if (!m_cpuFallback && !BlurGPU(weights, taps, downsample))
+    {
+        sLog->ErrorLog("PostProcess: unable to create blur textures, falling back to CPU blur");
+        m_cpuFallback = true;
+    }
+
+    if (m_cpuFallback)
+        BlurCPU(weights, taps, downsample);
+}
+
+void PostProcess::BlurPass(ScreenCapture* source, float stepX, float stepY, uint32* weights, uint32 taps, float width, float height)
+{
+    // everything is drawn to the left lower corner of the screen, which is where the capture starts
+    float y = (float)sStorage->GetOriginalScreenHeight() - height;
+
+    source->AddToBatch(0, y, width, height, MAKE_COLOR_RGBA(weights[0], weights[0], weights[0], 255), 0.0f, 0.0f, 1.0f, 1.0f, BATCH_BLEND_NONE);
+
+    // shifted copy leaves a strip at the edge uncovered, the edge texels are stretched over it, as the CPU blur clamps
+    // the coordinates - otherwise the borders would miss part of the weights and darken
+    bool horizontal = (stepX > 0.0f);
+    float size = horizontal ? width : height;
+    float edge = 0.5f * (horizontal ? stepX : stepY) / size;
+
+    for (uint32 i = 1; i <= taps; i++)
+    {
+        uint32 color = MAKE_COLOR_RGBA(weights[i], weights[i], weights[i], 255);
+
+        float shift = float(i) * (horizontal ? stepX : stepY);
+        if (shift > size)
+            shift = size;
+        float rest = size - shift;
+        float srcShift = shift / size;
+
+        if (horizontal)
+        {
+            source->AddToBatch(shift, y, rest, height, color, 0.0f, 0.0f, 1.0f - srcShift, 1.0f, BATCH_BLEND_ADD);
+            source->AddToBatch(0, y, shift, height, color, edge, 0.0f, 0.0f, 1.0f, BATCH_BLEND_ADD);
+            source->AddToBatch(0, y, rest, height, color, srcShift, 0.0f, 1.0f - srcShift, 1.0f, BATCH_BLEND_ADD);
+            source->AddToBatch(rest, y, shift, height, color, 1.0f - edge, 0.0f, 0.0f, 1.0f, BATCH_BLEND_ADD);
+        }
+        else
+        {
+            source->AddToBatch(0, y + shift, width, rest, color, 0.0f, 0.0f, 1.0f, 1.0f - srcShift, BATCH_BLEND_ADD);
+            source->AddToBatch(0, y, width, shift, color, 0.0f, edge, 1.0f, 0.0f, BATCH_BLEND_ADD);
+            source->AddToBatch(0, y, width, rest, color, 0.0f, srcShift, 1.0f, 1.0f - srcShift, BATCH_BLEND_ADD);
+            source->AddToBatch(0, y + rest, width, shift, color, 0.0f, 1.0f - edge, 1.0f, 0.0f, BATCH_BLEND_ADD);
+        }
+    }
+
+    sDrawBatch->Flush();
+}
+
+bool PostProcess::BlurGPU(uint32* weights, uint32 taps, uint32 downsample)
+{
+    uint32 screenWidth = sStorage->GetScreenWidth();
+    uint32 screenHeight = sStorage->GetScreenHeight();
+    uint32 width = screenWidth / downsample;
+    uint32 height = screenHeight / downsample;
+    if (width == 0)
+        width = 1;
+    if (height == 0)
+        height = 1;
+
+    // blur textures are made for the whole screen at once, so animated blur changing the downsample does not allocate
+    if (!m_scene.Prepare(screenWidth, screenHeight) || !m_ping.Prepare(width, height, screenWidth, screenHeight)
+        || !m_pong.Prepare(width, height, screenWidth, screenHeight))
+        return false;
+
+    float origWidth = (float)sStorage->GetOriginalScreenWidth();
+    float origHeight = (float)sStorage->GetOriginalScreenHeight();
+
+    // downsampled area and size of its pixel in presentation units
+    float areaWidth = origWidth * float(width) / float(screenWidth);
+    float areaHeight = origHeight * float(height) / float(screenHeight);
+    float texelWidth = areaWidth / float(width);
+    float texelHeight = areaHeight / float(height);
+
+    m_scene.Capture();
+
+    // downsample
+    m_scene.AddToBatch(0, origHeight - areaHeight, areaWidth, areaHeight, MAKE_COLOR_RGBA(255,255,255,255), 0.0f, 0.0f, 1.0f, 1.0f, BATCH_BLEND_NONE);
+    sDrawBatch->Flush();
+    m_ping.Capture();
+
+    // horizontal and vertical pass
+    BlurPass(&m_ping, texelWidth, 0.0f, weights, taps, areaWidth, areaHeight);
+    m_pong.Capture();
+    BlurPass(&m_pong, 0.0f, texelHeight, weights, taps, areaWidth, areaHeight);
+    m_ping.Capture();
+
+    // and stretch result over the whole screen, linear filtering smooths it a bit more
+    m_ping.AddToBatch(0, 0, origWidth, origHeight, MAKE_COLOR_RGBA(255,255,255,255), 0.0f, 0.0f, 1.0f, 1.0f, BATCH_BLEND_NONE);
+    sDrawBatch->Flush();
+
+    return true;
+}
+
+void PostProcess::BlurCPU(uint32* weights, uint32 taps, uint32 downsample)
+{
+    uint32 screenWidth = sStorage->GetScreenWidth();
+    uint32 screenHeight = sStorage->GetScreenHeight();
+    uint32 width = screenWidth / downsample;
+    uint32 height = screenHeight / downsample;
+    if (width == 0 || height == 0)
+        return;
+
+    m_cpuPixels.resize(screenWidth*screenHeight*4);
+    m_cpuDownsampled.resize(width*height*4);
+    m_cpuTemp.resize(width*height*4);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, screenWidth, screenHeight, GL_RGBA, GL_UNSIGNED_BYTE, &m_cpuPixels[0]);
+
+    // box downsample, rows are flipped at the same time, so the image can be drawn from the upper left corner
+    uint32 x, y, i, j, k, acc[4];
+    uint32 area = downsample*downsample;
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            acc[0] = acc[1] = acc[2] = acc[3] = 0;
+            for (j = 0; j < downsample; j++)
+            {
+                uint8* src = &m_cpuPixels[((y*downsample + j)*screenWidth + x*downsample)*4];
+                for (i = 0; i < downsample; i++)
+                    for (k = 0; k < 4; k++)
+                        acc[k] += src[i*4 + k];
+            }
+
+            for (k = 0; k < 4; k++)
+                m_cpuDownsampled[((height - 1 - y)*width + x)*4 + k] = uint8(acc[k] / area);
+        }
+    }
+
+    BlurImage(&m_cpuDownsampled[0], width, height, weights, taps, &m_cpuTemp[0]);
+
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_BLEND);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glRasterPos2f(0.0f, 0.0f);
+    glPixelZoom(float(screenWidth) / float(width), -float(screenHeight) / float(height));
+    glDrawPixels(width, height, GL_RGBA, GL_UNSIGNED_BYTE, &m_cpuDownsampled[0]);
+    glPixelZoom(1.0f, 1.0f);
+}
+
+void PostProcess::Colorize(uint32 color)
+{
+    if (COLOR_A(color) == 0)
+        return;
+
+    sDrawBatch->AddQuad(0, 0, (float)sStorage->GetOriginalScreenWidth(), (float)sStorage->GetOriginalScreenHeight(), color);
+    sDrawBatch->Flush();
+}
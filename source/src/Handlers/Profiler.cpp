@@ -0,0 +1,110 @@
+#include "Global.h"
+#include "Defines/Effects.h"
+#include "Handlers/Profiler.h"
+
+#ifndef _WIN32
+  #include <sys/time.h>
+#endif
+
+#include <cstdio>
+
+#ifdef _WIN32
+  #define snprintf _snprintf
+#endif
+
+FrameProfiler::FrameProfiler()
+{
+    m_frameStart = 0;
+    m_historyPos = 0;
+    m_frameCount = 0;
+    m_droppedFrames = 0;
+
+    for (uint32 i = 0; i < PROFILER_HISTORY; i++)
+        m_history[i] = 0;
+
+    memset(&m_effectStats, 0, sizeof(EffectStatistics));
+}
+
+uint64 FrameProfiler::GetTime()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&counter);
+
+    // whole seconds and the remainder separately, counter multiplied by million would overflow after days of uptime
+    uint64 ticks = uint64(counter.QuadPart);
+    uint64 freq = uint64(frequency.QuadPart);
+
+    return (ticks / freq) * 1000000 + (ticks % freq) * 1000000 / freq;
+#else
+    timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return uint64(tv.tv_sec) * 1000000 + uint64(tv.tv_usec);
+#endif
+}
+
+void FrameProfiler::BeginFrame()
+{
+    m_frameStart = GetTime();
+}
+
+void FrameProfiler::EndFrame()
+{
+    uint32 frameTime = uint32(GetTime() - m_frameStart);
+
+    m_history[m_historyPos] = frameTime;
+    m_historyPos = (m_historyPos + 1) % PROFILER_HISTORY;
+    m_frameCount++;
+
+    if (frameTime > PROFILER_FRAME_BUDGET)
+        m_droppedFrames++;
+
+    // store counters of this frame and start counting again
+    EffectHandler::ResetFrameStatistics(&m_effectStats);
+}
+
+uint32 FrameProfiler::GetAverageFrameTime()
+{
+    uint32 count = (m_frameCount < PROFILER_HISTORY) ? m_frameCount : PROFILER_HISTORY;
+    if (count == 0)
+        return 0;
+
+    uint64 sum = 0;
+    for (uint32 i = 0; i < count; i++)
+        sum += m_history[i];
+
+    return uint32(sum / count);
+}
+
+uint32 FrameProfiler::GetMaxFrameTime()
+{
+    uint32 result = 0;
+    for (uint32 i = 0; i < PROFILER_HISTORY; i++)
+        if (m_history[i] > result)
+            result = m_history[i];
+
+    return result;
+}
+
+uint32 FrameProfiler::FormatReport(char* buffer, uint32 size)
+{
+    EffectStatistics* st = &m_effectStats;
+
+    int32 len = snprintf(buffer, size, "FRAME last=%u avg=%u max=%u dropped=%u/%u EFFECTS live=%u queued=%u animate=%u "
+                         "linear=%u circle=%u bezier=%u polyline=%u spline=%u nomove=%u\n",
+                         GetLastFrameTime(), GetAverageFrameTime(), GetMaxFrameTime(), m_droppedFrames, m_frameCount,
+                         st->liveHandlers, st->queuedEffects, st->animateTime,
+                         st->evaluations[MOVE_TYPE_LINEAR], st->evaluations[MOVE_TYPE_CIRCULAR], st->evaluations[MOVE_TYPE_BEZIER],
+                         st->evaluations[MOVE_TYPE_POLYLINE], st->evaluations[MOVE_TYPE_SPLINE], st->evaluations[EFFECT_STAT_NO_MOVE]);
+
+    if (len < 0 || uint32(len) >= size)
+        return (size > 0) ? size - 1 : 0;
+
+    return uint32(len);
+}
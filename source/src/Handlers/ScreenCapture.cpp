@@ -0,0 +1,119 @@
+#include "Global.h"
+#include "Handlers/ScreenCapture.h"
+
+ScreenCapture::ScreenCapture()
+{
+    m_textureId = 0;
+    m_width = 0;
+    m_height = 0;
+    m_textureWidth = 0;
+    m_textureHeight = 0;
+    m_captured = false;
+}
+
+ScreenCapture::~ScreenCapture()
+{
+    Release();
+}
+
+uint32 ScreenCapture::NextPowerOfTwo(uint32 value)
+{
+    uint32 res = 1;
+    while (res < value)
+        res <<= 1;
+
+    return res;
+}
+
+bool ScreenCapture::Prepare(uint32 width, uint32 height, uint32 maxWidth, uint32 maxHeight)
+{
+    if (width == 0 || height == 0)
+        return false;
+
+    // nothing to do, texture is ready
+    if (m_textureId && m_width == width && m_height == height)
+        return true;
+
+    // texture is large enough, only the captured area changes
+    if (m_textureId && width <= m_textureWidth && height <= m_textureHeight)
+    {
+        m_width = width;
+        m_height = height;
+        m_captured = false;
+        return true;
+    }
+
+    Release();
+
+    if (maxWidth < width)
+        maxWidth = width;
+    if (maxHeight < height)
+        maxHeight = height;
+
+    m_width = width;
+    m_height = height;
+    m_textureWidth = NextPowerOfTwo(maxWidth);
+    m_textureHeight = NextPowerOfTwo(maxHeight);
+
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    if (tex == 0)
+        return false;
+
+    m_textureId = tex;
+
+    glBindTexture(GL_TEXTURE_2D, m_textureId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_textureWidth, m_textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (glGetError() != GL_NO_ERROR)
+    {
+        Release();
+        return false;
+    }
+
+    return true;
+}
+
+void ScreenCapture::Release()
+{
+    if (m_textureId)
+    {
+        GLuint tex = m_textureId;
+        glDeleteTextures(1, &tex);
+    }
+
+    m_textureId = 0;
+    m_captured = false;
+}
+
+void ScreenCapture::Capture()
+{
+    if (!m_textureId)
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, m_textureId);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, m_width, m_height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_captured = true;
+}
+
+void ScreenCapture::AddToBatch(float x, float y, float width, float height, uint32 color, float srcX, float srcY, float srcWidth, float srcHeight, uint8 blend)
+{
+    if (!m_textureId || !m_captured)
+        return;
+
+    float maxU = float(m_width) / float(m_textureWidth);
+    float maxV = float(m_height) / float(m_textureHeight);
+
+    // framebuffer rows are stored from the bottom, so the vertical texture coordinate has to be flipped
+    sDrawBatch->AddTexturedQuad(x, y, width, height, color, m_textureId,
+                                srcX * maxU, (1.0f - srcY) * maxV,
+                                (srcX + srcWidth) * maxU, (1.0f - srcY - srcHeight) * maxV,
+                                blend);
+}
@@ -0,0 +1,61 @@
+#include "Global.h"
+#include "Handlers/TextMetrics.h"
+#include "Handlers/FontRegistry.h"
+
+TextRunKey::TextRunKey(int32 p_fontId, uint8 p_feature, const wchar_t* text, uint32 p_length)
+{
+    fontId = p_fontId;
+    feature = p_feature;
+    length = p_length;
+    hash = HashString(text, length);
+}
+
+TextMetrics::TextMetrics()
+{
+}
+
+uint32 TextMetrics::GetTextWidth(int32 fontId, uint8 feature, const wchar_t* text, uint32 length)
+{
+    if (fontId < 0 || !text || length == 0)
+        return 0;
+
+    TextRunKey key(fontId, feature, text, length);
+
+    std::map<TextRunKey, TextMeasure>::iterator itr = m_widths.find(key);
+    if (itr != m_widths.end() && itr->second.text.compare(0, std::wstring::npos, text, length) == 0)
+        return itr->second.width;
+
+    if (m_widths.size() >= TEXT_METRICS_CACHE_MAX)
+        m_widths.clear();
+
+    // SimplyFlat measures whole strings only
+    m_buffer.assign(text, length);
+
+    // not cached yet (or colliding with other text, which is then replaced)
+    TextMeasure* measure = &m_widths[key];
+    measure->text = m_buffer;
+    measure->width = sSimplyFlat->Drawing->GetTextWidth(sFontRegistry->GetSimplyFlatFont(fontId), feature, m_buffer.c_str());
+
+    return measure->width;
+}
+
+uint32 TextMetrics::GetFontHeight(int32 fontId)
+{
+    if (fontId < 0)
+        return 0;
+
+    std::map<int32, uint32>::iterator itr = m_heights.find(fontId);
+    if (itr != m_heights.end())
+        return itr->second;
+
+    uint32 height = sSimplyFlat->Drawing->GetFontHeight(sFontRegistry->GetSimplyFlatFont(fontId));
+    m_heights[fontId] = height;
+
+    return height;
+}
+
+void TextMetrics::Invalidate()
+{
+    m_widths.clear();
+    m_heights.clear();
+}
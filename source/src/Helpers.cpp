@@ -399,3 +399,13 @@ const char* ToMultiByteString(const wchar_t* input)
 
     return mbc;
 }
+
+uint32 HashString(const wchar_t* input, uint32 length)
+{
+    // FNV-1a
+    uint32 hash = 2166136261U;
+    for (uint32 i = 0; i < length; i++)
+        hash = (hash ^ uint32(input[i])) * 16777619U;
+
+    return hash;
+}
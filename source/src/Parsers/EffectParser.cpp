@@ -70,6 +70,10 @@ bool EffectParser::Parse(std::vector<std::wstring> *input)
                 }
                 else if (EqualString(right, L"bezier", true))
                     tmp->moveType = new uint32(MOVE_TYPE_BEZIER);
+                else if (EqualString(right, L"polyline", true))
+                    tmp->moveType = new uint32(MOVE_TYPE_POLYLINE);
+                else if (EqualString(right, L"spline", true))
+                    tmp->moveType = new uint32(MOVE_TYPE_SPLINE);
                 else
                     RAISE_ERROR("EffectParser: Unknown move type '%s'", right);
             }
@@ -86,14 +90,12 @@ bool EffectParser::Parse(std::vector<std::wstring> *input)
             // effect progress
             else if (EqualString(left, L"\\PROGRESS", true))
             {
-                if (EqualString(right, L"linear", true))
-                    tmp->progressType = new uint32(EP_LINEAR);
-                else if (EqualString(right, L"sinus", true))
-                    tmp->progressType = new uint32(EP_SINUS);
-                else if (EqualString(right, L"quadratic", true))
-                    tmp->progressType = new uint32(EP_QUADRATIC);
-                else
-                    RAISE_ERROR("EffectParser: Unknown progress type '%s'", right);
+                // named curve (linear, sinus, ease-in-out, bounce, ..) or cubic-bezier(x1,y1,x2,y2) or steps(n)
+                uint8 curve = sEasing->ParseCurve(right);
+                if (curve == EP_INVALID)
+                    RAISE_ERROR("EffectParser: Unknown progress type '%S'", right);
+
+                tmp->progressType = new uint32(curve);
             }
             // starting position
             else if (EqualString(left, L"\\START_POS", true))
@@ -121,6 +123,20 @@ bool EffectParser::Parse(std::vector<std::wstring> *input)
                 tmp->endPos[0] = ToInt(xpos);
                 tmp->endPos[1] = ToInt(ypos);
             }
+            // point of polyline or spline path, the path goes from start position through all points in order to end position
+            else if (EqualString(left, L"\\PATH_POINT", true))
+            {
+                wchar_t* xpos = LeftSide(right, ',');
+                wchar_t* ypos = RightSide(right, ',');
+
+                if (!IsNumeric(xpos) || !IsNumeric(ypos))
+                    RAISE_ERROR("EffectParser: Non-numeric value supplied as path point parameter");
+
+                if (!tmp->pathPoints)
+                    tmp->pathPoints = new std::vector<CVector2>;
+
+                tmp->pathPoints->push_back(CVector2((float)ToInt(xpos), (float)ToInt(ypos)));
+            }
             // in case of bezier movement, start vector is needed
             else if (EqualString(left, L"\\START_VECTOR", true))
             {
@@ -280,12 +296,42 @@ bool EffectParser::Parse(std::vector<std::wstring> *input)
             {
                 tmp->isBlocking = false;
             }
+            // sets effect as concurrent - played on element with running effect, it's composed with it
+            else if (EqualString(left, L"\\CONCURRENT", true))
+            {
+                tmp->isConcurrent = true;
+            }
+            // order of concurrent effect
+            else if (EqualString(left, L"\\PRIORITY", true))
+            {
+                if (!IsNumeric(right))
+                    RAISE_ERROR("EffectParser: Non-numeric value supplied as priority parameter");
+
+                tmp->priority = ToInt(right);
+            }
             else if (EqualString(left, L"\\NEXT_EFFECT", true))
             {
+                // effect name, optionally followed by repeat count
+                EffectChainLink link;
+                link.name = right;
+                link.repeat = 0;
+                link.target = NULL;
+
+                wchar_t* name = LeftSide(right, ' ');
+                wchar_t* count = RightSide(right, ' ');
+                if (name && count)
+                {
+                    if (!IsNumeric(count) || ToInt(count) <= 0)
+                        RAISE_ERROR("EffectParser: invalid repeat count '%S' of chained effect in effect '%S'", count, effname);
+
+                    link.name = name;
+                    link.repeat = ToInt(count);
+                }
+
                 if (tmp->m_effectChain == NULL)
-                    tmp->m_effectChain = new std::vector<std::wstring>;
+                    tmp->m_effectChain = new std::vector<EffectChainLink>;
 
-                tmp->m_effectChain->push_back(right);
+                tmp->m_effectChain->push_back(link);
             }
             else if (EqualString(left, L"\\DEF_END", true))
             {
@@ -322,3 +368,124 @@ bool EffectParser::Parse(std::vector<std::wstring> *input)
 
     return true;
 }
+
+bool EffectParser::ResolveChains()
+{
+    EffectMap* effects = sStorage->GetEffectMap();
+
+    // resolve names of chained effects
+    for (EffectMap::iterator itr = effects->begin(); itr != effects->end(); ++itr)
+    {
+        std::vector<EffectChainLink>* links = itr->second->m_effectChain;
+        if (!links)
+            continue;
+
+        for (std::vector<EffectChainLink>::iterator lnk = links->begin(); lnk != links->end(); ++lnk)
+        {
+            lnk->target = sStorage->GetEffect(lnk->name.c_str());
+            if (!lnk->target)
+                sLog->ErrorLog("EffectParser: effect '%S' chained in effect '%S' does not exist", lnk->name.c_str(), itr->first);
+        }
+    }
+
+    // and build list of played effects for every chain
+    for (EffectMap::iterator itr = effects->begin(); itr != effects->end(); ++itr)
+    {
+        if (!itr->second->m_effectChain)
+            continue;
+
+        std::vector<Effect*> stack;
+        std::vector<EffectChainLink*> path;
+        std::map<EffectChainLink*, uint32> passes;
+
+        itr->second->chain = new std::vector<Effect*>;
+        FlattenChain(itr->first, itr->second, NULL, &stack, &path, &passes, itr->second->chain);
+    }
+
+    return true;
+}
+
+void EffectParser::FlattenChain(const wchar_t* rootName, Effect* eff, EffectChainLink* via, std::vector<Effect*>* stack, std::vector<EffectChainLink*>* path,
+                                std::map<EffectChainLink*, uint32>* passes, std::vector<Effect*>* out)
+{
+    if (!eff->m_effectChain)
+        return;
+
+    stack->push_back(eff);
+    path->push_back(via);
+
+    for (std::vector<EffectChainLink>::iterator lnk = eff->m_effectChain->begin(); lnk != eff->m_effectChain->end(); ++lnk)
+    {
+        if (!lnk->target)
+            continue;
+
+        uint32 repeat = lnk->repeat ? lnk->repeat : 1;
+
+        // the cycle closed by this link starts at the last occurrence of its target on stack
+        int32 cycleStart = -1;
+        for (uint32 i = stack->size(); i > 0; i--)
+        {
+            if ((*stack)[i-1] == lnk->target)
+            {
+                cycleStart = int32(i-1);
+                break;
+            }
+        }
+
+        // link back to effect, which is being played, is allowed only with repeat count - every pass through it plays the cycle once more
+        // the count belongs to the cycle, so links inside a counted cycle are followed freely and the counted back-link stops it
+        if (cycleStart >= 0)
+        {
+            if (lnk->repeat)
+            {
+                if ((*passes)[&(*lnk)] >= lnk->repeat)
+                    continue;
+
+                (*passes)[&(*lnk)]++;
+            }
+            else
+            {
+                bool counted = false;
+                for (uint32 i = uint32(cycleStart) + 1; i < path->size(); i++)
+                {
+                    if ((*path)[i] && passes->find((*path)[i]) != passes->end())
+                    {
+                        counted = true;
+                        break;
+                    }
+                }
+
+                if (!counted)
+                {
+                    sLog->ErrorLog("EffectParser: effect '%S' is chained recursively in chain of effect '%S' without repeat count, ignored", lnk->name.c_str(), rootName);
+                    continue;
+                }
+            }
+
+            repeat = 1;
+        }
+
+        if (stack->size() >= EFFECT_CHAIN_MAX_DEPTH)
+        {
+            sLog->ErrorLog("EffectParser: chain of effect '%S' is nested too deep, effect '%S' ignored", rootName, lnk->name.c_str());
+            continue;
+        }
+
+        for (uint32 i = 0; i < repeat; i++)
+        {
+            if (out->size() >= EFFECT_CHAIN_MAX_LENGTH)
+            {
+                sLog->ErrorLog("EffectParser: chain of effect '%S' is too long, truncated", rootName);
+                stack->pop_back();
+                path->pop_back();
+                return;
+            }
+
+            out->push_back(lnk->target);
+            FlattenChain(rootName, lnk->target, &(*lnk), stack, path, passes, out);
+        }
+    }
+
+    stack->pop_back();
+    path->pop_back();
+}
@@ -0,0 +1,502 @@
+#include "Global.h"
+#include "Helpers.h"
+#include "Storage.h"
+#include "Parsers/ExpressionCompiler.h"
+
+#include <cmath>
+
+ExpressionValue ExpressionValue::Int(int64 value)
+{
+    ExpressionValue result;
+    result.isFloat = false;
+    result.asInt = value;
+    result.asFloat = 0.0;
+    return result;
+}
+
+ExpressionValue ExpressionValue::Float(double value)
+{
+    ExpressionValue result;
+    result.isFloat = true;
+    result.asInt = 0;
+    result.asFloat = value;
+    return result;
+}
+
+ExpressionValue ExpressionValue::Apply(MathOperation op, ExpressionValue left, ExpressionValue right)
+{
+    bool isFloat = left.isFloat || right.isFloat;
+
+    switch (op)
+    {
+        case OP_ADD:
+            if (isFloat)
+                return Float(left.ToFloat() + right.ToFloat());
+            return Int(left.asInt + right.asInt);
+        case OP_MULTIPLY:
+            if (isFloat)
+                return Float(left.ToFloat() * right.ToFloat());
+            return Int(left.asInt * right.asInt);
+        case OP_DIVIDE:
+            if (right.ToFloat() == 0.0)
+                return Float(left.ToFloat());
+            return Float(left.ToFloat() / right.ToFloat());
+        case OP_MODULO:
+            if (isFloat)
+            {
+                if (right.ToFloat() == 0.0)
+                    return Float(left.ToFloat());
+                return Float(fmod(left.ToFloat(), right.ToFloat()));
+            }
+            if (right.asInt == 0)
+                return left;
+            return Int(left.asInt % right.asInt);
+        default:
+            break;
+    }
+
+    return left;
+}
+
+ExpressionValue ExpressionValue::Negate(ExpressionValue value)
+{
+    if (value.isFloat)
+        return Float(-value.asFloat);
+
+    return Int(-value.asInt);
+}
+
+ExpressionProgram::ExpressionProgram()
+{
+    m_constant = ExpressionValue::Int(0);
+    m_resultFloat = false;
+}
+
+ExpressionProgram* ExpressionProgram::Compile(ExpressionTreeElement* tree)
+{
+    if (!tree)
+        return NULL;
+
+    ExpressionProgram* program = new ExpressionProgram;
+
+    Operand result = program->CompileNode(tree, program->m_code);
+    program->m_resultFloat = result.value.isFloat;
+    if (result.constant)
+        program->m_constant = result.value;
+
+    if (program->GetStackDepth() > EXPRESSION_STACK_MAX)
+    {
+        delete program;
+        return NULL;
+    }
+
+    return program;
+}
+
+void ExpressionProgram::Emit(std::vector<ExpressionInstruction> &code, uint8 opcode)
+{
+    ExpressionInstruction ins;
+    ins.opcode = opcode;
+    ins.operand.asInt = 0;
+    code.push_back(ins);
+}
+
+void ExpressionProgram::EmitPush(std::vector<ExpressionInstruction> &code, ExpressionValue value, bool asFloat)
+{
+    ExpressionInstruction ins;
+    if (asFloat)
+    {
+        ins.opcode = EXOP_PUSH_FLOAT;
+        ins.operand.asFloat = value.ToFloat();
+    }
+    else
+    {
+        ins.opcode = EXOP_PUSH_INT;
+        ins.operand.asInt = value.asInt;
+    }
+    code.push_back(ins);
+}
+
+uint32 ExpressionProgram::GetReferenceSlot(const std::wstring &elementId, uint8 properties)
+{
+    for (uint32 i = 0; i < m_references.size(); i++)
+    {
+        if (m_references[i].properties == properties && EqualString(m_references[i].elementId.c_str(), elementId.c_str()))
+            return i;
+    }
+
+    ExpressionReference ref;
+    ref.elementId = elementId;
+    ref.properties = properties;
+    ref.element = NULL;
+    ref.instance = false;
+    m_references.push_back(ref);
+
+    return m_references.size() - 1;
+}
+
+uint32 ExpressionProgram::GetStackDepth()
+{
+    int32 depth = 0, maxDepth = 0;
+
+    for (uint32 i = 0; i < m_code.size(); i++)
+    {
+        switch (m_code[i].opcode)
+        {
+            case EXOP_PUSH_INT:
+            case EXOP_PUSH_FLOAT:
+            case EXOP_PUSH_REF:
+                depth++;
+                break;
+            case EXOP_TO_FLOAT:
+            case EXOP_NEG_INT:
+            case EXOP_NEG_FLOAT:
+                break;
+            default:
+                depth--;
+                break;
+        }
+
+        if (depth > maxDepth)
+            maxDepth = depth;
+    }
+
+    return uint32(maxDepth);
+}
+
+ExpressionProgram::Operand ExpressionProgram::CompileNode(ExpressionTreeElement* node, std::vector<ExpressionInstruction> &code)
+{
+    Operand result;
+    result.constant = true;
+    result.value = ExpressionValue::Int(0);
+
+    if (!node)
+        return result;
+
+    switch (node->valueType)
+    {
+        case VT_INTEGER:
+            result.value = ExpressionValue::Int(node->value.asLong);
+            break;
+        case VT_FLOAT:
+            result.value = ExpressionValue::Float(node->value.asDouble);
+            break;
+        case VT_STRING:
+            result = CompileReference(node->value.asString, code);
+            break;
+        case VT_EXPRESSION:
+        default:
+            if (node->items.empty())
+                break;
+            if (node->operation == OP_ADD || node->operation == OP_MULTIPLY)
+                result = CompileChain(node, code);
+            else
+                result = CompileSequence(node, code);
+            break;
+    }
+
+    if (!node->polarity)
+    {
+        uint8 negate = result.value.isFloat ? EXOP_NEG_FLOAT : EXOP_NEG_INT;
+
+        if (result.constant)
+            result.value = ExpressionValue::Negate(result.value);
+        // double negation cancels out
+        else if (!code.empty() && code.back().opcode == negate)
+            code.pop_back();
+        else
+            Emit(code, negate);
+    }
+
+    return result;
+}
+
+ExpressionProgram::Operand ExpressionProgram::CompileReference(const wchar_t* name, std::vector<ExpressionInstruction> &code)
+{
+    Operand result;
+    result.constant = true;
+    result.value = ExpressionValue::Int(0);
+
+    if (!name)
+        return result;
+
+    // non-object values are known in compile time
+    const wchar_t* dot = wcschr(name, L'.');
+    if (!dot)
+    {
+        if (EqualString(name, L"width", true))
+            result.value = ExpressionValue::Int(sStorage->GetOriginalScreenWidth());
+        else if (EqualString(name, L"height", true))
+            result.value = ExpressionValue::Int(sStorage->GetOriginalScreenHeight());
+
+        return result;
+    }
+
+    uint8 properties = 0;
+    if (EqualString(dot + 1, L"x", true))
+        properties = EXPR_DEP_X;
+    else if (EqualString(dot + 1, L"y", true))
+        properties = EXPR_DEP_Y;
+
+    // unknown property is always zero
+    if (!properties || dot == name)
+        return result;
+
+    ExpressionInstruction ins;
+    ins.opcode = EXOP_PUSH_REF;
+    ins.operand.asInt = 0;
+    ins.operand.asSlot = GetReferenceSlot(std::wstring(name, dot - name), properties);
+    code.push_back(ins);
+
+    result.constant = false;
+    return result;
+}
+
+ExpressionProgram::Operand ExpressionProgram::CompileChain(ExpressionTreeElement* node, std::vector<ExpressionInstruction> &code)
+{
+    MathOperation op = node->operation;
+    uint32 codeStart = code.size();
+
+    // addition and multiplication do not depend on order, so all constants of chain are folded into one
+    ExpressionValue folded = ExpressionValue::Int(0);
+    bool hasFolded = false;
+    bool hasRuntime = false;
+    bool runtimeFloat = false;
+
+    std::vector<ExpressionInstruction> itemCode;
+    for (uint32 i = 0; i < node->items.size(); i++)
+    {
+        itemCode.clear();
+        Operand item = CompileNode(node->items[i], itemCode);
+
+        if (item.constant)
+        {
+            folded = hasFolded ? ExpressionValue::Apply(op, folded, item.value) : item.value;
+            hasFolded = true;
+            continue;
+        }
+
+        if (!hasRuntime)
+        {
+            code.insert(code.end(), itemCode.begin(), itemCode.end());
+            hasRuntime = true;
+            runtimeFloat = item.value.isFloat;
+            continue;
+        }
+
+        // adding negated value is subtraction
+        bool subtract = false;
+        if (op == OP_ADD && (itemCode.back().opcode == EXOP_NEG_INT || itemCode.back().opcode == EXOP_NEG_FLOAT))
+        {
+            itemCode.pop_back();
+            subtract = true;
+        }
+
+        bool isFloat = runtimeFloat || item.value.isFloat;
+        if (isFloat && !runtimeFloat)
+            Emit(code, EXOP_TO_FLOAT);
+
+        code.insert(code.end(), itemCode.begin(), itemCode.end());
+        if (isFloat && !item.value.isFloat)
+            Emit(code, EXOP_TO_FLOAT);
+
+        if (op == OP_MULTIPLY)
+            Emit(code, isFloat ? EXOP_MUL_FLOAT : EXOP_MUL_INT);
+        else if (subtract)
+            Emit(code, isFloat ? EXOP_SUB_FLOAT : EXOP_SUB_INT);
+        else
+            Emit(code, isFloat ? EXOP_ADD_FLOAT : EXOP_ADD_INT);
+
+        runtimeFloat = isFloat;
+    }
+
+    Operand result;
+    result.constant = !hasRuntime;
+    result.value = folded;
+
+    if (!hasRuntime || !hasFolded)
+    {
+        if (hasRuntime)
+            result.value = runtimeFloat ? ExpressionValue::Float(0.0) : ExpressionValue::Int(0);
+        return result;
+    }
+
+    bool isFloat = runtimeFloat || folded.isFloat;
+
+    // multiplication by zero does not need the references at all
+    if (op == OP_MULTIPLY && folded.ToFloat() == 0.0)
+    {
+        code.resize(codeStart);
+        result.constant = true;
+        result.value = isFloat ? ExpressionValue::Float(0.0) : ExpressionValue::Int(0);
+        return result;
+    }
+
+    result.value = isFloat ? ExpressionValue::Float(0.0) : ExpressionValue::Int(0);
+
+    if (isFloat && !runtimeFloat)
+        Emit(code, EXOP_TO_FLOAT);
+
+    // adding zero and multiplying by one changes nothing but type
+    if (folded.ToFloat() == ((op == OP_ADD) ? 0.0 : 1.0))
+        return result;
+
+    EmitPush(code, folded, isFloat);
+    if (op == OP_MULTIPLY)
+        Emit(code, isFloat ? EXOP_MUL_FLOAT : EXOP_MUL_INT);
+    else
+        Emit(code, isFloat ? EXOP_ADD_FLOAT : EXOP_ADD_INT);
+
+    return result;
+}
+
+ExpressionProgram::Operand ExpressionProgram::CompileSequence(ExpressionTreeElement* node, std::vector<ExpressionInstruction> &code)
+{
+    MathOperation op = node->operation;
+
+    // division and modulo are evaluated from left to right, only leading constants could be folded
+    Operand acc = CompileNode(node->items[0], code);
+
+    std::vector<ExpressionInstruction> itemCode;
+    for (uint32 i = 1; i < node->items.size(); i++)
+    {
+        itemCode.clear();
+        Operand item = CompileNode(node->items[i], itemCode);
+
+        if (acc.constant && item.constant)
+        {
+            acc.value = ExpressionValue::Apply(op, acc.value, item.value);
+            continue;
+        }
+
+        bool isFloat = (op == OP_DIVIDE) || acc.value.isFloat || item.value.isFloat;
+
+        if (acc.constant)
+            EmitPush(code, acc.value, isFloat);
+        else if (isFloat && !acc.value.isFloat)
+            Emit(code, EXOP_TO_FLOAT);
+
+        if (item.constant)
+            EmitPush(code, item.value, isFloat);
+        else
+        {
+            code.insert(code.end(), itemCode.begin(), itemCode.end());
+            if (isFloat && !item.value.isFloat)
+                Emit(code, EXOP_TO_FLOAT);
+        }
+
+        if (op == OP_DIVIDE)
+            Emit(code, EXOP_DIV_FLOAT);
+        else
+            Emit(code, isFloat ? EXOP_MOD_FLOAT : EXOP_MOD_INT);
+
+        acc.constant = false;
+        acc.value = isFloat ? ExpressionValue::Float(0.0) : ExpressionValue::Int(0);
+    }
+
+    return acc;
+}
+
+void ExpressionProgram::BindElement(SlideElement* elem, bool instance)
+{
+    for (std::vector<ExpressionReference>::iterator itr = m_references.begin(); itr != m_references.end(); ++itr)
+    {
+        // the first created instance wins, as it's the first one found in active elements
+        if (itr->instance || (!instance && itr->element))
+            continue;
+
+        if (!EqualString(itr->elementId.c_str(), elem->elemId))
+            continue;
+
+        itr->element = elem;
+        itr->instance = instance;
+    }
+}
+
+ExpressionValue ExpressionProgram::Evaluate()
+{
+    if (m_code.empty())
+        return m_constant;
+
+    union
+    {
+        int64 asInt;
+        double asFloat;
+    } stack[EXPRESSION_STACK_MAX];
+    int32 top = -1;
+
+    const ExpressionInstruction* ins = &m_code[0];
+    const ExpressionInstruction* end = ins + m_code.size();
+
+    for ( ; ins != end; ++ins)
+    {
+        switch (ins->opcode)
+        {
+            case EXOP_PUSH_INT:
+                stack[++top].asInt = ins->operand.asInt;
+                break;
+            case EXOP_PUSH_FLOAT:
+                stack[++top].asFloat = ins->operand.asFloat;
+                break;
+            case EXOP_PUSH_REF:
+            {
+                const ExpressionReference* ref = &m_references[ins->operand.asSlot];
+                stack[++top].asInt = ref->element ? int64(ref->element->GetVisiblePosition((ref->properties == EXPR_DEP_X) ? 0 : 1)) : 0;
+                break;
+            }
+            case EXOP_TO_FLOAT:
+                stack[top].asFloat = double(stack[top].asInt);
+                break;
+            case EXOP_NEG_INT:
+                stack[top].asInt = -stack[top].asInt;
+                break;
+            case EXOP_NEG_FLOAT:
+                stack[top].asFloat = -stack[top].asFloat;
+                break;
+            case EXOP_ADD_INT:
+                top--;
+                stack[top].asInt += stack[top+1].asInt;
+                break;
+            case EXOP_ADD_FLOAT:
+                top--;
+                stack[top].asFloat += stack[top+1].asFloat;
+                break;
+            case EXOP_SUB_INT:
+                top--;
+                stack[top].asInt -= stack[top+1].asInt;
+                break;
+            case EXOP_SUB_FLOAT:
+                top--;
+                stack[top].asFloat -= stack[top+1].asFloat;
+                break;
+            case EXOP_MUL_INT:
+                top--;
+                stack[top].asInt *= stack[top+1].asInt;
+                break;
+            case EXOP_MUL_FLOAT:
+                top--;
+                stack[top].asFloat *= stack[top+1].asFloat;
+                break;
+            case EXOP_DIV_FLOAT:
+                top--;
+                if (stack[top+1].asFloat != 0.0)
+                    stack[top].asFloat /= stack[top+1].asFloat;
+                break;
+            case EXOP_MOD_INT:
+                top--;
+                if (stack[top+1].asInt != 0)
+                    stack[top].asInt %= stack[top+1].asInt;
+                break;
+            case EXOP_MOD_FLOAT:
+                top--;
+                if (stack[top+1].asFloat != 0.0)
+                    stack[top].asFloat = fmod(stack[top].asFloat, stack[top+1].asFloat);
+                break;
+        }
+    }
+
+    if (m_resultFloat)
+        return ExpressionValue::Float(stack[0].asFloat);
+
+    return ExpressionValue::Int(stack[0].asInt);
+}
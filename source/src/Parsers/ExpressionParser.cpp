@@ -29,7 +29,8 @@ ExpressionVector* ExpressionParser::Parse(const wchar_t *input)
             en = charEntity(input[j]);
             if (en != EN_UNDEFINED || j == wcslen(input)-1)
             {
-                if (j == wcslen(input)-1)
+                // value at the very end (but not followed by operator or parenthesis there)
+                if (en == EN_UNDEFINED)
                 {
                     wchar_t* val = new wchar_t[j-i+2];
                     wcsncpy(val, &(input[i]), j-i+1);
@@ -96,170 +97,191 @@ bool ExpressionParser::CheckSyntax(ExpressionVector* input)
     return true;
 }
 
-ExpressionTreeElement* ExpressionParser::BuildTree(ExpressionVector *input, uint32 start, uint32 count)
+// Checks, if the expression is enclosed in one pair of parentheses, i.e. "(a+b)", but not "(a)+(b)"
+static bool IsEnclosed(ExpressionVector* input, uint32 start, uint32 count)
 {
-    if (!input || input->empty() || count == 0)
-        return NULL;
+    if (count < 2 || (*input)[start] != ExpressionParser::EN_LEFT_PAR || (*input)[start+count-1] != ExpressionParser::EN_RIGHT_PAR)
+        return false;
 
-    if (count == 1)
-    {
-        if ((*input)[start] == EN_VALUE)
-            return BuildValueElement((*input).getValue(start));
-        else
-            return NULL;
-    }
-    if (count == 2 && ((*input)[start] == EN_PLUS || (*input)[start] == EN_MINUS))
+    int32 deepness = 0;
+    for (uint32 i = start; i < start+count-1; i++)
     {
-        if ((*input)[start+1] == EN_VALUE)
-        {
-            ExpressionTreeElement* tmp = BuildValueElement((*input).getValue(start+1));
-
-            // remain from expression preparsing, does it have to be there anyways?
-            // polarity of single element is decided when parsing addition elements one by one
-            /*if ((*input)[start] == EN_PLUS)
-                tmp->polarity = true;
-            else if ((*input)[start] == EN_MINUS)
-                tmp->polarity = false;*/
+        if ((*input)[i] == ExpressionParser::EN_LEFT_PAR)
+            deepness++;
+        else if ((*input)[i] == ExpressionParser::EN_RIGHT_PAR)
+            deepness--;
 
-            return tmp;
-        }
+        // the first parenthesis was closed before the end
+        if (deepness == 0)
+            return false;
     }
 
-    ExpressionTreeElement* tmp = new ExpressionTreeElement;
-    tmp->valueType = VT_EXPRESSION;
-    tmp->items.clear();
+    return true;
+}
 
-    if (((*input)[start] == EN_MINUS || (*input)[start] == EN_PLUS) && (*input)[start+1] == EN_LEFT_PAR && (*input)[start+count-1] == EN_RIGHT_PAR)
-    {
-        start += 2;
-        count -= 3;
-    }
-    else if ((*input)[start] == EN_LEFT_PAR && (*input)[start+count-1] == EN_RIGHT_PAR)
+// Builds operand of addition and adds it to target; the operand begins with sign, except the first one
+static void AddOperand(ExpressionVector* input, uint32 from, uint32 to, ExpressionTreeElement* target)
+{
+    bool negative = false;
+
+    // signs of addition operands are stored as their polarity
+    if ((*input)[from] == ExpressionParser::EN_PLUS || (*input)[from] == ExpressionParser::EN_MINUS)
     {
-        start += 1;
-        count -= 2;
+        negative = ((*input)[from] == ExpressionParser::EN_MINUS);
+        from++;
     }
 
-    uint32 i;
+    if (from >= to)
+        return;
+
+    ExpressionTreeElement* child = ExpressionParser::BuildTree(input, from, to-from);
+    if (!child)
+        return;
+
+    if (negative)
+        child->polarity = !child->polarity;
+
+    target->items.push_back(child);
+}
+
+// Splits expression by plus and minus on the top level of parentheses to operands of target, returns false if there's none
+// Subtraction is an addition of negative value, so the order of operands does not matter
+static bool SplitAddition(ExpressionVector* input, uint32 start, uint32 count, ExpressionTreeElement* target)
+{
     uint32 lastBreak = start;
     int32 deepness = 0;
 
-    // thanks to saving polarity of every element, it does not depend on the order of addition elements
+    for (uint32 i = start; i < start+count; i++)
+    {
+        ExpressionParser::Entity en = (*input)[i];
 
-    ExpressionTreeElement* child = NULL;
+        if (en == ExpressionParser::EN_LEFT_PAR)
+            deepness++;
+        else if (en == ExpressionParser::EN_RIGHT_PAR)
+            deepness--;
 
-    // at first parse the simple addition elements (only values)
-    for (i = start; i < input->size() && i < start+count; i++)
-    {
-        // if the string doesn't begin with polarity unary operator and we are on the top scope
-        if (i != start && deepness == 0 && ((*input)[i] == EN_PLUS || (*input)[i] == EN_MINUS || (lastBreak != start && (i == input->size()-1 || i == start+count-1)) ))
-        {
-            if (i == input->size()-1 || i == start+count-1)
-            {
-                child = BuildTree(input, lastBreak, i-lastBreak+1);
-                if ((*input)[lastBreak] == EN_MINUS)
-                    child->polarity = false;
+        if (deepness != 0 || i == start)
+            continue;
 
-                tmp->items.push_back(child);
-            }
-            else
-            {
-                child = BuildTree(input, lastBreak, i-lastBreak);
-                if ((*input)[lastBreak] == EN_MINUS)
-                    child->polarity = false;
+        // sign right after another operator or opening parenthesis is unary, not a break
+        ExpressionParser::Entity prev = (*input)[i-1];
+        bool isBreak = (en == ExpressionParser::EN_PLUS || en == ExpressionParser::EN_MINUS)
+                    && ExpressionParser::entityCathegory(prev) != ExpressionParser::EC_OPERATOR && prev != ExpressionParser::EN_LEFT_PAR;
 
-                tmp->items.push_back(child);
-            }
+        if (!isBreak)
+            continue;
 
-            lastBreak = i;
-        }
+        AddOperand(input, lastBreak, i, target);
+        lastBreak = i;
+    }
 
-        if ((*input)[i] == EN_LEFT_PAR)
-            deepness++;
+    if (lastBreak == start)
+        return false;
 
-        if ((*input)[i] == EN_RIGHT_PAR)
+    AddOperand(input, lastBreak, start+count, target);
+    return true;
+}
+
+// Splits expression by the last multiplication, division or modulo on the top level of parentheses, returns false if there's none
+// All three have the same priority and are evaluated from left to right, so everything before the last one is its left operand
+static bool SplitMultiplication(ExpressionVector* input, uint32 start, uint32 count, ExpressionTreeElement* target)
+{
+    uint32 lastBreak = start;
+    int32 deepness = 0;
+
+    for (uint32 i = start; i < start+count; i++)
+    {
+        ExpressionParser::Entity en = (*input)[i];
+
+        if (en == ExpressionParser::EN_LEFT_PAR)
+            deepness++;
+        else if (en == ExpressionParser::EN_RIGHT_PAR)
             deepness--;
+
+        if (deepness != 0 || i == start)
+            continue;
+
+        if (en == ExpressionParser::EN_MULT || en == ExpressionParser::EN_DIV || en == ExpressionParser::EN_MODULO)
+            lastBreak = i;
     }
 
-    // If parser already found some dividable elements, we won't care about them anymore, call the operation "addition", and parse inner expressions
-    if (lastBreak != start)
-        tmp->operation = OP_ADD;
-    else
+    if (lastBreak == start)
+        return false;
+
+    switch ((*input)[lastBreak])
     {
-        for (i = start; i < input->size() && i < start+count; i++)
-        {
-            // if the string doesn't begin with polarity unary operator and we are on the top scope
-            if (i != start && deepness == 0 && ((*input)[i] == EN_MULT || (lastBreak != start && (i == input->size()-1 || i == start+count-1))))
-            {
-                if (i == input->size()-1 || i == start+count-1)
-                    tmp->items.push_back(BuildTree(input, lastBreak+1, i-lastBreak));
-                else
-                    tmp->items.push_back(BuildTree(input, lastBreak, i-lastBreak));
+        case ExpressionParser::EN_MULT:
+            target->operation = OP_MULTIPLY;
+            break;
+        case ExpressionParser::EN_DIV:
+            target->operation = OP_DIVIDE;
+            break;
+        default:
+            target->operation = OP_MODULO;
+            break;
+    }
 
-                lastBreak = i;
-            }
+    ExpressionTreeElement* left = ExpressionParser::BuildTree(input, start, lastBreak-start);
+    if (left)
+        target->items.push_back(left);
 
-            if ((*input)[i] == EN_LEFT_PAR)
-                deepness++;
+    ExpressionTreeElement* right = ExpressionParser::BuildTree(input, lastBreak+1, start+count-lastBreak-1);
+    if (right)
+        target->items.push_back(right);
 
-            if ((*input)[i] == EN_RIGHT_PAR)
-                deepness--;
-        }
+    return true;
+}
 
-        if (lastBreak != start)
-            tmp->operation = OP_MULTIPLY;
+ExpressionTreeElement* ExpressionParser::BuildTree(ExpressionVector *input, uint32 start, uint32 count)
+{
+    if (!input || input->empty() || count == 0)
+        return NULL;
+
+    if (count == 1)
+    {
+        if ((*input)[start] == EN_VALUE)
+            return BuildValueElement((*input).getValue(start));
         else
+            return NULL;
+    }
+    if (count == 2 && ((*input)[start] == EN_PLUS || (*input)[start] == EN_MINUS))
+    {
+        if ((*input)[start+1] == EN_VALUE)
         {
-            for (i = start; i < input->size() && i < start+count; i++)
-            {
-                // if the string doesn't begin with polarity unary operator and we are on the top scope
-                if (i != start && deepness == 0 && ((*input)[i] == EN_MODULO || (lastBreak != start && (i == input->size()-1 || i == start+count-1))))
-                {
-                    if (i == input->size()-1 || i == start+count-1)
-                        tmp->items.push_back(BuildTree(input, lastBreak+1, i-lastBreak));
-                    else
-                        tmp->items.push_back(BuildTree(input, lastBreak, i-lastBreak));
-
-                    lastBreak = i;
-                }
+            ExpressionTreeElement* tmp = BuildValueElement((*input).getValue(start+1));
 
-                if ((*input)[i] == EN_LEFT_PAR)
-                    deepness++;
+            // operands of addition come here without sign, so this is only unary sign, i.e. "-a*b"
+            if (tmp && (*input)[start] == EN_MINUS)
+                tmp->polarity = false;
 
-                if ((*input)[i] == EN_RIGHT_PAR)
-                    deepness--;
-            }
-
-            if (lastBreak != start)
-                tmp->operation = OP_MODULO;
-            else
-            {
-                for (i = start; i < input->size() && i < start+count; i++)
-                {
-                    // if the string doesn't begin with polarity unary operator and we are on the top scope
-                    if (i != start && deepness == 0 && ((*input)[i] == EN_DIV || (lastBreak != start && (i == input->size()-1 || i == start+count-1))))
-                    {
-                        if (i == input->size()-1 || i == start+count-1)
-                            tmp->items.push_back(BuildTree(input, lastBreak+1, i-lastBreak));
-                        else
-                            tmp->items.push_back(BuildTree(input, lastBreak, i-lastBreak));
+            return tmp;
+        }
+    }
 
-                        lastBreak = i;
-                    }
+    // expression in parentheses (with optional sign) is the inner expression itself
+    uint32 innerStart = start;
+    if ((*input)[start] == EN_MINUS || (*input)[start] == EN_PLUS)
+        innerStart++;
 
-                    if ((*input)[i] == EN_LEFT_PAR)
-                        deepness++;
+    if (IsEnclosed(input, innerStart, start+count-innerStart))
+    {
+        ExpressionTreeElement* inner = BuildTree(input, innerStart+1, start+count-innerStart-2);
+        if (inner && (*input)[start] == EN_MINUS)
+            inner->polarity = !inner->polarity;
 
-                    if ((*input)[i] == EN_RIGHT_PAR)
-                        deepness--;
-                }
+        return inner;
+    }
 
-                if (lastBreak != start)
-                    tmp->operation = OP_DIVIDE;
-            }
+    ExpressionTreeElement* tmp = new ExpressionTreeElement;
+    tmp->valueType = VT_EXPRESSION;
+    tmp->items.clear();
 
-        }
-    }
+    // thanks to saving polarity of every element, it does not depend on the order of addition elements
+    // operators with the lowest priority are split first, so the ones with higher priority end up deeper in tree
+    if (SplitAddition(input, start, count, tmp))
+        tmp->operation = OP_ADD;
+    else if (!SplitMultiplication(input, start, count, tmp))
+        tmp->operation = OP_ADD;
 
     return tmp;
 }
@@ -332,6 +354,18 @@ ValueType ExprTreeElem::getEvaluableType()
     return VT_STRING;
 }
 
+void ExprTreeElem::GetReferences(std::vector<const wchar_t*> &output)
+{
+    if (valueType == VT_STRING)
+    {
+        output.push_back(value.asString);
+        return;
+    }
+
+    for (uint32 i = 0; i < items.size(); i++)
+        items[i]->GetReferences(output);
+}
+
 void ExprTreeElem::SimplifyChildren()
 {
     if (items.empty())
@@ -528,9 +528,12 @@ SlideElement* SlideParser::ParseElement(const wchar_t *input, uint8* special, wc
 
         tmp->typeText.text = right;
 
-        GetPositionDefinitionKeyValue(&defs, L"P", &tmp->position[0], &tmp->position[1]);
-        tmp->finalPosition[0] = tmp->position[0];
-        tmp->finalPosition[1] = tmp->position[1];
+        GetPositionDefinitionKeyValue(&defs, L"P", &tmp->positionSpec[0], &tmp->positionSpec[1]);
+        for (uint32 i = 0; i <= 1; i++)
+        {
+            tmp->position[i] = float(tmp->positionSpec[i]);
+            tmp->finalPosition[i] = tmp->positionSpec[i];
+        }
 
         tmp->typeText.depth = 0;
         if (const wchar_t* depth = GetDefinitionKeyValue(&defs, L"D"))
@@ -611,7 +614,9 @@ SlideElement* SlideParser::ParseElement(const wchar_t *input, uint8* special, wc
         tmp->elemStyle = GetDefinitionKeyValue(&defs, L"S");
         tmp->elemEffect = GetDefinitionKeyValue(&defs, L"E");
 
-        GetPositionDefinitionKeyValue(&defs, L"P", &tmp->position[0], &tmp->position[1]);
+        GetPositionDefinitionKeyValue(&defs, L"P", &tmp->positionSpec[0], &tmp->positionSpec[1]);
+        tmp->position[0] = float(tmp->positionSpec[0]);
+        tmp->position[1] = float(tmp->positionSpec[1]);
         GetPositionDefinitionKeyValue(&defs, L"V", (int32*)&tmp->typeImage.size[0], (int32*)&tmp->typeImage.size[1]); // we can make explicit conversion to int32* since range won't exceed
 
         ResourceEntry* res = sStorage->GetResource(right);
@@ -685,50 +690,78 @@ SlideElement* SlideParser::ParseElement(const wchar_t *input, uint8* special, wc
         tmp = new SlideElement;
         tmp->elemType = SLIDE_ELEM_NEW_SLIDE;
         tmp->typeNewSlide.type = SST_NONE;
+        tmp->typeNewSlide.moveAngle = 0.0f;
+        tmp->typeNewSlide.effectTimer = 0;
+        tmp->typeNewSlide.effProgress = EP_LINEAR;
+        tmp->typeNewSlide.effect = NULL;
 
         if (right)
             left = LeftSide(right, L' ');
 
         if (left && right)
         {
-            if (EqualString(left, L"FADE", true))
-            {
-                // canvas effect --> colorize 100% opacity, delete elements, move on, decolorize
+            SlideSwitchType switchType = SST_NONE;
 
-                tmp->elemType = SLIDE_ELEM_CANVAS_EFFECT;
+            if (EqualString(left, L"FADE", true))
+                switchType = SST_FADE;
+            else if (EqualString(left, L"MOVE", true))
+                switchType = SST_MOVE;
+            else if (EqualString(left, L"DISPERSE", true))
+                switchType = SST_DISPERSE;
+
+            // parameters in any order:
+            //   progress curve (linear, sinus, ease-in-out, cubic-bezier(..), ..)
+            //   first number is timer [ms], second number is move angle [degrees] (only for move)
+            //   color (only for fade) - fade through color instead of crossfading slides
+            uint32 effTimer = 0;
+            uint8 progress = EP_LINEAR;
+            float angle = 0.0f;
+            bool timerSet = false;
+            uint32 color = 0;
+            bool colorSet = false;
 
-                tmp->typeCanvasEffect.hard = true;
-                tmp->typeCanvasEffect.effectType = CE_COLORIZE;
-                tmp->typeCanvasEffect.effectTimer = 0;
-                tmp->typeCanvasEffect.effProgress = EP_LINEAR;
+            right = RightSide(right, L' ');
+            while (right)
+            {
+                left = LeftSide(right, L' ');
 
-                uint32 effTimer = 0;
-                uint8 progress = EP_LINEAR;
+                uint8 curve = sEasing->ParseCurve(left);
 
-                right = RightSide(right, L' ');
-                while (right)
+                if (curve != EP_INVALID)
+                    progress = curve;
+                else if (IsNumeric(left))
                 {
-                    left = LeftSide(right, L' ');
-
-                    if (EqualString(left, L"quadratic", true))
-                        progress = EP_QUADRATIC;
-                    else if (EqualString(left, L"sinus", true))
-                        progress = EP_SINUS;
-                    else if (EqualString(left, L"linear", true))
-                        progress = EP_LINEAR;
-                    else if (IsNumeric(left))
+                    if (!timerSet)
+                    {
                         effTimer = ToInt(left);
+                        timerSet = true;
+                    }
                     else
+                        angle = (float)ToInt(left);
+                }
+                else
+                {
+                    if (switchType == SST_FADE && StyleParser::ParseColor(left, &color))
                     {
-                        if (StyleParser::ParseColor(left, &tmp->typeCanvasEffect.amount.asUnsigned))
-                            tmp->typeCanvasEffect.amount.asUnsigned |= COLOR_A(255);
-                        else
-                            RAISE_ERROR_NULL("SlideParser: invalid input '%S' in new slide definition", left);
+                        color |= COLOR_A(255);
+                        colorSet = true;
                     }
-
-                    right = RightSide(right, L' ');
+                    else
+                        RAISE_ERROR_NULL("SlideParser: invalid input '%S' in new slide definition", left);
                 }
 
+                right = RightSide(right, L' ');
+            }
+
+            if (switchType == SST_FADE && colorSet)
+            {
+                // canvas effect --> colorize 100% opacity, delete elements, move on, decolorize
+
+                tmp->elemType = SLIDE_ELEM_CANVAS_EFFECT;
+
+                tmp->typeCanvasEffect.hard = true;
+                tmp->typeCanvasEffect.effectType = CE_COLORIZE;
+                tmp->typeCanvasEffect.amount.asUnsigned = color;
                 tmp->typeCanvasEffect.effProgress = progress;
                 tmp->typeCanvasEffect.effectTimer = effTimer;
 
@@ -751,22 +784,23 @@ SlideElement* SlideParser::ParseElement(const wchar_t *input, uint8* special, wc
 
                 sStorage->AddSlideElement(tmp);
 
+                // the slides were already switched behind the color, so no transition is needed anymore
                 tmp = new SlideElement;
                 tmp->elemType = SLIDE_ELEM_NEW_SLIDE;
-                tmp->typeNewSlide.type = SST_FADE;
+                tmp->typeNewSlide.type = SST_NONE;
+                tmp->typeNewSlide.moveAngle = 0.0f;
+                tmp->typeNewSlide.effectTimer = 0;
+                tmp->typeNewSlide.effProgress = EP_LINEAR;
+                tmp->typeNewSlide.effect = NULL;
 
                 return tmp;
             }
-            else if (EqualString(left, L"MOVE", true))
-            {
-                // create fake effect for every element on slide to allow generic reverting
-                tmp->typeNewSlide.type = SST_MOVE;
-            }
-            else if (EqualString(left, L"DISPERSE", true))
-            {
-                // same as move --> move every element to different direction
-                tmp->typeNewSlide.type = SST_DISPERSE;
-            }
+
+            // crossfade, move and disperse are done by capturing old slide into texture and compositing it over the new one
+            tmp->typeNewSlide.type = switchType;
+            tmp->typeNewSlide.effectTimer = effTimer;
+            tmp->typeNewSlide.effProgress = progress;
+            tmp->typeNewSlide.moveAngle = angle;
         }
 
         return tmp;
@@ -785,7 +819,7 @@ SlideElement* SlideParser::ParseElement(const wchar_t *input, uint8* special, wc
         return tmp;
     }
     // play canvas effect - move, rotate, scale
-    else if (EqualString(left, L"\\CANVAS_MOVE", true) || EqualString(left, L"\\CANVAS_ROTATE", true) || EqualString(left, L"\\CANVAS_SCALE", true) || EqualString(left, L"\\CANVAS_RESET", true) || EqualString(left, L"\\CANVAS_COLORIZE", true))
+    else if (EqualString(left, L"\\CANVAS_MOVE", true) || EqualString(left, L"\\CANVAS_ROTATE", true) || EqualString(left, L"\\CANVAS_SCALE", true) || EqualString(left, L"\\CANVAS_RESET", true) || EqualString(left, L"\\CANVAS_COLORIZE", true) || EqualString(left, L"\\CANVAS_BLUR", true))
     {
         tmp = new SlideElement;
         tmp->elemType = SLIDE_ELEM_CANVAS_EFFECT;
@@ -868,6 +902,22 @@ SlideElement* SlideParser::ParseElement(const wchar_t *input, uint8* special, wc
             // and put there our implicit value
             tmp->typeCanvasEffect.amount.asUnsigned |= 0x40;
         }
+        else if (EqualString(left, L"\\CANVAS_BLUR", true))
+        {
+            tmp->typeCanvasEffect.effectType = CE_BLUR;
+
+            // parameter sequence:
+            // 1. blur radius [px] (i.e. 8), 0 to remove blur
+            // 2. effect timer [ms]
+            // 3. any other definitions in any order
+
+            left = LeftSide(right, L' ');
+
+            if (!IsNumeric(left))
+                RAISE_ERROR_NULL("SlideParser: invalid radius value '%S' in canvas blur definition", left?ToMultiByteString(left):"");
+
+            tmp->typeCanvasEffect.amount.asFloat = (float)ToInt(left);
+        }
         else if (EqualString(left, L"\\CANVAS_RESET", true))
         {
             tmp->typeCanvasEffect.effectType = CE_RESET;
@@ -890,14 +940,12 @@ SlideElement* SlideParser::ParseElement(const wchar_t *input, uint8* special, wc
                 left = LeftSide(right, L' ');
                 if (left)
                 {
+                    uint8 curve = sEasing->ParseCurve(left);
+
                     if (EqualString(left, L"hard", true))
                         tmp->typeCanvasEffect.hard = true;
-                    else if (EqualString(left, L"linear", true))
-                        tmp->typeCanvasEffect.effProgress = EP_LINEAR;
-                    else if (EqualString(left, L"sinus", true))
-                        tmp->typeCanvasEffect.effProgress = EP_SINUS;
-                    else if (EqualString(left, L"quadratic", true))
-                        tmp->typeCanvasEffect.effProgress = EP_QUADRATIC;
+                    else if (curve != EP_INVALID)
+                        tmp->typeCanvasEffect.effProgress = curve;
                     else if (IsNumeric(left))
                     {
                         if (tmp->typeCanvasEffect.effectType == CE_COLORIZE)
@@ -1065,15 +1113,17 @@ void SlideParser::ParseMarkup(const wchar_t *input, const wchar_t* stylename, St
                     if (tmp->colorize)
                         tmp->color = (*(defstyle->fontColor));
 
-                    tmp->text = new wchar_t[j-i-1];
-                    memset(tmp->text, 0, sizeof(wchar_t)*(j-i-1));
+                    // the buffer is later used for formatted result of expression
+                    uint32 textLen = (j-i-1 > STYLED_EXPRESSION_TEXT_LEN) ? j-i-1 : STYLED_EXPRESSION_TEXT_LEN;
+                    tmp->text = new wchar_t[textLen];
+                    memset(tmp->text, 0, sizeof(wchar_t)*textLen);
                     wcsncpy(tmp->text, &(input[i+2]), j-i-2);
 
                     target->push_back(tmp);
 
                     ExpressionVector* exvec = ExpressionParser::Parse(tmp->text);
+                    // constants are folded later, when the expression is compiled
                     ExpressionTreeElement* elmnt = ExpressionParser::BuildTree(exvec, 0, exvec->size());
-                    elmnt->SimplifyChildren();
                     ((*exmap)[target->size()-1]) = *elmnt;
 
                     i = j+1;
@@ -55,9 +55,8 @@ bool StyleParser::Parse(std::vector<std::wstring> *input)
             {
                 tmp->fontFamily = right;
 
-                // And set "flag" for generate a new font
-                if (tmp->fontId >= 0)
-                    tmp->fontId = -2;
+                // font is built later, after OpenGL init
+                sStorage->RequestStyleFont(tmp);
             }
             // font size in pixels
             else if (EqualString(left, L"\\FONT_SIZE", true))
@@ -67,8 +66,7 @@ bool StyleParser::Parse(std::vector<std::wstring> *input)
                 else
                     RAISE_ERROR("StyleParser: Non-numeric value '%s' used as font size", (right)?ToMultiByteString(right):"none");
 
-                if (tmp->fontId >= 0)
-                    tmp->fontId = -2;
+                sStorage->RequestStyleFont(tmp);
             }
             // font color
             else if (EqualString(left, L"\\FONT_COLOR", true))
@@ -79,8 +77,8 @@ bool StyleParser::Parse(std::vector<std::wstring> *input)
                 else
                     RAISE_ERROR("StyleParser: Invalid expression '%s' used as font color", (right)?ToMultiByteString(right):"none");
 
-                if (tmp->fontId >= 0)
-                    tmp->fontId = -2;
+                // style with any font property gets its own font, missing family and size are the default ones
+                sStorage->RequestStyleFont(tmp);
             }
             // color overlay
             else if (EqualString(left, L"\\COLOR_OVERLAY", true))
@@ -204,6 +204,21 @@ bool SupfileParser::Parse(std::vector<std::wstring>* input)
             else
                 sStorage->AllowFullscreen(true);
         }
+        // blur computed on CPU even with working textures, i.e. for headless tests
+        else if (EqualString(left, L"\\CPU_BLUR", true))
+        {
+            if (right && wcslen(right) > 0)
+            {
+                if (EqualString(right, L"OFF", true) || EqualString(right, L"NO", true))
+                    sStorage->ForceCPUBlur(false);
+                else if (EqualString(right, L"ON", true) || EqualString(right, L"YES", true))
+                    sStorage->ForceCPUBlur(true);
+                else
+                    RAISE_ERROR("SupfileParser: unknown token '%S' supplied as CPU blur parameter", right);
+            }
+            else
+                sStorage->ForceCPUBlur(true);
+        }
         // slide files
         else if (EqualString(left, L"\\SLIDES", true))
         {
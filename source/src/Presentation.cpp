@@ -1,6 +1,18 @@
 #include "Presentation.h"
 #include "Application.h"
+#include "Handlers/DrawBatch.h"
+#include "Handlers/PostProcess.h"
+#include "Handlers/AnimationSystem.h"
+#include "Handlers/Profiler.h"
+#include "Handlers/GlyphAtlas.h"
+#include "Handlers/FontRegistry.h"
 #include <ctime>
+#include <cstdio>
+#include <algorithm>
+
+#ifdef _WIN32
+  #define snprintf _snprintf
+#endif
 
 #ifdef _WIN32
 LRESULT CALLBACK MyWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -13,6 +25,8 @@ PresentationMgr::PresentationMgr()
 {
     m_slideElementPos = 0;
     m_slideElement = NULL;
+    m_frame = 0;
+    m_benchmarkPending = false;
     SetBlocking(false);
 
     m_btEnabled = false;
@@ -21,16 +35,19 @@ PresentationMgr::PresentationMgr()
 
     memset(&bgData, 0, sizeof(BackgroundData));
 
-    canvas.baseCoord = CVector2(0.0f, 0.0f);
-    canvas.baseAngle = 0.0f;
-    canvas.baseScale = 100.0f;
-    canvas.baseColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
+    staticCache.displayList = 0;
+    staticCache.count = 0;
+    staticCache.styleGeneration = 0;
+    staticCache.screenSize[0] = 0;
+    staticCache.screenSize[1] = 0;
+    staticCache.atlasGeneration = 0;
+    staticCache.valid = false;
 
-    canvas.hardBlur = 0.0f;
-    canvas.hardMove = CVector2(0.0f,0.0f);
-    canvas.hardRotateAngle = 0.0f;
-    canvas.hardScale = 100.0f;
-    canvas.hardColorizeColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
+    transition.type = SST_NONE;
+    transition.captured = false;
+    transition.moveAngle = 0.0f;
+
+    ResetCanvas();
 }
 
 /////
@@ -90,17 +107,22 @@ bool PresentationMgr::Init()
     sSimplyFlat->Interface->HookMouseEvent(MouseButtonPress);
 
     // Default font will be Arial, normal, size 25px
-    sStorage->SetDefaultFontId(sSimplyFlat->BuildFont("Arial", 25));
+    sStorage->SetDefaultFontId(sFontRegistry->GetFont(L"Arial", 25, 0));
 
-    if (sStorage->GetDefaultFontId() < 0)
+    // SimplyFlat draws with default font whenever it cannot use the other one, so it's rendered right away
+    // It has to be rendered after OGL init, because of using some of OGL functions to render
+    if (sStorage->GetDefaultFontId() < 0 || sFontRegistry->GetSimplyFlatFont(sStorage->GetDefaultFontId()) < 0)
         RAISE_ERROR("Could not initialize default font!");
 
-    // Here we initialize fonts which come with styles
-    // They have to be rendered and saved after OGL init, because of using some of OGL functions to render
+    // Here we register fonts which come with styles, SimplyFlat renders them only when it has to draw with them
     sStorage->BuildStyleFonts();
 
     sStorage->SetupDefaultStyle();
 
+    // blur on CPU was requested (i.e. for headless tests), so it's checked before the presentation starts
+    if (sStorage->IsCPUBlurForced() && !sPostProcess->ForceCPUFallback())
+        RAISE_ERROR("Could not initialize CPU blur!");
+
     sStorage->PostParseElements();
 
     // Here we have to load all resources
@@ -266,6 +288,34 @@ void PresentationMgr::HandleExternalMessage(char* msg, uint8 len)
     {
         MoveBack(true);
     }
+    // Statistics of the last frame, sent back to network client
+    else if (EqualString(msg, "STATS"))
+    {
+        char report[512];
+        uint32 reportLen = sProfiler->FormatReport(report, 512);
+
+        if (m_client != 0 && m_client != INVALID_SOCKET)
+            send(m_client, report, reportLen, 0);
+    }
+    // Comparison of expression tree walker with compiled expressions, answered once the presentation is idle
+    else if (EqualString(msg, "BENCHEXPR"))
+    {
+        m_benchmarkPending = true;
+    }
+    // State of current step at given time since its start, in the same units as effect timers
+    else if (len > 5 && strncmp(msg, "SEEK ", 5) == 0)
+    {
+        SeekStep(uint32(atoi(msg + 5)));
+    }
+    // Fonts resident in memory, and glyph atlas usage
+    else if (EqualString(msg, "FONTS"))
+    {
+        char report[256];
+        uint32 reportLen = sFontRegistry->FormatReport(report, 256);
+
+        if (m_client != 0 && m_client != INVALID_SOCKET)
+            send(m_client, report, reportLen, 0);
+    }
 }
 
 void PresentationMgr::MoveBack(bool hard)
@@ -360,6 +410,15 @@ void PresentationMgr::MoveBack(bool hard)
     m_slideElementPos -= posDelta;
     m_slideElement = (*lastActual);
 
+    // elements are going to be rolled back, cached geometry does not correspond to them anymore
+    InvalidateStaticCache();
+
+    // and also stop any running transition
+    transition.type = SST_NONE;
+
+    std::vector<SlideElement*> effectTargets;
+    bool canvasChanged = false;
+
     for ( ; oldLast != lastActual && oldLast != m_activeElements.end() &&  oldLast != m_activeElements.begin(); oldLast--)
     {
         if (!(*oldLast))
@@ -371,6 +430,7 @@ void PresentationMgr::MoveBack(bool hard)
             bgData.color = 0;
             bgData.resourceId = 0;
             bgData.source = NULL;
+            bgData.cached = false;
             for (uint32 i = 0; i <= 1; i++)
             {
                 bgData.backgroundDimensions[i] = 0;
@@ -383,247 +443,248 @@ void PresentationMgr::MoveBack(bool hard)
                     ApplyBackgroundElement(*it);
             }
         }
-        // roll back effect queue on slide elements
+        // effects played on elements and canvas effects are evaluated again from the new position
         else if ((*oldLast)->elemType == SLIDE_ELEM_PLAY_EFFECT)
         {
-            for (SlideList::iterator it = m_activeElements.begin(); it != m_activeElements.end(); ++it)
-                if (EqualString((*it)->elemId, (*oldLast)->elemId) && (*it)->myEffect)
-                    (*it)->myEffect->RollBackLastQueued();
+            SlideElement* target = GetActiveElementById((*oldLast)->elemId);
+            if (target && std::find(effectTargets.begin(), effectTargets.end(), target) == effectTargets.end())
+                effectTargets.push_back(target);
         }
-        // roll back canvas effects
         else if ((*oldLast)->elemType == SLIDE_ELEM_CANVAS_EFFECT)
-        {
-            switch ((*oldLast)->typeCanvasEffect.effectType)
+            canvasChanged = true;
+    }
+
+    for (std::vector<SlideElement*>::iterator itr = effectTargets.begin(); itr != effectTargets.end(); ++itr)
+        EvaluateElementEffects(*itr, lastActual);
+
+    if (canvasChanged)
+        EvaluateCanvas(lastActual);
+
+    // blocking element with timer set has to be set again
+    if (m_slideElement->elemType == SLIDE_ELEM_BLOCK && m_slideElement->typeBlock.time != 0)
+        m_slideElement->typeBlock.startTime = clock();
+
+    SetBlocking(sStorage->IsSlideElementBlocking(m_slideElement, true));
+}
+
+void PresentationMgr::ResetCanvas()
+{
+    canvas.baseCoord = CVector2(0.0f, 0.0f);
+    canvas.baseAngle = 0.0f;
+    canvas.baseScale = 100.0f;
+    canvas.baseBlur = 0.0f;
+    canvas.baseColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
+
+    canvas.hardBlur = 0.0f;
+    canvas.hardMove = CVector2(0.0f,0.0f);
+    canvas.hardRotateAngle = 0.0f;
+    canvas.hardScale = 100.0f;
+    canvas.hardColorizeColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
+
+    canvas.hardRotateCenter[0] = 0;
+    canvas.hardRotateCenter[1] = 0;
+
+    EffectTime finished = {0, 0, EP_LINEAR};
+    canvas.hardMove_time = finished;
+    canvas.hardRotate_time = finished;
+    canvas.hardScale_time = finished;
+    canvas.hardBlur_time = finished;
+    canvas.hardColorize_time = finished;
+}
+
+void PresentationMgr::ApplyCanvasEffect(SlideElement* elem, clock_t startTime)
+{
+    switch (elem->typeCanvasEffect.effectType)
+    {
+        case CE_RESET:
+            if (elem->typeCanvasEffect.hard || elem->typeCanvasEffect.effectTimer == 0)
             {
-                case CE_RESET:
-                {
-                    canvas.baseCoord = CVector2(0,0);
-                    canvas.hardMove = CVector2(0,0);
-                    canvas.baseAngle = 0.0f;
-                    canvas.hardRotateAngle = 0.0f;
-                    canvas.baseScale = 100.0f;
-                    canvas.hardScale = 100.0f;
-                    canvas.baseColor = MAKE_COLOR_RGBA(255,255,255,0);
-                    canvas.hardColorizeColor = canvas.baseColor;
-
-                    bool move = false, rotate = false, scale = false, colorize = false;
-                    SlideList::iterator it = oldLast;
-                    if (it != m_activeElements.begin())
-                        --it;
-                    CVector2 modVector(0,0);
-                    float modRotate = 0.0f, frst = 0.0f;
-                    for ( ; it != m_activeElements.begin(); --it)
-                    {
-                        if ((*it)->elemType != SLIDE_ELEM_CANVAS_EFFECT)
-                            continue;
+                canvas.baseCoord = CVector2(0.0f, 0.0f);
+                canvas.baseAngle = 0.0f;
+                canvas.baseScale = 100.0f;
+                canvas.baseBlur = 0.0f;
+                canvas.baseColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
+
+                canvas.hardMove = CVector2(0.0f, 0.0f);
+                canvas.hardRotateAngle = 0.0f;
+                canvas.hardScale = 100.0f;
+                canvas.hardBlur = 0.0f;
+                canvas.hardColorizeColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
+                break;
+            }
 
-                        if (!move && (*it)->typeCanvasEffect.effectType == CE_MOVE)
-                        {
-                            if ((*it)->typeCanvasEffect.hard)
-                            {
-                                canvas.baseCoord = CVector2(0,0);
-                                canvas.hardMove = modVector + (*it)->typeCanvasEffect.moveVector;
-                                move = true;
-                                continue;
-                            }
-                            else
-                                modVector = modVector + (*it)->typeCanvasEffect.moveVector;
-                        }
+            canvas.baseCoord  = canvas.baseCoord + canvas.hardMove;
+            canvas.baseAngle += canvas.hardRotateAngle;
+            canvas.baseScale  = canvas.hardScale;
+            canvas.baseBlur   = canvas.hardBlur;
+            canvas.baseColor  = canvas.hardColorizeColor;
+
+            canvas.hardMove = -canvas.baseCoord;
+            canvas.hardRotateAngle = -canvas.baseAngle;
+            canvas.hardScale = 100.0f;
+            canvas.hardBlur = 0.0f;
+            canvas.hardColorizeColor &= 0xFFFFFF00;
+
+            canvas.hardMove_time.startTime = startTime;
+            canvas.hardMove_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardMove_time.progressType = elem->typeCanvasEffect.effProgress;
+            canvas.hardRotate_time.startTime = startTime;
+            canvas.hardRotate_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardRotate_time.progressType = elem->typeCanvasEffect.effProgress;
+            canvas.hardScale_time.startTime = startTime;
+            canvas.hardScale_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardScale_time.progressType = elem->typeCanvasEffect.effProgress;
+            canvas.hardBlur_time.startTime = startTime;
+            canvas.hardBlur_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardBlur_time.progressType = elem->typeCanvasEffect.effProgress;
+            canvas.hardColorize_time.startTime = startTime;
+            canvas.hardColorize_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardColorize_time.progressType = elem->typeCanvasEffect.effProgress;
+            break;
+        case CE_MOVE:
+            if (!elem->typeCanvasEffect.hard)
+                canvas.baseCoord = canvas.hardMove;
+            else
+                canvas.baseCoord = CVector2(0.0f, 0.0f);
 
-                        if (!rotate && (*it)->typeCanvasEffect.effectType == CE_ROTATE)
-                        {
-                            if ((*it)->typeCanvasEffect.hard)
-                            {
-                                if (frst == 0)
-                                {
-                                    canvas.baseAngle = 0.0f;
-                                    canvas.hardRotateAngle = (*it)->typeCanvasEffect.amount.asFloat;
-                                }
-                                else
-                                {
-                                    canvas.baseAngle = modRotate + (*it)->typeCanvasEffect.amount.asFloat;
-                                    canvas.hardRotateAngle = frst;
-                                }
-                                rotate = true;
-                                continue;
-                            }
-                            else
-                            {
-                                if (frst == 0)
-                                    frst = (*it)->typeCanvasEffect.amount.asFloat;
-                                else
-                                    modRotate += (*it)->typeCanvasEffect.amount.asFloat;
-                            }
-                        }
+            canvas.hardMove = elem->typeCanvasEffect.moveVector;
+            canvas.hardMove_time.startTime = startTime;
+            canvas.hardMove_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardMove_time.progressType = elem->typeCanvasEffect.effProgress;
+            break;
+        case CE_ROTATE:
+            if (!elem->typeCanvasEffect.hard)
+                canvas.baseAngle = canvas.hardRotateAngle;
+            else
+                canvas.baseAngle = 0.0f;
 
-                        if (!scale && (*it)->typeCanvasEffect.effectType == CE_SCALE)
-                        {
-                            canvas.baseScale = (*it)->typeCanvasEffect.amount.asFloat;
-                            canvas.hardScale = (*it)->typeCanvasEffect.amount.asFloat;
-                            scale = true;
-                            continue;
-                        }
+            canvas.hardRotateAngle = elem->typeCanvasEffect.amount.asFloat;
+            canvas.hardRotate_time.startTime = startTime;
+            canvas.hardRotate_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardRotate_time.progressType = elem->typeCanvasEffect.effProgress;
 
-                        if (!colorize && (*it)->typeCanvasEffect.effectType == CE_COLORIZE)
-                        {
-                            //canvas.baseColor = (*it)->typeCanvasEffect.amount.asUnsigned;
-                            canvas.hardColorizeColor = (*it)->typeCanvasEffect.amount.asUnsigned;
-                            colorize = true;
-                            continue;
-                        }
+            canvas.hardRotateCenter[0] = (int32)elem->typeCanvasEffect.moveVector.x;
+            canvas.hardRotateCenter[1] = (int32)elem->typeCanvasEffect.moveVector.y;
+            break;
+        case CE_SCALE:
+            if (!elem->typeCanvasEffect.hard)
+                canvas.baseScale = canvas.hardScale;
+            else
+                canvas.baseScale = 100.0f;
 
-                        if (move && rotate && scale && colorize)
-                            break;
-                    }
+            canvas.hardScale = elem->typeCanvasEffect.amount.asFloat;
+            canvas.hardScale_time.startTime = startTime;
+            canvas.hardScale_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardScale_time.progressType = elem->typeCanvasEffect.effProgress;
+            break;
+        case CE_BLUR:
+            if (!elem->typeCanvasEffect.hard)
+                canvas.baseBlur = canvas.hardBlur;
+            else
+                canvas.baseBlur = 0.0f;
 
-                    if (!move)
-                    {
-                        canvas.baseCoord = CVector2(0,0);
-                        canvas.hardMove = modVector;
-                    }
-                    if (!rotate)
-                    {
-                        canvas.baseAngle = modRotate;
-                        canvas.hardRotateAngle = frst;
-                    }
+            canvas.hardBlur = elem->typeCanvasEffect.amount.asFloat;
+            canvas.hardBlur_time.startTime = startTime;
+            canvas.hardBlur_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardBlur_time.progressType = elem->typeCanvasEffect.effProgress;
+            break;
+        case CE_COLORIZE:
+            if (!elem->typeCanvasEffect.hard)
+                canvas.baseColor = canvas.hardColorizeColor;
+            else
+                canvas.baseColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
 
-                    break;
-                }
-                case CE_MOVE:
-                {
-                    if ((*oldLast)->typeCanvasEffect.hard)
-                    {
-                        SlideList::iterator it = oldLast;
-                        if (it != m_activeElements.begin())
-                            --it;
-                        CVector2 modVector(0,0);
-                        for ( ; it != m_activeElements.begin(); --it)
-                        {
-                            if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_MOVE)
-                            {
-                                if ((*it)->typeCanvasEffect.hard)
-                                {
-                                    modVector = modVector + (*it)->typeCanvasEffect.moveVector;
-                                    break;
-                                }
-                                else
-                                    modVector = modVector + (*it)->typeCanvasEffect.moveVector;
-                            }
-                            else if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_RESET)
-                                break;
-                        }
-                        canvas.baseCoord = CVector2(0,0);
-                        canvas.hardMove  = modVector;
-                    }
-                    else
-                    {
-                        canvas.baseCoord = CVector2(0,0);
-                        canvas.hardMove  = canvas.hardMove - (*oldLast)->typeCanvasEffect.moveVector;
-                    }
-                    break;
-                }
-                case CE_ROTATE:
-                {
-                    SlideList::iterator it = oldLast;
-                    if (it != m_activeElements.begin())
-                        --it;
-                    float mod = 0.0f, frst = 0.0f;
-                    bool foundCheckpoint = false, foundSecond = false;
-                    for ( ; it != m_activeElements.begin(); --it)
-                    {
-                        if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_ROTATE)
-                        {
-                            if ((*it)->typeCanvasEffect.hard)
-                            {
-                                mod += (*it)->typeCanvasEffect.amount.asFloat;
-                                break;
-                            }
-                            else
-                            {
-                                if (!(*oldLast)->typeCanvasEffect.hard)
-                                {
-                                    canvas.baseAngle -= (*it)->typeCanvasEffect.amount.asFloat;
-                                    canvas.hardRotateAngle = (*it)->typeCanvasEffect.amount.asFloat;
-                                    foundCheckpoint = true;
-                                }
-                                else
-                                {
-                                    if (frst == 0)
-                                        frst = (*it)->typeCanvasEffect.amount.asFloat;
-                                    else
-                                        mod += (*it)->typeCanvasEffect.amount.asFloat;
-                                }
-                            }
-                        }
-                        else if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_RESET)
-                            break;
-                    }
-                    // mod is 0 only when reached hard effect
-                    if ((*oldLast)->typeCanvasEffect.hard || mod != 0.0f)
-                    {
-                        canvas.baseAngle = mod;
-                        canvas.hardRotateAngle = frst;
-                    }
-                    if (!(*oldLast)->typeCanvasEffect.hard && !foundCheckpoint)
-                    {
-                        canvas.baseAngle = 0.0f;
-                        canvas.hardRotateAngle = 0.0f;
-                    }
-                    break;
-                }
-                case CE_SCALE:
-                {
-                    // doesn't matter if it's hard change or not
-
-                    canvas.baseScale = 100.0f;
-                    canvas.hardScale = 100.0f;
-                    SlideList::iterator it = lastActual;
-                    if (it != m_activeElements.begin())
-                        --it;
-                    for ( ; it != m_activeElements.begin(); --it)
-                    {
-                        if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_SCALE)
-                        {
-                            canvas.baseScale = (*it)->typeCanvasEffect.amount.asFloat;
-                            canvas.hardScale = (*it)->typeCanvasEffect.amount.asFloat;
-                            break;
-                        }
-                        else if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_RESET)
-                            break;
-                    }
-                    break;
-                }
-                case CE_COLORIZE:
-                {
-                    // doesn't matter if it's hard change or not
-
-                    canvas.baseColor = MAKE_COLOR_RGBA(255,255,255,0);
-                    canvas.hardColorizeColor = canvas.baseColor;
-                    SlideList::iterator it = lastActual;
-                    if (it != m_activeElements.begin())
-                        --it;
-                    for ( ; it != m_activeElements.begin(); --it)
-                    {
-                        if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_COLORIZE)
-                        {
-                            canvas.baseColor = (*it)->typeCanvasEffect.amount.asUnsigned;
-                            canvas.hardColorizeColor = (*it)->typeCanvasEffect.amount.asUnsigned;
-                            break;
-                        }
-                        else if ((*it)->elemType == SLIDE_ELEM_CANVAS_EFFECT && (*it)->typeCanvasEffect.effectType == CE_RESET)
-                            break;
-                    }
-                    break;
-                }
+            canvas.hardColorizeColor = elem->typeCanvasEffect.amount.asUnsigned;
+            canvas.hardColorize_time.startTime = startTime;
+            canvas.hardColorize_time.deltaTime = elem->typeCanvasEffect.effectTimer;
+            canvas.hardColorize_time.progressType = elem->typeCanvasEffect.effProgress;
+            break;
+        // others are NYI
+        default:
+            break;
+    }
+}
+
+void PresentationMgr::EvaluateCanvas(SlideList::iterator last, uint32 elapsed)
+{
+    // canvas state is given only by canvas effects up to the position, all of them are finished
+    ResetCanvas();
+
+    if (last == m_activeElements.end())
+        return;
+
+    SlideList::iterator end = last;
+    ++end;
+
+    for (SlideList::iterator itr = m_activeElements.begin(); itr != end; ++itr)
+    {
+        if ((*itr)->elemType != SLIDE_ELEM_CANVAS_EFFECT)
+            continue;
+
+        uint32 timer = (*itr)->typeCanvasEffect.effectTimer;
+        if (itr == last && elapsed < timer)
+            timer = elapsed;
+
+        ApplyCanvasEffect(*itr, clock() - clock_t(timer));
+    }
+}
+
+void PresentationMgr::EvaluateElementEffects(SlideElement* elem, SlideList::iterator last, uint32 elapsed)
+{
+    // element state is given by its own effect and all effects played on it up to the position, all of them are finished
+    // except the ones started at the position itself, when the time since its start is given
+    elem->ResetEffects();
+
+    Effect* seeked = NULL;
+    bool queued = false;
+
+    if (last != m_activeElements.end())
+    {
+        SlideList::iterator end = last;
+        ++end;
+
+        for (SlideList::iterator itr = m_activeElements.begin(); itr != end; ++itr)
+        {
+            if ((*itr)->elemType != SLIDE_ELEM_PLAY_EFFECT || GetActiveElementById((*itr)->elemId) != elem)
+                continue;
+
+            if (itr == last && elapsed != STEP_ELAPSED_FINISHED)
+            {
+                seeked = sStorage->GetEffect((*itr)->elemEffect);
+                queued = (elem->myEffect != NULL);
             }
+
+            elem->PlayEffect((*itr)->elemEffect);
         }
+
+        // element appearing at the position plays its own effect
+        if ((*last) == elem && elapsed != STEP_ELAPSED_FINISHED && elem->myEffect)
+            seeked = elem->myEffect->getEffectProto();
     }
 
-    // blocking element with timer set has to be set again
-    if (m_slideElement->elemType == SLIDE_ELEM_BLOCK && m_slideElement->typeBlock.time != 0)
-        m_slideElement->typeBlock.startTime = clock();
+    elem->SeekEffects(seeked, queued, elapsed);
+}
 
-    SetBlocking(sStorage->IsSlideElementBlocking(m_slideElement, true));
+void PresentationMgr::SeekStep(uint32 elapsed)
+{
+    if (lastActual == m_activeElements.end() || !(*lastActual))
+        return;
+
+    SlideElement* step = (*lastActual);
+
+    // elements are going to be evaluated again, cached geometry does not correspond to them anymore
+    InvalidateStaticCache();
+
+    if (step->elemType == SLIDE_ELEM_PLAY_EFFECT)
+    {
+        SlideElement* target = GetActiveElementById(step->elemId);
+        if (target)
+            EvaluateElementEffects(target, lastActual, elapsed);
+    }
+    else if (step->elemType == SLIDE_ELEM_CANVAS_EFFECT)
+        EvaluateCanvas(lastActual, elapsed);
+    else if (step->myEffect)
+        EvaluateElementEffects(step, lastActual, elapsed);
 }
 
 SlideElement* PresentationMgr::GetActiveElementById(const wchar_t* id)
@@ -690,80 +751,62 @@ void PresentationMgr::Run()
         }
 #endif
 
+        sProfiler->BeginFrame();
+
         if (sStorage->IsNetworkEnabled())
             UpdateNetwork();
 
         suppressPostAction = false;
         suppressPostBlocking = false;
 
-        // Rebuild fonts if needed- sometimes a font change occurs. This will lead fontId to be set to -2
-        // this handler iterates through all the styles and check whether fontId is -2. If yes, it will build the font
-        sStorage->BuildStyleFonts();
+        // Fonts are registered only when some style asks for it (parsed or changed style sets fontId to -2 and queues itself),
+        // and only then the markup waiting for them is parsed again, rendering is left to atlas workers
+        if (sStorage->HasPendingFonts())
+            sStorage->BuildStyleFonts();
 
         // SF before draw events
         sSimplyFlat->BeforeDraw();
 
+        // update all interpolated animations at once, only the drawn elements are animated
+        MarkActiveElements();
+        uint64 animateStart = FrameProfiler::GetTime();
+        sAnimation->Update(clock(), m_frame);
+        EffectHandler::AddAnimateTime(uint32(FrameProfiler::GetTime() - animateStart));
+
+        // capture outgoing slide, if there is some transition running
+        if (transition.type != SST_NONE && !transition.captured)
+            CaptureSlideTransition();
+
         // At first, draw battleground and stuff
-        sSimplyFlat->Drawing->ClearColor(COLOR_R(bgData.color),COLOR_G(bgData.color),COLOR_B(bgData.color));
-        if (bgData.resourceId > 0)
-        {
-            ResourceEntry* res = sStorage->GetResource(bgData.resourceId);
-            if (res && res->image)
-                sSimplyFlat->Drawing->DrawRectangle(bgData.backgroundPosition[0], bgData.backgroundPosition[1], bgData.backgroundDimensions[0], bgData.backgroundDimensions[1], 0, res->image->textureId);
-        }
-        if (bgData.source)
-        {
-            GradientData** ptr = &bgData.source->typeBackground.gradients[0];
-            if (bgData.source->typeBackground.gradientEdges)
-            {
-                if (ptr[GRAD_TOP])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(0,0,sStorage->GetOriginalScreenWidth(), ptr[GRAD_TOP]->size, ptr[GRAD_TOP]->color | 0xFF, ptr[GRAD_TOP]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_BOTTOM);
-                if (ptr[GRAD_BOTTOM])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(0,sStorage->GetOriginalScreenHeight()-ptr[GRAD_BOTTOM]->size, sStorage->GetOriginalScreenWidth(), ptr[GRAD_BOTTOM]->size, ptr[GRAD_BOTTOM]->color | 0xFF, ptr[GRAD_BOTTOM]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_TOP);
-                if (ptr[GRAD_LEFT])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(0,0, ptr[GRAD_LEFT]->size, sStorage->GetOriginalScreenHeight(), ptr[GRAD_LEFT]->color | 0xFF, ptr[GRAD_LEFT]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_RIGHT);
-                if (ptr[GRAD_RIGHT])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(sStorage->GetOriginalScreenWidth()-ptr[GRAD_RIGHT]->size, 0, ptr[GRAD_RIGHT]->size, sStorage->GetOriginalScreenHeight(), ptr[GRAD_RIGHT]->color | 0xFF, ptr[GRAD_RIGHT]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_LEFT);
-            }
-            else
-            {
-                // There should be only one gradient set
-                // if there are more than one gradient set, it's users fault and we are going to draw all of them
-
-                if (ptr[GRAD_TOP])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(0,0,sStorage->GetOriginalScreenWidth(), sStorage->GetOriginalScreenHeight(), ptr[GRAD_TOP]->color | 0xFF, bgData.color | 0xFF, VERT_BOTTOM);
-                if (ptr[GRAD_BOTTOM])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(0,0,sStorage->GetOriginalScreenWidth(), sStorage->GetOriginalScreenHeight(), ptr[GRAD_BOTTOM]->color | 0xFF, bgData.color | 0xFF, VERT_TOP);
-                if (ptr[GRAD_LEFT])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(0,0,sStorage->GetOriginalScreenWidth(), sStorage->GetOriginalScreenHeight(), ptr[GRAD_LEFT]->color | 0xFF, bgData.color | 0xFF, VERT_RIGHT);
-                if (ptr[GRAD_RIGHT])
-                    sSimplyFlat->Drawing->DrawRectangleGradient(0,0,sStorage->GetOriginalScreenWidth(), sStorage->GetOriginalScreenHeight(), ptr[GRAD_RIGHT]->color | 0xFF, bgData.color | 0xFF, VERT_LEFT);
-            }
-        }
+        DrawBackground();
 
         // Perform canvas effects like movement and rotation
         AnimateCanvas(true);
 
         // draw active elements which should be drawn
-        for (SlideList::iterator itr = firstActual; itr != m_activeElements.end(); ++itr)
-        {
-            // "drawable" parameter is set when building slide element prototype
-            if ((*itr)->drawable)
-                (*itr)->Draw();
+        DrawActiveElements();
 
-            if (itr == lastActual)
-                break;
-        }
+        // submit all batched element quads, while the canvas transformation is still set
+        sDrawBatch->Flush();
 
         // Perform canvas effects after drawing like colorize and blur
         AnimateCanvas(false);
 
+        // And put the outgoing slide over everything, if the transition is still running
+        DrawSlideTransition();
+
         // SF after draw events
         sSimplyFlat->AfterDraw();
 
+        sProfiler->EndFrame();
+
         // If something blocked our presentation, let's wait for some event to unblock it. It should be unblocked in PresentationMgr::InterfaceEvent
         if (IsBlocking())
         {
+            // nobody sees the stall, when the screen does not change
+            if (m_benchmarkPending && IsIdle())
+                RunPendingBenchmark();
+
             // timer block
             if (m_slideElement && m_slideElement->elemType == SLIDE_ELEM_BLOCK && m_slideElement->typeBlock.time != 0 && m_slideElement->typeBlock.startTime + m_slideElement->typeBlock.time <= clock())
                 SetBlocking(false);
@@ -863,105 +906,16 @@ void PresentationMgr::Run()
             case SLIDE_ELEM_NEW_SLIDE:
             {
                 // new slide causes firstActual iterator to point at the same element as lastActual
+                SlideList::iterator oldFirst = firstActual;
                 firstActual = lastActual;
+
+                if (m_slideElement->typeNewSlide.type != SST_NONE)
+                    StartSlideTransition(m_slideElement, oldFirst, firstActual);
                 break;
             }
             case SLIDE_ELEM_CANVAS_EFFECT:
-            {
-                switch (m_slideElement->typeCanvasEffect.effectType)
-                {
-                    case CE_RESET:
-                        if (m_slideElement->typeCanvasEffect.hard || m_slideElement->typeCanvasEffect.effectTimer == 0)
-                        {
-                            canvas.baseCoord = CVector2(0.0f, 0.0f);
-                            canvas.baseAngle = 0.0f;
-                            canvas.baseScale = 100.0f;
-                            canvas.baseColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
-
-                            canvas.hardMove = CVector2(0.0f, 0.0f);
-                            canvas.hardRotateAngle = 0.0f;
-                            canvas.hardScale = 100.0f;
-                            canvas.hardColorizeColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
-                            break;
-                        }
-
-                        canvas.baseCoord  = canvas.baseCoord + canvas.hardMove;
-                        canvas.baseAngle += canvas.hardRotateAngle;
-                        canvas.baseScale  = canvas.hardScale;
-                        canvas.baseColor  = canvas.hardColorizeColor;
-
-                        canvas.hardMove = -canvas.baseCoord;
-                        canvas.hardRotateAngle = -canvas.baseAngle;
-                        canvas.hardScale = 100.0f;
-                        canvas.hardColorizeColor &= 0xFFFFFF00;
-
-                        canvas.hardMove_time.startTime = clock();
-                        canvas.hardMove_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardMove_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-                        canvas.hardRotate_time.startTime = clock();
-                        canvas.hardRotate_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardRotate_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-                        canvas.hardScale_time.startTime = clock();
-                        canvas.hardScale_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardScale_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-                        canvas.hardColorize_time.startTime = clock();
-                        canvas.hardColorize_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardColorize_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-                        break;
-                    case CE_MOVE:
-                        if (!m_slideElement->typeCanvasEffect.hard)
-                            canvas.baseCoord = canvas.hardMove;
-                        else
-                            canvas.baseCoord = CVector2(0.0f, 0.0f);
-
-                        canvas.hardMove = m_slideElement->typeCanvasEffect.moveVector;
-                        canvas.hardMove_time.startTime = clock();
-                        canvas.hardMove_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardMove_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-                        break;
-                    case CE_ROTATE:
-                        if (!m_slideElement->typeCanvasEffect.hard)
-                            canvas.baseAngle = canvas.hardRotateAngle;
-                        else
-                            canvas.baseAngle = 0.0f;
-
-                        canvas.hardRotateAngle = m_slideElement->typeCanvasEffect.amount.asFloat;
-                        canvas.hardRotate_time.startTime = clock();
-                        canvas.hardRotate_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardRotate_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-
-                        canvas.hardRotateCenter[0] = (int32)m_slideElement->typeCanvasEffect.moveVector.x;
-                        canvas.hardRotateCenter[1] = (int32)m_slideElement->typeCanvasEffect.moveVector.y;
-                        break;
-                    case CE_SCALE:
-                        if (!m_slideElement->typeCanvasEffect.hard)
-                            canvas.baseScale = canvas.hardScale;
-                        else
-                            canvas.baseScale = 100.0f;
-
-                        canvas.hardScale = m_slideElement->typeCanvasEffect.amount.asFloat;
-                        canvas.hardScale_time.startTime = clock();
-                        canvas.hardScale_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardScale_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-                        break;
-                    case CE_COLORIZE:
-                        if (!m_slideElement->typeCanvasEffect.hard)
-                            canvas.baseColor = canvas.hardColorizeColor;
-                        else
-                            canvas.baseColor = MAKE_COLOR_RGBA(255, 255, 255, 0);
-
-                        canvas.hardColorizeColor = m_slideElement->typeCanvasEffect.amount.asUnsigned;
-                        canvas.hardColorize_time.startTime = clock();
-                        canvas.hardColorize_time.deltaTime = m_slideElement->typeCanvasEffect.effectTimer;
-                        canvas.hardColorize_time.progressType = m_slideElement->typeCanvasEffect.effProgress;
-                        break;
-                    // others are NYI
-                    default:
-                        break;
-                }
-
+                ApplyCanvasEffect(m_slideElement, clock());
                 break;
-            }
             default:
                 break;
         }
@@ -973,12 +927,291 @@ void PresentationMgr::Run()
 #endif
 }
 
+void PresentationMgr::DrawBackground()
+{
+    // resolution changed since last render, the cached image would be stretched
+    if (bgData.cached && (m_backgroundCapture.GetWidth() != sStorage->GetScreenWidth() || m_backgroundCapture.GetHeight() != sStorage->GetScreenHeight()))
+        bgData.cached = false;
+
+    if (!bgData.cached && !RenderBackgroundCache())
+    {
+        // texture could not be created, so we have to compose background every frame
+        ComposeBackground();
+        sDrawBatch->Flush();
+        return;
+    }
+
+    // background is opaque and covers whole screen
+    m_backgroundCapture.AddToBatch(0, 0, (float)sStorage->GetOriginalScreenWidth(), (float)sStorage->GetOriginalScreenHeight(),
+                                   MAKE_COLOR_RGBA(255,255,255,255), 0.0f, 0.0f, 1.0f, 1.0f, BATCH_BLEND_NONE);
+
+    // background is not affected by canvas effects, so it has to be submitted before them
+    sDrawBatch->Flush();
+}
+
+bool PresentationMgr::RenderBackgroundCache()
+{
+    if (!m_backgroundCapture.Prepare(sStorage->GetScreenWidth(), sStorage->GetScreenHeight()))
+        return false;
+
+    // compose background to the back buffer and store it, the frame will overdraw it anyway
+    glPushMatrix();
+    glLoadIdentity();
+
+    ComposeBackground();
+    sDrawBatch->Flush();
+
+    glPopMatrix();
+
+    m_backgroundCapture.Capture();
+    bgData.cached = true;
+
+    return true;
+}
+
+void PresentationMgr::ComposeBackground()
+{
+    sSimplyFlat->Drawing->ClearColor(COLOR_R(bgData.color),COLOR_G(bgData.color),COLOR_B(bgData.color));
+    if (bgData.resourceId > 0)
+    {
+        ResourceEntry* res = sStorage->GetResource(bgData.resourceId);
+        if (res && res->image)
+            sDrawBatch->AddQuad((float)bgData.backgroundPosition[0], (float)bgData.backgroundPosition[1], (float)bgData.backgroundDimensions[0], (float)bgData.backgroundDimensions[1], MAKE_COLOR_RGBA(255,255,255,255), res->image->textureId);
+    }
+    if (bgData.source)
+    {
+        GradientData** ptr = &bgData.source->typeBackground.gradients[0];
+        float width = (float)sStorage->GetOriginalScreenWidth();
+        float height = (float)sStorage->GetOriginalScreenHeight();
+        if (bgData.source->typeBackground.gradientEdges)
+        {
+            if (ptr[GRAD_TOP])
+                sDrawBatch->AddGradientQuad(0, 0, width, (float)ptr[GRAD_TOP]->size, ptr[GRAD_TOP]->color | 0xFF, ptr[GRAD_TOP]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_BOTTOM);
+            if (ptr[GRAD_BOTTOM])
+                sDrawBatch->AddGradientQuad(0, height-ptr[GRAD_BOTTOM]->size, width, (float)ptr[GRAD_BOTTOM]->size, ptr[GRAD_BOTTOM]->color | 0xFF, ptr[GRAD_BOTTOM]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_TOP);
+            if (ptr[GRAD_LEFT])
+                sDrawBatch->AddGradientQuad(0, 0, (float)ptr[GRAD_LEFT]->size, height, ptr[GRAD_LEFT]->color | 0xFF, ptr[GRAD_LEFT]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_RIGHT);
+            if (ptr[GRAD_RIGHT])
+                sDrawBatch->AddGradientQuad(width-ptr[GRAD_RIGHT]->size, 0, (float)ptr[GRAD_RIGHT]->size, height, ptr[GRAD_RIGHT]->color | 0xFF, ptr[GRAD_RIGHT]->color | MAKE_COLOR_RGBA(0,0,0,0), VERT_LEFT);
+        }
+        else
+        {
+            // There should be only one gradient set
+            // if there are more than one gradient set, it's users fault and we are going to draw all of them
+
+            if (ptr[GRAD_TOP])
+                sDrawBatch->AddGradientQuad(0, 0, width, height, ptr[GRAD_TOP]->color | 0xFF, bgData.color | 0xFF, VERT_BOTTOM);
+            if (ptr[GRAD_BOTTOM])
+                sDrawBatch->AddGradientQuad(0, 0, width, height, ptr[GRAD_BOTTOM]->color | 0xFF, bgData.color | 0xFF, VERT_TOP);
+            if (ptr[GRAD_LEFT])
+                sDrawBatch->AddGradientQuad(0, 0, width, height, ptr[GRAD_LEFT]->color | 0xFF, bgData.color | 0xFF, VERT_RIGHT);
+            if (ptr[GRAD_RIGHT])
+                sDrawBatch->AddGradientQuad(0, 0, width, height, ptr[GRAD_RIGHT]->color | 0xFF, bgData.color | 0xFF, VERT_LEFT);
+        }
+    }
+}
+
+void PresentationMgr::MarkActiveElements()
+{
+    m_frame++;
+
+    SlideList::iterator endActual = lastActual;
+    if (endActual != m_activeElements.end())
+        ++endActual;
+
+    for (SlideList::iterator itr = firstActual; itr != endActual && itr != m_activeElements.end(); ++itr)
+        (*itr)->activeFrame = m_frame;
+}
+
+void PresentationMgr::DrawActiveElements()
+{
+    SlideList::iterator endActual = lastActual;
+    if (endActual != m_activeElements.end())
+        ++endActual;
+
+    // find the sequence of static elements from the beginning of slide
+    SlideList::iterator itr = firstActual;
+    uint32 staticCount = 0;
+    for ( ; itr != endActual && (*itr)->IsStatic(); ++itr)
+        staticCount++;
+
+    if (staticCount > 0)
+    {
+        if (!staticCache.valid || staticCache.first != firstActual || staticCache.count != staticCount
+            || staticCache.styleGeneration != sStorage->GetStyleGeneration()
+            || staticCache.screenSize[0] != sStorage->GetScreenWidth() || staticCache.screenSize[1] != sStorage->GetScreenHeight()
+            || staticCache.atlasGeneration != sGlyphAtlas->GetGeneration())
+        {
+            // atlas could be reset while drawing the list, then it's built again in the next frame
+            staticCache.atlasGeneration = sGlyphAtlas->GetGeneration();
+
+            if (staticCache.displayList == 0)
+                staticCache.displayList = glGenLists(1);
+
+            // everything batched so far belongs outside of the list
+            sDrawBatch->Flush();
+
+            glNewList(staticCache.displayList, GL_COMPILE);
+            for (SlideList::iterator it = firstActual; it != itr; ++it)
+            {
+                // "drawable" parameter is set when building slide element prototype
+                if ((*it)->drawable)
+                    (*it)->Draw();
+            }
+            sDrawBatch->Flush();
+            glEndList();
+
+            staticCache.first = firstActual;
+            staticCache.count = staticCount;
+            staticCache.styleGeneration = sStorage->GetStyleGeneration();
+            staticCache.screenSize[0] = sStorage->GetScreenWidth();
+            staticCache.screenSize[1] = sStorage->GetScreenHeight();
+            staticCache.valid = true;
+        }
+
+        glCallList(staticCache.displayList);
+    }
+
+    // and draw the rest as usual
+    for ( ; itr != endActual; ++itr)
+    {
+        if ((*itr)->drawable)
+            (*itr)->Draw();
+    }
+}
+
+void PresentationMgr::StartSlideTransition(SlideElement* elem, SlideList::iterator oldFirst, SlideList::iterator oldEnd)
+{
+    if (!elem || elem->elemType != SLIDE_ELEM_NEW_SLIDE || elem->typeNewSlide.effectTimer == 0)
+        return;
+
+    transition.type = elem->typeNewSlide.type;
+    transition.first = oldFirst;
+    transition.end = oldEnd;
+    transition.captured = false;
+    transition.moveAngle = elem->typeNewSlide.moveAngle;
+    transition.time.deltaTime = elem->typeNewSlide.effectTimer;
+    transition.time.progressType = elem->typeNewSlide.effProgress;
+    transition.time.startTime = clock();
+}
+
+void PresentationMgr::CaptureSlideTransition()
+{
+    // The outgoing slide is drawn once more to the back buffer and copied to texture.
+    // Background and canvas state still belongs to outgoing slide, since the new slide element has just been processed
+    if (!m_transitionCapture.Prepare(sStorage->GetScreenWidth(), sStorage->GetScreenHeight()))
+    {
+        transition.type = SST_NONE;
+        return;
+    }
+
+    glPushMatrix();
+
+    DrawBackground();
+    AnimateCanvas(true);
+
+    for (SlideList::iterator itr = transition.first; itr != transition.end && itr != m_activeElements.end(); ++itr)
+    {
+        if ((*itr)->drawable)
+            (*itr)->Draw();
+    }
+    sDrawBatch->Flush();
+
+    AnimateCanvas(false);
+
+    glPopMatrix();
+
+    m_transitionCapture.Capture();
+
+    // and clear after ourselves, the new slide will be drawn from scratch
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    transition.captured = true;
+    transition.time.startTime = clock();
+}
+
+void PresentationMgr::DrawSlideTransition()
+{
+    if (transition.type == SST_NONE || !transition.captured)
+        return;
+
+    float timeCoef = 1.0f;
+    if (transition.time.deltaTime > 0)
+        timeCoef = float(clock() - transition.time.startTime) / float(transition.time.deltaTime);
+
+    if (timeCoef >= 1.0f)
+    {
+        transition.type = SST_NONE;
+        m_transitionCapture.Invalidate();
+        return;
+    }
+    else if (timeCoef < 0.0f)
+        timeCoef = 0.0f;
+
+    EffectHandler::CalculateEffectProgress(timeCoef, transition.time.progressType);
+
+    // opacity of the outgoing slide, some curves may overshoot
+    float fade = 1.0f - timeCoef;
+    if (fade < 0.0f)
+        fade = 0.0f;
+    else if (fade > 1.0f)
+        fade = 1.0f;
+
+    float width = (float)sStorage->GetOriginalScreenWidth();
+    float height = (float)sStorage->GetOriginalScreenHeight();
+    float diagonal = sqrt(width*width + height*height);
+
+    switch (transition.type)
+    {
+        case SST_FADE:
+        {
+            m_transitionCapture.AddToBatch(0, 0, width, height, MAKE_COLOR_RGBA(255, 255, 255, uint8(255.0f*fade)));
+            break;
+        }
+        case SST_MOVE:
+        {
+            // move the whole old slide away in specified direction
+            float angle = transition.moveAngle * float(M_PI) / 180.0f;
+            m_transitionCapture.AddToBatch(cos(angle) * diagonal * timeCoef, sin(angle) * diagonal * timeCoef, width, height,
+                                           MAKE_COLOR_RGBA(255, 255, 255, 255), 0.0f, 0.0f, 1.0f, 1.0f, BATCH_BLEND_NONE);
+            break;
+        }
+        case SST_DISPERSE:
+        {
+            // split the old slide to tiles, every tile flies away from the center of screen and fades out
+            float tileWidth = width / float(TRANSITION_DISPERSE_COLUMNS);
+            float tileHeight = height / float(TRANSITION_DISPERSE_ROWS);
+            uint8 alpha = uint8(255.0f*fade);
+
+            for (uint32 i = 0; i < TRANSITION_DISPERSE_COLUMNS; i++)
+            {
+                for (uint32 j = 0; j < TRANSITION_DISPERSE_ROWS; j++)
+                {
+                    CVector2 dir((i + 0.5f)*tileWidth - width/2.0f, (j + 0.5f)*tileHeight - height/2.0f);
+                    dir.unitMultiply(diagonal * timeCoef);
+
+                    m_transitionCapture.AddToBatch(i*tileWidth + dir.x, j*tileHeight + dir.y, tileWidth, tileHeight,
+                                                   MAKE_COLOR_RGBA(255, 255, 255, alpha),
+                                                   float(i) / float(TRANSITION_DISPERSE_COLUMNS), float(j) / float(TRANSITION_DISPERSE_ROWS),
+                                                   1.0f / float(TRANSITION_DISPERSE_COLUMNS), 1.0f / float(TRANSITION_DISPERSE_ROWS));
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    sDrawBatch->Flush();
+}
+
 void PresentationMgr::ApplyBackgroundElement(SlideElement* elem)
 {
     if (!elem || elem->elemType != SLIDE_ELEM_BACKGROUND)
         return;
 
     bgData.source = elem;
+    bgData.cached = false;
 
     if (elem->typeBackground.imageResourceId > 0)
         bgData.resourceId = elem->typeBackground.imageResourceId;
@@ -1022,80 +1255,47 @@ void PresentationMgr::ApplyBackgroundElement(SlideElement* elem)
     }
 }
 
+int64 PresentationMgr::EvaluateExpression(ExpressionProgram* program, ExpressionTreeElement* expr)
+{
+    if (program)
+        return program->Evaluate().ToInt();
+
+    return NumerateExpression(expr);
+}
+
 int64 PresentationMgr::NumerateExpression(ExpressionTreeElement* expr)
+{
+    return WalkExpression(expr).ToInt();
+}
+
+ExpressionValue PresentationMgr::WalkExpression(ExpressionTreeElement* expr)
 {
     // This function MUSTN'T touch anything in expression tree element supplied as it's a pointer to shared memory
 
-    if (!expr)
-        return 0;
+    ExpressionValue result = ExpressionValue::Int(0);
 
-    int64 tmpval = 0;
+    if (!expr)
+        return result;
 
     // if element value is string, we can only return real value as integer in the same tree element
     if (expr->valueType == VT_STRING)
-    {
-        tmpval = GetElementReferenceValue(expr->value.asString);
-        return (tmpval*((expr->polarity)?1:(-1)));
-    }
+        result = ExpressionValue::Int(GetElementReferenceValue(expr->value.asString));
     else if (expr->valueType == VT_INTEGER)
-        return (expr->value.asLong*((expr->polarity)?1:(-1)));
+        result = ExpressionValue::Int(expr->value.asLong);
     else if (expr->valueType == VT_FLOAT)
-        return ((int64)expr->value.asDouble*((expr->polarity)?1:(-1)));
-
-    if (expr->items.empty())
-        return 0;
-
-    tmpval = NumerateExpression(expr->items[0]);
-
-    for (uint32 i = 1; i < expr->items.size(); i++)
+        result = ExpressionValue::Float(expr->value.asDouble);
+    else if (!expr->items.empty())
     {
-        switch (expr->operation)
-        {
-            case OP_ADD:
-            {
-                if (expr->items[i]->valueType == VT_INTEGER)
-                    tmpval += expr->items[i]->value.asLong;
-                else
-                    tmpval += (int64)expr->items[i]->value.asDouble;
-                break;
-            }
-            case OP_MULTIPLY:
-            {
-                if (expr->items[i]->valueType == VT_INTEGER)
-                    tmpval *= expr->items[i]->value.asLong;
-                else
-                    tmpval *= (int64)expr->items[i]->value.asDouble;
-                break;
-            }
-            case OP_DIVIDE:
-            {
-                if (expr->items[i]->valueType == VT_INTEGER)
-                {
-                    if (expr->items[i]->value.asLong != 0)
-                        tmpval /= expr->items[i]->value.asLong;
-                }
-                else
-                {
-                    if (expr->items[i]->value.asDouble != 0)
-                        tmpval /= (int64)expr->items[i]->value.asDouble;
-                }
-                break;
-            }
-            case OP_MODULO:
-            {
-                // modulo is applicable only on integer types
-                // TODO for future: round floating values if modulo is requested, or throw an error
-                if (expr->items[i]->valueType == VT_INTEGER)
-                {
-                    if (expr->items[i]->value.asLong != 0)
-                        tmpval %= expr->items[i]->value.asLong;
-                }
-                break;
-            }
-        }
+        // every operand may be expression again, the arithmetics is the same as in compiled expressions
+        result = WalkExpression(expr->items[0]);
+        for (uint32 i = 1; i < expr->items.size(); i++)
+            result = ExpressionValue::Apply(expr->operation, result, WalkExpression(expr->items[i]));
     }
 
-    return tmpval;
+    if (!expr->polarity)
+        result = ExpressionValue::Negate(result);
+
+    return result;
 }
 
 int64 PresentationMgr::GetElementReferenceValue(wchar_t *input)
@@ -1110,39 +1310,137 @@ int64 PresentationMgr::GetElementReferenceValue(wchar_t *input)
     if (!left)
         return 0;
 
+    int64 result = 0;
+
     // parsing non-object value
     if (!right)
     {
         if (EqualString(left, L"width", true))
-            return sStorage->GetOriginalScreenWidth();
+            result = sStorage->GetOriginalScreenWidth();
         else if (EqualString(left, L"height", true))
-            return sStorage->GetOriginalScreenHeight();
+            result = sStorage->GetOriginalScreenHeight();
+    }
+    else
+    {
+        SlideElement* tmp = NULL;
+        for (SlideList::iterator itr = m_activeElements.begin(); itr != m_activeElements.end(); ++itr)
+        {
+            if (EqualString((*itr)->elemId, left))
+            {
+                tmp = (*itr);
+                break;
+            }
+        }
 
-        return 0;
+        if (!tmp)
+            tmp = sStorage->GetSlideElementById(left);
+
+        if (tmp)
+        {
+            if (EqualString(right, L"x", true))
+                result = (int64)tmp->GetVisiblePosition(0);
+            else if (EqualString(right, L"y", true))
+                result = (int64)tmp->GetVisiblePosition(1);
+        }
     }
 
-    SlideElement* tmp = NULL;
-    for (SlideList::iterator itr = m_activeElements.begin(); itr != m_activeElements.end(); ++itr)
+    // left side is the input itself, when there's no delimiter
+    if (left != input)
+        delete[] left;
+    if (right)
+        delete[] right;
+
+    return result;
+}
+
+uint32 PresentationMgr::BenchmarkExpressions(char* buffer, uint32 size)
+{
+    std::vector<ExpressionTreeElement*> trees;
+    std::vector<ExpressionProgram*> programs;
+
+    SlideElement* elem;
+    for (uint32 pos = 0; (elem = sStorage->GetSlideElement(pos)) != NULL; pos++)
     {
-        if (EqualString((*itr)->elemId, left))
+        if (elem->elemType != SLIDE_ELEM_TEXT || !elem->typeText.outlistCache)
+            continue;
+
+        uint32 i = 0;
+        for (ExprMap::iterator itr = elem->typeText.outlistExpressions.begin(); itr != elem->typeText.outlistExpressions.end(); ++itr, i++)
         {
-            tmp = (*itr);
-            break;
+            if (i >= elem->typeText.outlistCache->programs.size() || !elem->typeText.outlistCache->programs[i])
+                continue;
+
+            trees.push_back(&itr->second);
+            programs.push_back(elem->typeText.outlistCache->programs[i]);
         }
     }
 
-    if (!tmp)
-        tmp = sStorage->GetSlideElementById(left);
+    uint32 i, j;
+    int64 treeSum = 0, programSum = 0;
+    uint32 mismatches = 0;
+
+    uint64 start = FrameProfiler::GetTime();
+    for (j = 0; j < EXPRESSION_BENCHMARK_ITERATIONS; j++)
+        for (i = 0; i < trees.size(); i++)
+            treeSum += NumerateExpression(trees[i]);
+    uint64 treeTime = FrameProfiler::GetTime() - start;
+
+    start = FrameProfiler::GetTime();
+    for (j = 0; j < EXPRESSION_BENCHMARK_ITERATIONS; j++)
+        for (i = 0; i < programs.size(); i++)
+            programSum += EvaluateExpression(programs[i], NULL);
+    uint64 programTime = FrameProfiler::GetTime() - start;
+
+    for (i = 0; i < trees.size(); i++)
+        if (NumerateExpression(trees[i]) != EvaluateExpression(programs[i], NULL))
+            mismatches++;
+
+    int32 len = snprintf(buffer, size, "EXPRESSIONS count=%u iterations=%u tree=%u bytecode=%u mismatches=%u checksum=%s\n",
+                         uint32(trees.size()), uint32(EXPRESSION_BENCHMARK_ITERATIONS), uint32(treeTime), uint32(programTime),
+                         mismatches, (treeSum == programSum) ? "ok" : "differs");
+
+    if (len < 0 || uint32(len) >= size)
+        return (size > 0) ? size - 1 : 0;
+
+    return uint32(len);
+}
+
+bool PresentationMgr::IsIdle()
+{
+    if (!IsBlocking() || transition.type != SST_NONE)
+        return false;
 
-    if (tmp)
+    clock_t now = clock();
+    EffectTime* canvasTimes[] = {&canvas.hardMove_time, &canvas.hardRotate_time, &canvas.hardScale_time,
+                                 &canvas.hardBlur_time, &canvas.hardColorize_time};
+    for (uint32 i = 0; i < sizeof(canvasTimes) / sizeof(EffectTime*); i++)
     {
-        if (EqualString(right, L"x", true))
-            return (int64)tmp->position[0];
-        else if (EqualString(right, L"y", true))
-            return (int64)tmp->position[1];
+        if (now < canvasTimes[i]->startTime + clock_t(canvasTimes[i]->deltaTime))
+            return false;
     }
 
-    return 0;
+    SlideList::iterator endActual = lastActual;
+    if (endActual != m_activeElements.end())
+        ++endActual;
+
+    for (SlideList::iterator itr = firstActual; itr != endActual && itr != m_activeElements.end(); ++itr)
+    {
+        if (!(*itr)->IsStatic())
+            return false;
+    }
+
+    return true;
+}
+
+void PresentationMgr::RunPendingBenchmark()
+{
+    m_benchmarkPending = false;
+
+    char report[256];
+    uint32 reportLen = BenchmarkExpressions(report, 256);
+
+    if (m_client != 0 && m_client != INVALID_SOCKET)
+        send(m_client, report, reportLen, 0);
 }
 
 void PresentationMgr::AnimateCanvas(bool before)
@@ -1213,6 +1511,23 @@ void PresentationMgr::AnimateCanvas(bool before)
     {
         glLoadIdentity();
 
+        if (canvas.hardBlur > 0.0f || canvas.baseBlur > 0.0f)
+        {
+            if (canvas.hardBlur_time.deltaTime == 0)
+                timeCoef = 1.0f;
+            else
+                timeCoef = float(clock() - canvas.hardBlur_time.startTime) / float(canvas.hardBlur_time.deltaTime);
+
+            if (timeCoef > 1.0f)
+                timeCoef = 1.0f;
+            else if (timeCoef < 0.0f)
+                timeCoef = 0.0f;
+
+            EffectHandler::CalculateEffectProgress(timeCoef, canvas.hardBlur_time.progressType);
+
+            sPostProcess->Blur(canvas.baseBlur + (canvas.hardBlur - canvas.baseBlur) * timeCoef);
+        }
+
         if (COLOR_A(canvas.hardColorizeColor) != 0 || COLOR_A(canvas.hardColorizeColor) != COLOR_A(canvas.baseColor))
         {
             if (canvas.hardColorize_time.deltaTime == 0)
@@ -1225,10 +1540,6 @@ void PresentationMgr::AnimateCanvas(bool before)
             else if (timeCoef < 0.0f)
                 timeCoef = 0.0f;
 
-            glDisable(GL_TEXTURE_2D);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
             uint8 r = 0, g = 0, b = 0;
 
             if (COLOR_A(canvas.baseColor) > 0)
@@ -1256,18 +1567,9 @@ void PresentationMgr::AnimateCanvas(bool before)
                 }
             }
 
-            glColor4ub(r, g, b,
-                       uint8(COLOR_A(canvas.baseColor) + (COLOR_A(canvas.hardColorizeColor) - COLOR_A(canvas.baseColor))*timeCoef));
-
-            glBegin(GL_QUADS);
-                glTexCoord2f(0.0f, 0.0f); glVertex2d(0, 0);
-                glTexCoord2f(1.0f, 0.0f); glVertex2d(sStorage->GetOriginalScreenWidth(), 0);
-                glTexCoord2f(1.0f, 1.0f); glVertex2d(sStorage->GetOriginalScreenWidth(), sStorage->GetOriginalScreenHeight());
-                glTexCoord2f(0.0f, 1.0f); glVertex2d(0, sStorage->GetOriginalScreenHeight());
-            glEnd();
+            uint8 a = uint8(COLOR_A(canvas.baseColor) + (COLOR_A(canvas.hardColorizeColor) - COLOR_A(canvas.baseColor))*timeCoef);
 
-            glDisable(GL_BLEND);
-            glColor4ub(255, 255, 255, 255);
+            sPostProcess->Colorize(MAKE_COLOR_RGBA(r, g, b, a));
         }
     }
 }
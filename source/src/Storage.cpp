@@ -8,7 +8,9 @@
 #include "Parsers/SlideParser.h"
 #include "Parsers/EffectParser.h"
 #include "Parsers/ResourceParser.h"
+#include "Parsers/ExpressionCompiler.h"
 #include "Parsers/TemplateParser.h"
+#include "Handlers/FontRegistry.h"
 
 Storage::Storage()
 {
@@ -18,8 +20,10 @@ Storage::Storage()
     m_originalScreenWidth = 800;
     m_originalScreenHeight = 600;
     m_fullscreen = true;
+    m_cpuBlur = false;
 
     m_defaultFontId = -1;
+    m_styleGeneration = 0;
     m_defaultTextStyle = NULL;
     m_defaultStyleName = L"";
 
@@ -78,6 +82,9 @@ bool Storage::ParseInputFiles()
             return false;
     }
 
+    if (!EffectParser::ResolveChains())
+        return false;
+
     for (std::list<std::wstring>::const_iterator itr = m_resourceFiles.begin(); itr != m_resourceFiles.end(); ++itr)
     {
         if (!ResourceParser::ParseFile((*itr).c_str()))
@@ -133,49 +140,24 @@ bool Storage::IsSlideElementBlocking(SlideElement* src, bool staticOnly)
 
 void Storage::BuildStyleFonts()
 {
-    bool fontMatch = false;
-
-    for (StyleMap::iterator itr = m_styleMap.begin(); itr != m_styleMap.end(); ++itr)
+    for (std::vector<Style*>::iterator itr = m_pendingFontStyles.begin(); itr != m_pendingFontStyles.end(); ++itr)
     {
-        if (itr->second->fontId == -2)
-        {
-            // This mechanism determines, if some font with that parameters already exists
-            for (std::list<StoredFont>::const_iterator iter = m_fontMap.begin(); iter != m_fontMap.end(); ++iter)
-            {
-                // If yes, assign its ID to style definition and continue to next style
-                if (EqualString(ToUppercase(iter->fontName), ToUppercase(itr->second->fontFamily), true)
-                    && iter->fontSize == (*itr->second->fontSize)
-                    && iter->bold == itr->second->bold
-                    && iter->italic == itr->second->italic
-                    && iter->underline == itr->second->underline
-                    && iter->strikeout == itr->second->strikeout)
-                {
-                    if (iter->fontId >= 0)
-                    {
-                        itr->second->fontId = iter->fontId;
-                        fontMatch = true;
-                        break;
-                    }
-                }
-            }
-            if (fontMatch)
-                continue;
-
-            itr->second->fontId = sSimplyFlat->BuildFont(ToMultiByteString(itr->second->fontFamily), (*(itr->second->fontSize)), (itr->second->bold ? FW_BOLD : 0), itr->second->italic, itr->second->underline, itr->second->strikeout);
-
-            // Save font definition for later use
-            StoredFont fnt;
-            fnt.fontName  = itr->second->fontFamily;
-            fnt.fontSize  = (*itr->second->fontSize);
-            fnt.fontId    = itr->second->fontId;
-            fnt.bold      = itr->second->bold;
-            fnt.italic    = itr->second->italic;
-            fnt.underline = itr->second->underline;
-            fnt.strikeout = itr->second->strikeout;
-            m_fontMap.push_back(fnt);
-        }
+        Style* style = (*itr);
+
+        // style could be queued more than once
+        if (style->fontId != -2)
+            continue;
+
+        // styles differing in features only (and their markup variants) get the same font
+        style->fontId = sFontRegistry->GetFont(style->fontFamily ? style->fontFamily : DEFAULT_FONT_FAMILY,
+                                               style->fontSize ? (*(style->fontSize)) : DEFAULT_FONT_SIZE,
+                                               SlideElement::elemTextData::GetFeatureArrayIndexOf(style));
+        m_styleGeneration++;
     }
 
+    m_pendingFontStyles.clear();
+
+    // markup, which waited for some of the fonts, could be parsed now
     PostParseElements();
 }
 
@@ -224,6 +206,74 @@ void Storage::SetupDefaultStyle()
     }
 }
 
+void Storage::BuildExpressionDependencies(SlideElement* elem)
+{
+    StyledTextCache* cache = elem->typeText.outlistCache;
+
+    uint32 index = 0;
+    for (ExprMap::iterator itr = elem->typeText.outlistExpressions.begin(); itr != elem->typeText.outlistExpressions.end(); ++itr, index++)
+    {
+        ExpressionProgram* program = ExpressionProgram::Compile(&itr->second);
+        cache->programs.push_back(program);
+
+        // expression left to tree walker finds referenced elements itself, it only needs to know when they move
+        if (!program)
+        {
+            std::vector<const wchar_t*> references;
+            itr->second.GetReferences(references);
+
+            for (std::vector<const wchar_t*>::iterator ref = references.begin(); ref != references.end(); ++ref)
+            {
+                // values without element, or with unknown property, are constant
+                const wchar_t* dot = wcschr(*ref, L'.');
+                if (!dot || dot == *ref)
+                    continue;
+
+                uint8 properties = 0;
+                if (EqualString(dot + 1, L"x", true))
+                    properties = EXPR_DEP_X;
+                else if (EqualString(dot + 1, L"y", true))
+                    properties = EXPR_DEP_Y;
+
+                if (properties)
+                    AddExpressionDependent(cache, index, std::wstring(*ref, dot - *ref).c_str(), properties, NULL);
+            }
+            continue;
+        }
+
+        // reference to element, which does not exist, stays unbound and is always zero
+        for (uint32 slot = 0; slot < program->GetReferenceCount(); slot++)
+        {
+            const ExpressionReference* ref = program->GetReference(slot);
+            AddExpressionDependent(cache, index, ref->elementId.c_str(), ref->properties, program);
+        }
+    }
+}
+
+void Storage::AddExpressionDependent(StyledTextCache* cache, uint32 index, const wchar_t* elementId, uint8 properties, ExpressionProgram* program)
+{
+    // every element with that id could be the referenced one, the first created instance of them
+    // is bound to the expression, and it knows its dependents, so it could bind itself
+    for (SlideElementVector::iterator el = m_slideData.begin(); el != m_slideData.end(); ++el)
+    {
+        if ((*el)->elemType == SLIDE_ELEM_PLAY_EFFECT || !EqualString((*el)->elemId, elementId))
+            continue;
+
+        if (!(*el)->dependents)
+            (*el)->dependents = new ExpressionDependentList;
+
+        ExpressionDependent dep;
+        dep.cache = cache;
+        dep.expression = index;
+        dep.properties = properties;
+        (*el)->dependents->push_back(dep);
+
+        // until then, the first prototype is read
+        if (program)
+            program->BindElement(*el, false);
+    }
+}
+
 void Storage::SetDefaultStyleName(const wchar_t* name)
 {
     m_defaultStyleName = name;
@@ -235,7 +285,9 @@ void Storage::PostParseElements()
     {
         (*itr)->typeText.outlist = new StyledTextList;
         SlideParser::ParseMarkup((*itr)->typeText.text, (*itr)->elemStyle, (*itr)->typeText.outlist, &((*itr)->typeText.outlistExpressions));
-        if ((*itr)->typeText.outlist->size() < 2)
+
+        // some font of markup is not built yet, the element waits until fonts are built again
+        if ((*itr)->typeText.outlist->empty())
         {
             delete (*itr)->typeText.outlist;
             (*itr)->typeText.outlist = NULL;
@@ -243,6 +295,21 @@ void Storage::PostParseElements()
             continue;
         }
 
+        // plain text is drawn directly
+        if ((*itr)->typeText.outlist->size() < 2)
+        {
+            delete (*itr)->typeText.outlist;
+            (*itr)->typeText.outlist = NULL;
+            itr = m_postParseList.erase(itr);
+            continue;
+        }
+
+        (*itr)->typeText.outlistCache = new StyledTextCache;
+        (*itr)->typeText.outlistCache->values.resize((*itr)->typeText.outlistExpressions.size(), 0);
+        (*itr)->typeText.outlistCache->flags.resize((*itr)->typeText.outlistExpressions.size(), 0);
+        BuildExpressionDependencies(*itr);
+
         itr = m_postParseList.erase(itr);
+        m_styleGeneration++;
     }
 }